@@ -2,39 +2,62 @@
 
 #include "utils.h"
 
-class aabb {
+template <typename T>
+class aabbT {
 public:
-	aabb() {}
-	aabb(const point3& a, const point3& b) : m_min(a), m_max(b) {}
+	aabbT() {}
+	aabbT(const vec3T<T>& a, const vec3T<T>& b) : m_min(a), m_max(b) {}
 
-	point3 getMin() const { return m_min; }
-	point3 getMax() const { return m_max; }
+	vec3T<T> getMin() const { return m_min; }
+	vec3T<T> getMax() const { return m_max; }
 
-	static aabb surroundingBox(aabb startBox, aabb endBox) {
-		point3 small(fmin(startBox.getMin().x(), endBox.getMin().x()),
-			fmin(startBox.getMin().y(), endBox.getMin().y()),
-			fmin(startBox.getMin().z(), endBox.getMin().z()));
+	static aabbT surroundingBox(aabbT startBox, aabbT endBox) {
+		vec3T<T> small(std::fmin(startBox.getMin().x(), endBox.getMin().x()),
+			std::fmin(startBox.getMin().y(), endBox.getMin().y()),
+			std::fmin(startBox.getMin().z(), endBox.getMin().z()));
 
-		point3 big(fmax(startBox.getMax().x(), endBox.getMax().x()),
-			fmax(startBox.getMax().y(), endBox.getMax().y()),
-			fmax(startBox.getMax().z(), endBox.getMax().z()));
+		vec3T<T> big(std::fmax(startBox.getMax().x(), endBox.getMax().x()),
+			std::fmax(startBox.getMax().y(), endBox.getMax().y()),
+			std::fmax(startBox.getMax().z(), endBox.getMax().z()));
 
-		return aabb(small, big);
+		return aabbT(small, big);
 	}
 
-	bool hit(const ray& r, double tMin, double tMax) const;
+	bool hit(const rayT<T>& r, T tMin, T tMax) const;
+
+	// Slab test with the ray's reciprocal direction computed once by the caller.
+	bool hit(const rayT<T>& r, const vec3T<T>& inverseDirection, T tMin, T tMax) const;
 
 public:
-	point3 m_min;
-	point3 m_max;
+	vec3T<T> m_min;
+	vec3T<T> m_max;
 };
 
-inline bool aabb::hit(const ray& r, double tMin, double tMax) const {
+using aabb = aabbT<real>;
+
+template <typename T>
+inline bool aabbT<T>::hit(const rayT<T>& r, T tMin, T tMax) const {
+	for (int i = 0; i < 3; i++) {
+		T inverseD = 1 / r.getDirection()[i];
+		T tClose = (getMin()[i] - r.getOrigin()[i]) * inverseD;
+		T tFar = (getMax()[i] - r.getOrigin()[i]) * inverseD;
+		if (inverseD < 0) std::swap(tClose, tFar);
+		tMin = tClose > tMin ? tClose : tMin;
+		tMax = tFar < tMax ? tFar : tMax;
+		if (tMax <= tMin) return false;
+	}
+
+	return true;
+}
+
+template <typename T>
+inline bool aabbT<T>::hit(const rayT<T>& r, const vec3T<T>& inverseDirection, T tMin, T tMax) const {
+	const vec3T<T> origin = r.getOrigin();
+
 	for (int i = 0; i < 3; i++) {
-		double inverseD = 1.0 / r.getDirection()[i];
-		double tClose = (getMin()[i] - r.getOrigin()[i]) * inverseD;
-		double tFar = (getMax()[i] - r.getOrigin()[i]) * inverseD;
-		if (inverseD < 0.0) std::swap(tClose, tFar);
+		T tClose = (m_min[i] - origin[i]) * inverseDirection[i];
+		T tFar = (m_max[i] - origin[i]) * inverseDirection[i];
+		if (inverseDirection[i] < 0) std::swap(tClose, tFar);
 		tMin = tClose > tMin ? tClose : tMin;
 		tMax = tFar < tMax ? tFar : tMax;
 		if (tMax <= tMin) return false;
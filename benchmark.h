@@ -0,0 +1,274 @@
+#pragma once
+
+#include "utils.h"
+
+#include "camera.h"
+#include "hittable.h"
+#include "hittableList.h"
+#include "bvh.h"
+#include "box.h"
+#include "tm.h"
+#include "linearBvh.h"
+#include "wideBvh.h"
+#include "tlas.h"
+#include "motionBvh.h"
+#include "sphere.h"
+#include "sphereCloud.h"
+#include "sampler.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// One camera ray per pixel, followed by a diffuse bounce from wherever it lands, so the timing
+// covers coherent primary rays as well as the incoherent secondary rays that dominate a render.
+inline std::vector<ray> benchmarkRays(const camera& view, const hittable& world, int width, int height) {
+	std::vector<ray> rays;
+	rays.reserve(size_t(width) * height * 2);
+
+	sampler& random = sampler::current();
+	hitRecord record;
+
+	for (int row = 0; row < height; row++) {
+		for (int col = 0; col < width; col++) {
+			random.startSample(std::uint64_t(row) * width + col, 0);
+			real u = real((col + randomDouble()) / (width - 1));
+			real v = real((row + randomDouble()) / (height - 1));
+			ray primary = view.getRay(u, v);
+			rays.push_back(primary);
+
+			random.startBounce(0);
+			if (world.hit(primary, real(0.001), real(infinity), record))
+				rays.push_back(ray(record.point, record.normal + randomUnitVector(), primary.getTime()));
+		}
+	}
+
+	return rays;
+}
+
+// Builds every tree accelerator over the scene's primitives and traces the same rays through
+// each on one thread. Hit counts should agree, except where volumes draw random numbers in hit.
+inline void benchmarkAccelerators(
+	const std::string& name, const hittableList& entities, const camera& view, int width, int height
+) {
+	using clock = std::chrono::steady_clock;
+
+	struct candidate {
+		const char* name;
+		std::function<shared_ptr<hittable>(const hittableList&)> build;
+		shared_ptr<hittable> tree;
+		double buildMilliseconds;
+	};
+
+	std::vector<candidate> candidates = {
+		{ "bvhNode",   [](const hittableList& e) { return make_shared<bvhNode>(e, 0.0, 1.0); },   nullptr, 0.0 },
+		{ "linearBvh", [](const hittableList& e) { return make_shared<linearBvh>(e, 0.0, 1.0); }, nullptr, 0.0 },
+		{ "bvh4",      [](const hittableList& e) { return make_shared<bvh4>(e, 0.0, 1.0); },      nullptr, 0.0 },
+		{ "bvh8",      [](const hittableList& e) { return make_shared<bvh8>(e, 0.0, 1.0); },      nullptr, 0.0 },
+		{ "tlas",      [](const hittableList& e) { return make_shared<tlas>(e, 0.0, 1.0); },      nullptr, 0.0 },
+		{ "motion1",   [](const hittableList& e) { return make_shared<motionBvh>(e, 0.0, 1.0, 1); }, nullptr, 0.0 },
+		{ "motion",    [](const hittableList& e) { return make_shared<motionBvh>(e, 0.0, 1.0); },    nullptr, 0.0 },
+	};
+
+	const hittableList primitives = flattenHierarchy(entities);
+	std::cerr << name << ": " << primitives.m_objects.size() << " primitives\n";
+
+	for (candidate& c : candidates) {
+		auto start = clock::now();
+		c.tree = c.build(primitives);
+		c.buildMilliseconds = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	}
+
+	const std::vector<ray> rays = benchmarkRays(view, *candidates[0].tree, width, height);
+	std::cerr << "Tracing " << rays.size() << " rays (" << width << "x" << height << " camera rays plus one bounce)\n";
+
+	double baselineSeconds = 0.0;
+	for (const candidate& c : candidates) {
+		hitRecord record;
+		std::uint64_t hits = 0;
+
+		auto start = clock::now();
+		for (const ray& r : rays) {
+			if (c.tree->hit(r, real(0.001), real(infinity), record)) hits++;
+		}
+		double seconds = std::chrono::duration<double>(clock::now() - start).count();
+		if (baselineSeconds == 0.0) baselineSeconds = seconds;
+
+		std::cerr << std::fixed << std::setprecision(2)
+			<< "  " << std::left << std::setw(10) << c.name << std::right
+			<< "  build " << std::setw(9) << c.buildMilliseconds << " ms"
+			<< "  trace " << std::setw(8) << rays.size() / seconds * 1e-6 << " Mrays/s"
+			<< "  " << std::setw(5) << baselineSeconds / seconds << "x"
+			<< "  hits " << hits << '\n' << std::defaultfloat << std::setprecision(6);
+	}
+}
+
+// Compares the slab-test box with the six-rectangle aaBox on a 20x20 grid of boxes like the
+// final scene's ground, each layout under its own linearBvh and traced with the same rays.
+inline void benchmarkBoxes(const camera& view, int width, int height) {
+	using clock = std::chrono::steady_clock;
+
+	hittableList slabBoxes, rectangleBoxes;
+	size_t rectangleBytes = 0;
+	auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+
+	for (int i = 0; i < 20; i++) {
+		for (int j = 0; j < 20; j++) {
+			point3 p0(-1000.0 + i * 100.0, 0.0, -1000.0 + j * 100.0);
+			point3 p1 = p0 + vec3(100.0, 1.0 + (i * 37 + j * 61) % 100, 100.0);
+
+			slabBoxes.add(make_shared<box>(p0, p1, ground));
+			auto legacy = make_shared<aaBox>(p0, p1, ground);
+			rectangleBytes += legacy->getByteSize();
+			rectangleBoxes.add(legacy);
+		}
+	}
+
+	const size_t count = slabBoxes.m_objects.size();
+	const size_t slabBytes = count * (sizeof(box) + 2 * sizeof(void*));
+
+	linearBvh slabTree(slabBoxes, 0.0, 1.0);
+	linearBvh rectangleTree(rectangleBoxes, 0.0, 1.0);
+	const std::vector<ray> rays = benchmarkRays(view, slabTree, width, height);
+
+	std::cerr << "Boxes: " << count << " boxes, " << rays.size() << " rays\n";
+
+	const std::pair<const char*, const hittable*> layouts[] = { { "aaBox", &rectangleTree }, { "box", &slabTree } };
+	const size_t bytes[] = { rectangleBytes, slabBytes };
+	double baselineSeconds = 0.0;
+	for (int k = 0; k < 2; k++) {
+		hitRecord record;
+		std::uint64_t hits = 0;
+
+		auto start = clock::now();
+		for (const ray& r : rays) {
+			if (layouts[k].second->hit(r, real(0.001), real(infinity), record)) hits++;
+		}
+		double seconds = std::chrono::duration<double>(clock::now() - start).count();
+		if (baselineSeconds == 0.0) baselineSeconds = seconds;
+
+		std::cerr << std::fixed << std::setprecision(2)
+			<< "  " << std::left << std::setw(10) << layouts[k].first << std::right
+			<< "  " << std::setw(6) << bytes[k] / count << " bytes/box"
+			<< "  trace " << std::setw(8) << rays.size() / seconds * 1e-6 << " Mrays/s"
+			<< "  " << std::setw(5) << baselineSeconds / seconds << "x"
+			<< "  hits " << hits << '\n' << std::defaultfloat << std::setprecision(6);
+	}
+}
+
+// Fills a cube in front of the camera with count spheres, once as sphere objects under a
+// linearBvh and once as a sphereCloud, and compares memory and throughput on the same rays.
+inline void benchmarkSphereCloud(size_t count, const camera& view, int width, int height) {
+	using clock = std::chrono::steady_clock;
+
+	hittableList objects;
+	sphereCloudBuffers buffers;
+	auto white = make_shared<lambertian>(color(0.73, 0.73, 0.73));
+	const std::uint32_t whiteIndex = buffers.addMaterial(white);
+	const real radius = real(10.0 / std::cbrt(count / 1000.0));
+
+	objects.m_objects.reserve(count);
+	buffers.reserve(count, false);
+	for (size_t i = 0; i < count; i++) {
+		point3 center = point3(128.0, 128.0, -100.0) + point3::random(0.0, 300.0);
+		buffers.addSphere(center, radius, whiteIndex);
+		// Built from the stored floats so both layouts hold exactly the same spheres.
+		objects.add(make_shared<sphere>(point3(buffers.cx.back(), buffers.cy.back(), buffers.cz.back()), radius, white));
+	}
+
+	auto start = clock::now();
+	linearBvh objectTree(objects, 0.0, 1.0);
+	const double objectMilliseconds = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	start = clock::now();
+	sphereCloud cloud(std::move(buffers));
+	const double cloudMilliseconds = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	// Each object, its shared_ptr control block, and the tree's pointer to it.
+	const size_t objectBytes = count * (sizeof(sphere) + 2 * sizeof(void*) + sizeof(shared_ptr<hittable>))
+		+ objectTree.getNodeCount() * sizeof(linearBvh::linearNode);
+	const std::vector<ray> rays = benchmarkRays(view, objectTree, width, height);
+	std::cerr << "Spheres: " << count << " spheres, " << rays.size() << " rays\n";
+
+	const std::pair<const char*, const hittable*> layouts[] = { { "sphere", &objectTree }, { "sphereCloud", &cloud } };
+	const size_t bytes[] = { objectBytes, cloud.getByteSize() };
+	const double buildMilliseconds[] = { objectMilliseconds, cloudMilliseconds };
+	double baselineSeconds = 0.0;
+	for (int k = 0; k < 2; k++) {
+		hitRecord record;
+		std::uint64_t hits = 0;
+
+		start = clock::now();
+		for (const ray& r : rays) {
+			if (layouts[k].second->hit(r, real(0.001), real(infinity), record)) hits++;
+		}
+		double seconds = std::chrono::duration<double>(clock::now() - start).count();
+		if (baselineSeconds == 0.0) baselineSeconds = seconds;
+
+		std::cerr << std::fixed << std::setprecision(2)
+			<< "  " << std::left << std::setw(11) << layouts[k].first << std::right
+			<< "  " << std::setw(6) << double(bytes[k]) / count << " bytes/sphere"
+			<< "  build " << std::setw(9) << buildMilliseconds[k] << " ms"
+			<< "  trace " << std::setw(8) << rays.size() / seconds * 1e-6 << " Mrays/s"
+			<< "  " << std::setw(5) << baselineSeconds / seconds << "x"
+			<< "  hits " << hits << '\n' << std::defaultfloat << std::setprecision(6);
+	}
+}
+
+// Moves every instance of a two-level tree and compares refitting the top level with building
+// it again, then traces the same rays through both results.
+inline void benchmarkRefit(const std::string& name, const hittableList& entities, const camera& view, int width, int height) {
+	using clock = std::chrono::steady_clock;
+	auto milliseconds = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	tlas refitted(entities, 0.0, 1.0);
+	std::cerr << name << ": " << refitted.getInstanceCount() << " instances of " << refitted.getShapeCount() << " shapes\n";
+
+	// Drift every transformed instance sideways, as an animation step would.
+	hittableList moved;
+	auto start = clock::now();
+	for (size_t i = 0; i < refitted.getInstanceCount(); i++) {
+		const instance& placed = refitted.getInstance(i);
+		affineTransform step = affineTransform::translate(vec3(real(0.3) * std::sin(real(i)), 0, real(0.3) * std::cos(real(i))));
+		if (!refitted.isTransformed(i)) {
+			moved.add(placed.m_object);
+			continue;
+		}
+		affineTransform toWorld = step * placed.m_toWorld;
+		moved.add(make_shared<instance>(placed.m_object, toWorld));
+		refitted.setTransform(i, toWorld);
+	}
+	double updateMilliseconds = milliseconds(start);
+
+	start = clock::now();
+	refitted.refit();
+	double refitMilliseconds = milliseconds(start);
+
+	start = clock::now();
+	tlas rebuilt(moved, 0.0, 1.0);
+	double rebuildMilliseconds = milliseconds(start);
+
+	const std::vector<ray> rays = benchmarkRays(view, rebuilt, width, height);
+	const std::pair<const char*, const tlas*> trees[] = { { "rebuilt", &rebuilt }, { "refitted", &refitted } };
+
+	std::cerr << std::fixed << std::setprecision(2)
+		<< "  transform update " << updateMilliseconds << " ms, refit " << refitMilliseconds
+		<< " ms, rebuild " << rebuildMilliseconds << " ms\n";
+	for (const auto& tree : trees) {
+		hitRecord record;
+		std::uint64_t hits = 0;
+		start = clock::now();
+		for (const ray& r : rays) {
+			if (tree.second->hit(r, real(0.001), real(infinity), record)) hits++;
+		}
+		double seconds = milliseconds(start) * 1e-3;
+		std::cerr << "  " << std::left << std::setw(10) << tree.first << std::right
+			<< "  trace " << std::setw(8) << rays.size() / seconds * 1e-6 << " Mrays/s  hits " << hits << '\n';
+	}
+	std::cerr << std::defaultfloat << std::setprecision(6);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "utils.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <utility>
+
+// Axis-aligned box intersected with a single slab test. The slab that decides the hit gives the
+// face, so the normal and texture coordinates follow without testing the sides one by one. Face
+// UVs match the aaRectangle that used to make up each side.
+class box : public hittable {
+public:
+	box() {}
+	box(const point3& p0, const point3& p1, shared_ptr<material> material_ptr)
+		: m_min(std::fmin(p0.x(), p1.x()), std::fmin(p0.y(), p1.y()), std::fmin(p0.z(), p1.z())),
+		  m_max(std::fmax(p0.x(), p1.x()), std::fmax(p0.y(), p1.y()), std::fmax(p0.z(), p1.z())),
+		  m_material_ptr(material_ptr) {}
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	// The hit face is kept as primitive = 2 * axis + (1 for the max face).
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+	virtual void fillAttributes(const ray& r, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		outputBox = aabb(m_min, m_max);
+		return true;
+	}
+
+public:
+	point3 m_min;
+	point3 m_max;
+	shared_ptr<material> m_material_ptr;
+};
+
+bool box::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	const point3& origin = r.getOrigin();
+	const vec3& direction = r.getDirection();
+
+	real tNear = -real(infinity), tFar = real(infinity);
+	int nearAxis = 0, farAxis = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		real inverse = 1 / direction[axis];
+		real t0 = (m_min[axis] - origin[axis]) * inverse;
+		real t1 = (m_max[axis] - origin[axis]) * inverse;
+		if (inverse < 0) std::swap(t0, t1);
+
+		if (t0 > tNear) { tNear = t0; nearAxis = axis; }
+		if (t1 < tFar) { tFar = t1; farAxis = axis; }
+	}
+	if (tNear > tFar) return false;
+
+	// The entry face, or the exit face for rays that start inside (volumes need both).
+	bool entering = tNear >= tMin && tNear <= tMax;
+	if (!entering && (tFar < tMin || tFar > tMax)) return false;
+
+	const int axis = entering ? nearAxis : farAxis;
+	const bool maxFace = (direction[axis] > 0) != entering;
+
+	record.t = entering ? tNear : tFar;
+	record.object = this;
+	record.primitive = 2 * axis + (maxFace ? 1 : 0);
+	return true;
+}
+
+void box::fillAttributes(const ray& r, hitRecord& record) const {
+	const int axis = record.primitive / 2;
+	const bool maxFace = record.primitive & 1;
+
+	point3 p = r.resize(record.t);
+	p[axis] = maxFace ? m_max[axis] : m_min[axis];
+
+	vec3 outwardNormal;
+	outwardNormal[axis] = maxFace ? real(1) : real(-1);
+
+	const int uAxis = axis == 0 ? 1 : 0;
+	const int vAxis = axis == 2 ? 1 : 2;
+	record.u = std::clamp((p[uAxis] - m_min[uAxis]) / (m_max[uAxis] - m_min[uAxis]), real(0), real(1));
+	record.v = std::clamp((p[vAxis] - m_min[vAxis]) / (m_max[vAxis] - m_min[vAxis]), real(0), real(1));
+
+	record.dpdu = record.dpdv = vec3(0, 0, 0);
+	record.dpdu[uAxis] = m_max[uAxis] - m_min[uAxis];
+	record.dpdv[vAxis] = m_max[vAxis] - m_min[vAxis];
+
+	record.point = p;
+	record.setFaceNormal(r, outwardNormal);
+	record.material_ptr = m_material_ptr.get();
+}
@@ -4,26 +4,34 @@
 
 #include "hittable.h"
 #include "hittableList.h"
+#include "bvhBuilder.h"
 
-#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
 
 class bvhNode : public hittable {
 public:
 	bvhNode() {}
 
-	bvhNode(const hittableList& entities, double startTime, double endTime)
-		: bvhNode(std::vector<shared_ptr<hittable>>(entities.m_objects), size_t(0), entities.m_objects.size(), startTime, endTime) {}
+	bvhNode(const hittableList& entities, real startTime, real endTime)
+		: bvhNode(entities.m_objects, size_t(0), entities.m_objects.size(), startTime, endTime) {}
 
 	bvhNode(
-		std::vector<shared_ptr<hittable>>& srcObjects, size_t start, size_t end, double startTime, double endTime
+		const std::vector<shared_ptr<hittable>>& srcObjects, size_t start, size_t end, real startTime, real endTime
 	);
 
-	virtual bool hit(
-		const ray& r, double tMin, double tMax, hitRecord& record
-	) const override;
+	// Converts one node of a finished build, along with its subtree.
+	bvhNode(const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects);
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
 
 	virtual bool getAABB(
-		double startTime, double endTime, aabb& outputBox
+		real startTime, real endTime, aabb& outputBox
 	) const override;
 
 public:
@@ -33,86 +41,70 @@ public:
 	aabb m_box;
 };
 
-inline bool boxCompare(const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis) {
-	aabb boxA;
-	aabb boxB;
+bvhNode::bvhNode(const std::vector<shared_ptr<hittable>>& srcObjects,
+	size_t start, size_t end, real startTime, real endTime) {
 
-	if (!a->getAABB(0.0, 0.0, boxA) || !b->getAABB(0.0, 0.0, boxB))
-		std::cerr << "No bounding box in bvhNode constructor.\n";
+	if (start >= end) return;
 
-	return boxA.getMin()[axis] < boxB.getMin()[axis];
-}
+	// Bounds are gathered once and the split search runs on flat arrays, see bvhBuilder.
+	bvhBuilder builder(gatherBounds(srcObjects, start, end, startTime, endTime), 1);
+	builder.build();
 
-bool compareBoxX(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-	return boxCompare(a, b, 0);
-}
+	std::cerr << "bvhNode: " << end - start << " objects, " << builder.getNodeCount() << " nodes built in "
+		<< builder.getBuildMilliseconds() << " ms\n";
 
-bool compareBoxY(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-	return boxCompare(a, b, 1);
+	std::vector<shared_ptr<hittable>> objects(srcObjects.begin() + start, srcObjects.begin() + end);
+	*this = bvhNode(builder, builder.getRoot(), objects);
 }
 
-bool compareBoxZ(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-	return boxCompare(a, b, 2);
-}
-
-bvhNode::bvhNode(std::vector<shared_ptr<hittable>>& srcObjects,
-	size_t start, size_t end, double startTime, double endTime) {
-
-	std::vector<shared_ptr<hittable>> objects = srcObjects; // modifiable objects vector
-
-	// Choose random axis to split evenly down
-	int axis = randomInt(0, 2);
-	auto comparator = (axis == 0) ? compareBoxX : ((axis == 1) ? compareBoxY : compareBoxZ);
-
-	size_t objectSpan = end - start;
+bvhNode::bvhNode(const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects) {
+	const bvhBuildNode& node = builder.getNode(nodeIndex);
+	m_box = node.box;
 
-	switch (objectSpan) {
-	case 0:
+	if (node.count > 0) {
+		m_object = objects[builder.getPrimitive(node.start)];
 		return;
-	case 1:
-		m_object = objects[start];
-		m_object->getAABB(startTime, endTime, m_box);
-		return;
-	case 2:
-		if (comparator(objects[start], objects[start + 1])) {
-			m_left = make_shared<bvhNode>(objects[start], startTime, endTime);
-			m_right = make_shared<bvhNode>(objects[start + 1], startTime, endTime);
-		}
-		else {
-			m_left = make_shared<bvhNode>(objects[start + 1], startTime, endTime);
-			m_right = make_shared<bvhNode>(objects[start], startTime, endTime);
-		}
-		break;
-	default:
-		std::sort(objects.begin() + start, objects.begin() + end, comparator);
-
-		int mid = start + objectSpan / 2;
-		m_left = make_shared<bvhNode>(objects, start, mid, startTime, endTime);
-		m_right = make_shared<bvhNode>(objects, mid, end, startTime, endTime);
-		break;
 	}
 
-	aabb boxLeft, boxRight;
-
-	if (!m_left->getAABB(startTime, endTime, boxLeft)
-		|| !m_right->getAABB(startTime, endTime, boxRight)
-	) std::cerr << "No bounding box in bvhNode constructor.\n";
-
-	m_box = aabb::surroundingBox(m_left->m_box, m_right->m_box);
+	m_left = make_shared<bvhNode>(builder, node.firstChild, objects);
+	m_right = make_shared<bvhNode>(builder, node.firstChild + 1, objects);
 }
 
-bool bvhNode::hit(const ray& r, double tMin, double tMax, hitRecord& record) const {
+bool bvhNode::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
 	if (!m_box.hit(r, tMin, tMax)) return false;
 
-	if (m_object) return m_object->hit(r, tMin, tMax, record);
+	if (m_object) return m_object->intersect(r, tMin, tMax, record);
 
-	bool hitLeft = m_left->hit(r, tMin, tMax, record);
-	bool hitRight = m_right->hit(r, tMin, hitLeft ? record.t : tMax, record);
+	bool hitLeft = m_left->intersect(r, tMin, tMax, record);
+	bool hitRight = m_right->intersect(r, tMin, hitLeft ? record.t : tMax, record);
 
 	return hitLeft || hitRight;
 }
 
-bool bvhNode::getAABB(double startTime, double endTime, aabb& outputBox) const {
+bool bvhNode::getAABB(real startTime, real endTime, aabb& outputBox) const {
 	outputBox = m_box;
 	return true;
 }
+
+// Expands nested lists and bvhNode trees into their primitives, so a top-level accelerator
+// sees every object instead of opaque subtrees built by the scene code.
+inline void appendPrimitives(const shared_ptr<hittable>& object, std::vector<shared_ptr<hittable>>& primitives) {
+	if (auto list = std::dynamic_pointer_cast<hittableList>(object)) {
+		for (const auto& child : list->m_objects) appendPrimitives(child, primitives);
+	} else if (auto node = std::dynamic_pointer_cast<bvhNode>(object)) {
+		if (node->m_object) {
+			appendPrimitives(node->m_object, primitives);
+		} else {
+			appendPrimitives(node->m_left, primitives);
+			appendPrimitives(node->m_right, primitives);
+		}
+	} else {
+		primitives.push_back(object);
+	}
+}
+
+inline hittableList flattenHierarchy(const hittableList& entities) {
+	hittableList flattened;
+	for (const auto& object : entities.m_objects) appendPrimitives(object, flattened.m_objects);
+	return flattened;
+}
@@ -0,0 +1,351 @@
+#pragma once
+
+#include "utils.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+inline double surfaceArea(const aabb& box) {
+	vec3 d = box.getMax() - box.getMin();
+	return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+// Enlarges box in place to also enclose other; cheaper than surroundingBox in the build loops.
+inline void growBox(aabb& box, const aabb& other) {
+	for (int a = 0; a < 3; a++) {
+		box.m_min[a] = std::min(box.m_min[a], other.m_min[a]);
+		box.m_max[a] = std::max(box.m_max[a], other.m_max[a]);
+	}
+}
+
+// Nearest float at or below, and at or above, value: float boxes rounded this way still enclose
+// what they bound. Values beyond the float range round to the largest float or to infinity.
+inline float roundDown(double value) {
+	if (value > FLT_MAX) return FLT_MAX;
+	if (value < -FLT_MAX) return -INFINITY;
+	float f = static_cast<float>(value);
+	return double(f) > value ? std::nextafter(f, -FLT_MAX) : f;
+}
+
+inline float roundUp(double value) {
+	if (value < -FLT_MAX) return -FLT_MAX;
+	if (value > FLT_MAX) return INFINITY;
+	float f = static_cast<float>(value);
+	return double(f) < value ? std::nextafter(f, FLT_MAX) : f;
+}
+
+// Primitive bounds as the builder keeps them, in float whatever real is, which halves the
+// builder's memory in double builds; node boxes grown from them still enclose every primitive,
+// if need be with infinite sides.
+struct buildBounds {
+	float min[3];
+	float max[3];
+
+	static buildBounds fromBox(const aabb& box) {
+		buildBounds bounds;
+		for (int a = 0; a < 3; a++) {
+			bounds.min[a] = roundDown(box.m_min[a]);
+			bounds.max[a] = roundUp(box.m_max[a]);
+		}
+		return bounds;
+	}
+
+	void grow(const buildBounds& other) {
+		for (int a = 0; a < 3; a++) {
+			min[a] = std::min(min[a], other.min[a]);
+			max[a] = std::max(max[a], other.max[a]);
+		}
+	}
+
+	double getSurfaceArea() const {
+		const double dx = double(max[0]) - min[0], dy = double(max[1]) - min[1], dz = double(max[2]) - min[2];
+		return 2.0 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	aabb toBox() const { return aabb(point3(min[0], min[1], min[2]), point3(max[0], max[1], max[2])); }
+};
+
+// Node of a finished build. Children of an interior node are always allocated as a pair, so
+// the second child is firstChild + 1.
+struct bvhBuildNode {
+	aabb box;
+	std::uint32_t firstChild; // Interior nodes only
+	std::uint32_t start;      // Leaf: first entry of the builder's primitive order
+	std::uint32_t count;      // Leaf: number of primitives, zero for interior nodes
+	std::uint8_t axis;        // Interior: split axis
+};
+
+// Builds a BVH over precomputed primitive bounds, shared by bvhNode, linearBvh and the other
+// trees. Bounds and centroids are read from flat arrays (no virtual calls while building), the
+// primitive order is partitioned in place with binned SAH splits, and subtrees above a size
+// threshold are built as separate tasks on a thread pool. Splits depend only on the input, so
+// the resulting tree is the same for any thread count; only node indices may differ.
+// Once the SAH could push a subtree past s_maxDepth, the builder switches to median splits.
+// Nodes are allocated in blocks as the build reaches them, so memory follows the nodes made
+// rather than the 2n - 1 that single-primitive leaves would need, and the primitive bounds are
+// released once the tree is built.
+class bvhBuilder {
+public:
+	// Deepest leaf of any tree, in edges from the root. Traversals push at most one node per
+	// level, so stacks of this size never overflow.
+	static const int s_maxDepth = 48;
+
+	// SAH cost of a node visit, in units of one primitive test through a virtual hit call.
+	static constexpr double s_traversalCost = 0.125;
+
+	// primitiveCost is the cost of one primitive test in the same units; leaves that test
+	// several primitives at once with SIMD pass less than 1 and come out fuller.
+	bvhBuilder(std::vector<aabb> bounds, int maxLeafSize, double primitiveCost = 1.0);
+	bvhBuilder(std::vector<buildBounds> bounds, int maxLeafSize, double primitiveCost = 1.0);
+
+	// Builds once; the primitive bounds are gone afterwards.
+	void build(unsigned threadCount = threadPool::defaultThreadCount());
+
+	bool isEmpty() const { return m_order.empty(); }
+	std::uint32_t getRoot() const { return 0; }
+	const bvhBuildNode& getNode(std::uint32_t index) const { return m_blocks[index >> s_blockShift][index & (s_blockSize - 1)]; }
+	size_t getNodeCount() const { return m_nodeCount; }
+	int getDepth() const { return m_depth; }
+
+	// Index into the caller's primitive array for a leaf's i-th entry.
+	std::uint32_t getPrimitive(std::uint32_t orderIndex) const { return m_order[orderIndex]; }
+
+	double getBuildMilliseconds() const { return m_buildMilliseconds; }
+
+private:
+	void buildRange(std::uint32_t nodeIndex, std::uint32_t start, std::uint32_t end, int depth, threadPool* pool);
+	void makeLeaf(std::uint32_t nodeIndex, std::uint32_t start, std::uint32_t end, int depth, const buildBounds& bounds);
+
+	bvhBuildNode& nodeAt(std::uint32_t index) { return m_blocks[index >> s_blockShift][index & (s_blockSize - 1)]; }
+	std::uint32_t allocatePair();
+
+	// Twice the centroid, which orders and bins primitives the same way; clamped so infinite
+	// sides still give a finite value.
+	double centroid(std::uint32_t primitive, int axis) const {
+		const buildBounds& bounds = m_bounds[primitive];
+		return double(std::max(bounds.min[axis], -FLT_MAX)) + std::min(bounds.max[axis], FLT_MAX);
+	}
+
+private:
+	// Subtrees with fewer primitives are built on the thread that split their parent.
+	static const std::uint32_t s_parallelThreshold = 4096;
+	static const int s_bucketCount = 12;
+	static const int s_blockShift = 12;
+	static const std::uint32_t s_blockSize = 1u << s_blockShift;
+
+	std::vector<buildBounds> m_bounds;
+	std::vector<std::uint32_t> m_order;
+	std::vector<std::unique_ptr<bvhBuildNode[]>> m_blocks; // Null until the build reaches them
+	std::mutex m_blockMutex;
+	std::atomic<std::uint32_t> m_nodeCount;
+	std::atomic<int> m_depth;
+	int m_maxLeafSize;
+	double m_primitiveCost;
+	double m_buildMilliseconds;
+};
+
+// Collects every object's bounds once, in parallel chunks for large scenes.
+inline std::vector<aabb> gatherBounds(
+	const std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, real startTime, real endTime
+) {
+	std::vector<aabb> bounds(end - start);
+
+	auto gatherChunk = [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			if (!objects[start + i]->getAABB(startTime, endTime, bounds[i]))
+				std::cerr << "No bounding box in BVH constructor.\n";
+		}
+	};
+
+	const size_t chunkSize = 16384;
+	if (bounds.size() <= chunkSize) {
+		gatherChunk(0, bounds.size());
+		return bounds;
+	}
+
+	threadPool pool;
+	for (size_t first = 0; first < bounds.size(); first += chunkSize)
+		pool.submit([&, first] { gatherChunk(first, std::min(first + chunkSize, bounds.size())); });
+	pool.wait();
+
+	return bounds;
+}
+
+inline bvhBuilder::bvhBuilder(std::vector<aabb> bounds, int maxLeafSize, double primitiveCost)
+	: bvhBuilder(std::vector<buildBounds>(), maxLeafSize, primitiveCost) {
+	m_bounds.resize(bounds.size());
+	m_order.resize(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++) {
+		m_bounds[i] = buildBounds::fromBox(bounds[i]);
+		m_order[i] = static_cast<std::uint32_t>(i);
+	}
+}
+
+inline bvhBuilder::bvhBuilder(std::vector<buildBounds> bounds, int maxLeafSize, double primitiveCost)
+	: m_bounds(std::move(bounds)), m_nodeCount(0), m_depth(0), m_maxLeafSize(std::max(1, maxLeafSize)), m_primitiveCost(primitiveCost),
+	  m_buildMilliseconds(0.0) {
+	m_order.resize(m_bounds.size());
+	for (size_t i = 0; i < m_bounds.size(); i++) m_order[i] = static_cast<std::uint32_t>(i);
+}
+
+inline std::uint32_t bvhBuilder::allocatePair() {
+	const std::uint32_t first = m_nodeCount.fetch_add(2);
+	std::lock_guard<std::mutex> lock(m_blockMutex);
+	for (std::uint32_t index : { first, first + 1 }) {
+		auto& block = m_blocks[index >> s_blockShift];
+		if (!block) block.reset(new bvhBuildNode[s_blockSize]);
+	}
+	return first;
+}
+
+inline void bvhBuilder::build(unsigned threadCount) {
+	auto startTime = std::chrono::steady_clock::now();
+
+	m_blocks.clear();
+	m_depth = 0;
+	if (!m_order.empty()) {
+		m_blocks.resize(((2 * m_order.size() - 1) >> s_blockShift) + 1);
+		m_blocks[0].reset(new bvhBuildNode[s_blockSize]);
+		m_nodeCount = 1;
+
+		const std::uint32_t count = static_cast<std::uint32_t>(m_order.size());
+		if (threadCount > 1 && count > s_parallelThreshold) {
+			threadPool pool(threadCount);
+			pool.submit([this, count, &pool] { buildRange(0, 0, count, 0, &pool); });
+			pool.wait();
+		} else {
+			buildRange(0, 0, count, 0, nullptr);
+		}
+	}
+	std::vector<buildBounds>().swap(m_bounds);
+
+	m_buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+inline void bvhBuilder::makeLeaf(std::uint32_t nodeIndex, std::uint32_t start, std::uint32_t end, int depth, const buildBounds& bounds) {
+	nodeAt(nodeIndex) = { bounds.toBox(), 0, start, end - start, 0 };
+	int deepest = m_depth.load();
+	while (depth > deepest && !m_depth.compare_exchange_weak(deepest, depth)) {}
+}
+
+inline void bvhBuilder::buildRange(std::uint32_t nodeIndex, std::uint32_t start, std::uint32_t end, int depth, threadPool* pool) {
+	buildBounds bounds = m_bounds[m_order[start]];
+	double centroidMin[3], centroidMax[3];
+	for (int a = 0; a < 3; a++) centroidMin[a] = centroidMax[a] = centroid(m_order[start], a);
+
+	for (std::uint32_t i = start + 1; i < end; i++) {
+		bounds.grow(m_bounds[m_order[i]]);
+		for (int a = 0; a < 3; a++) {
+			const double c = centroid(m_order[i], a);
+			centroidMin[a] = std::min(centroidMin[a], c);
+			centroidMax[a] = std::max(centroidMax[a], c);
+		}
+	}
+
+	const std::uint32_t count = end - start;
+	if (count == 1) return makeLeaf(nodeIndex, start, end, depth, bounds);
+
+	// Split along the axis where the centroids spread the most.
+	const double extent[3] = { centroidMax[0] - centroidMin[0], centroidMax[1] - centroidMin[1], centroidMax[2] - centroidMin[2] };
+	int axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+	std::uint32_t mid = start + count / 2;
+
+	// Median splits halve the count, so a subtree needs ceil(log2(count)) levels below it. SAH
+	// splits may be lopsided (geometrically spaced primitives peel off one per level), so they
+	// are only taken while that many levels remain.
+	int levelsNeeded = 0;
+	while ((std::uint64_t(1) << levelsNeeded) < count) levelsNeeded++;
+	const bool useSah = depth + levelsNeeded < s_maxDepth;
+
+	if (extent[axis] <= 0.0 || !useSah) {
+		// No plane separates the centroids, or the depth is used up: halve the range instead.
+		if (count <= std::uint32_t(m_maxLeafSize)) return makeLeaf(nodeIndex, start, end, depth, bounds);
+		if (extent[axis] > 0.0) {
+			std::nth_element(m_order.begin() + start, m_order.begin() + mid, m_order.begin() + end,
+				[&](std::uint32_t a, std::uint32_t b) { return centroid(a, axis) < centroid(b, axis); });
+		}
+	} else {
+		// Bin the centroids and evaluate the SAH cost at every bucket boundary.
+		const double scale = s_bucketCount / extent[axis];
+		const double axisMin = centroidMin[axis];
+		auto bucketOf = [&](std::uint32_t primitive) {
+			int b = static_cast<int>((centroid(primitive, axis) - axisMin) * scale);
+			return std::min(b, s_bucketCount - 1);
+		};
+
+		int bucketCounts[s_bucketCount] = {};
+		buildBounds bucketBoxes[s_bucketCount];
+		for (std::uint32_t i = start; i < end; i++) {
+			int b = bucketOf(m_order[i]);
+			const buildBounds& box = m_bounds[m_order[i]];
+			if (bucketCounts[b] == 0) bucketBoxes[b] = box;
+			else bucketBoxes[b].grow(box);
+			bucketCounts[b]++;
+		}
+
+		// Sweep from the right to get every right-hand side, then from the left.
+		double rightArea[s_bucketCount] = {};
+		int rightCount[s_bucketCount] = {};
+		buildBounds running;
+		int runningCount = 0;
+		for (int b = s_bucketCount - 1; b > 0; b--) {
+			if (bucketCounts[b] > 0) {
+				if (runningCount == 0) running = bucketBoxes[b];
+				else running.grow(bucketBoxes[b]);
+				runningCount += bucketCounts[b];
+			}
+			rightArea[b] = runningCount > 0 ? running.getSurfaceArea() : 0.0;
+			rightCount[b] = runningCount;
+		}
+
+		const double parentArea = std::max(bounds.getSurfaceArea(), 1e-300);
+		double bestCost = infinity;
+		int bestSplit = 1;
+		runningCount = 0;
+		for (int b = 0; b < s_bucketCount - 1; b++) {
+			if (bucketCounts[b] > 0) {
+				if (runningCount == 0) running = bucketBoxes[b];
+				else running.grow(bucketBoxes[b]);
+				runningCount += bucketCounts[b];
+			}
+			if (runningCount == 0 || rightCount[b + 1] == 0) continue;
+
+			double cost = s_traversalCost + m_primitiveCost
+				* (runningCount * running.getSurfaceArea() + rightCount[b + 1] * rightArea[b + 1]) / parentArea;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestSplit = b + 1;
+			}
+		}
+
+		if (count <= std::uint32_t(m_maxLeafSize) && m_primitiveCost * count <= bestCost)
+			return makeLeaf(nodeIndex, start, end, depth, bounds);
+
+		auto midIter = std::partition(m_order.begin() + start, m_order.begin() + end,
+			[&](std::uint32_t primitive) { return bucketOf(primitive) < bestSplit; });
+		mid = static_cast<std::uint32_t>(midIter - m_order.begin());
+		if (mid == start || mid == end) mid = start + count / 2;
+	}
+
+	std::uint32_t firstChild = allocatePair();
+	nodeAt(nodeIndex) = { bounds.toBox(), firstChild, 0, 0, static_cast<std::uint8_t>(axis) };
+
+	if (pool && end - mid > s_parallelThreshold) {
+		pool->submit([this, firstChild, mid, end, depth, pool] { buildRange(firstChild + 1, mid, end, depth + 1, pool); });
+	} else {
+		buildRange(firstChild + 1, mid, end, depth + 1, pool);
+	}
+	buildRange(firstChild, start, mid, depth + 1, pool);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "utils.h"
+#include "rayDifferential.h"
 
 class camera {
 public:
@@ -8,17 +9,17 @@ public:
 		point3 lookFrom,
 		point3 lookAt,
 		vec3 vUp,
-		double vFovDegrees,
-		double aspectRatio,
-		double aperture,
-		double focusDistance,
-		double startTime = 0.0,
-		double endTime = 0.0
+		real vFovDegrees,
+		real aspectRatio,
+		real aperture,
+		real focusDistance,
+		real startTime = 0.0,
+		real endTime = 0.0
 	) {
-		double theta = degreesToRadians(vFovDegrees);
-		double h = tan(theta / 2.0);
-		double viewportHeight = 2.0 * h;
-		double viewportWidth = aspectRatio * viewportHeight;
+		real theta = degreesToRadians(vFovDegrees);
+		real h = tan(theta / 2.0);
+		real viewportHeight = 2.0 * h;
+		real viewportWidth = aspectRatio * viewportHeight;
 
 		m_w = unitVector(lookFrom - lookAt);
 		m_u = unitVector(cross(vUp, m_w));
@@ -34,7 +35,7 @@ public:
 		m_endTime = endTime;
 	}
 
-	ray getRay(double s, double t) const {
+	ray getRay(real s, real t) const {
 		vec3 rd = m_lensRadius * randomInUnitDisk();
 		vec3 m_offset = m_u * rd.x() + m_v * rd.y();
 
@@ -45,12 +46,23 @@ public:
 		);
 	}
 
+	// The same ray, with its differentials for steps of ds and dt to the neighbouring pixels.
+	// Neighbours share the lens sample, so only the direction changes.
+	ray getRay(real s, real t, real ds, real dt, rayDifferential& differential) const {
+		ray r = getRay(s, t);
+		differential.dOriginDx = differential.dOriginDy = vec3(0.0, 0.0, 0.0);
+		differential.dDirectionDx = unitVectorDerivative(r.getDirection(), ds * m_horizontal);
+		differential.dDirectionDy = unitVectorDerivative(r.getDirection(), dt * m_vertical);
+		differential.valid = true;
+		return r;
+	}
+
 private:
 	point3 m_origin;
 	point3 m_lowerLeftCorner;
 	vec3 m_horizontal;
 	vec3 m_vertical;
 	vec3 m_u, m_v, m_w;
-	double m_lensRadius;
-	double m_startTime, m_endTime; // Shutter open, close times
+	real m_lensRadius;
+	real m_startTime, m_endTime; // Shutter open, close times
 };
\ No newline at end of file
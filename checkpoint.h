@@ -0,0 +1,112 @@
+#pragma once
+
+#include "framebuffer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Everything needed to continue a progressive render where it stopped. The sampler is
+// counter based, so each pixel's sample count is its complete RNG position: sample s of a
+// pixel draws the same numbers whether it is rendered now or after a resume.
+struct checkpointInfo {
+	std::uint32_t sceneId = 0;
+	std::uint32_t seed = 0;
+	std::int32_t width = 0;
+	std::int32_t height = 0;
+	std::int32_t maxDepth = 0;
+	std::uint32_t realSize = sizeof(real); // Float and double builds trace slightly different paths
+	std::uint32_t textureFiltering = 1;
+	std::int32_t noiseVolumeResolution = 0;
+	std::uint64_t meshHash = 0; // Geometry of a --mesh render, zero for the built-in scenes
+};
+
+namespace checkpointDetail {
+	const char magic[4] = { 'R', 'T', 'C', 'K' };
+	const std::uint32_t version = 6;
+
+	struct fileHeader {
+		char magic[4];
+		std::uint32_t version;
+		checkpointInfo info;
+	};
+}
+
+// Writes to a temporary file first and renames it, so a machine preempted mid-write still
+// leaves the previous checkpoint intact.
+inline bool saveCheckpoint(const std::string& path, const checkpointInfo& info, const framebuffer& image) {
+	using namespace checkpointDetail;
+
+	const std::string tempPath = path + ".tmp";
+	std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+	if (!file) {
+		std::cerr << "ERROR: Could not open checkpoint '" << tempPath << "' for writing.\n";
+		return false;
+	}
+
+	fileHeader header;
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.info = info;
+
+	const size_t n = image.getPixelCount();
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+		&& std::fwrite(image.m_pixels.data(), sizeof(colorSum), n, file) == n
+		&& std::fwrite(image.m_squares.data(), sizeof(double), n, file) == n
+		&& std::fwrite(image.m_counts.data(), sizeof(std::uint32_t), n, file) == n;
+	ok = std::fclose(file) == 0 && ok;
+
+	if (ok) {
+		std::remove(path.c_str()); // rename does not replace existing files on Windows
+		ok = std::rename(tempPath.c_str(), path.c_str()) == 0;
+	}
+
+	if (!ok) std::cerr << "ERROR: Failed to write checkpoint '" << path << "'.\n";
+	return ok;
+}
+
+// Loads the accumulated sums if the file exists and was written for the same render setup.
+inline bool loadCheckpoint(const std::string& path, const checkpointInfo& expected, framebuffer& image) {
+	using namespace checkpointDetail;
+
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if (!file) return false;
+
+	fileHeader header;
+	bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+		&& std::memcmp(header.magic, magic, sizeof(magic)) == 0
+		&& header.version == version;
+
+	if (!ok) {
+		std::cerr << "Checkpoint '" << path << "' is unreadable, starting over.\n";
+		std::fclose(file);
+		return false;
+	}
+
+	const checkpointInfo& info = header.info;
+	if ((info.sceneId != expected.sceneId || info.seed != expected.seed || info.width != expected.width
+		|| info.height != expected.height || info.maxDepth != expected.maxDepth || info.realSize != expected.realSize
+		|| info.textureFiltering != expected.textureFiltering || info.noiseVolumeResolution != expected.noiseVolumeResolution
+		|| info.meshHash != expected.meshHash)) {
+		std::cerr << "Checkpoint '" << path << "' belongs to a different render setup, starting over.\n";
+		std::fclose(file);
+		return false;
+	}
+
+	framebuffer loaded(info.width, info.height);
+	const size_t n = loaded.getPixelCount();
+	ok = std::fread(loaded.m_pixels.data(), sizeof(colorSum), n, file) == n
+		&& std::fread(loaded.m_squares.data(), sizeof(double), n, file) == n
+		&& std::fread(loaded.m_counts.data(), sizeof(std::uint32_t), n, file) == n;
+	std::fclose(file);
+
+	if (!ok) {
+		std::cerr << "Checkpoint '" << path << "' is unreadable, starting over.\n";
+		return false;
+	}
+
+	image = std::move(loaded);
+	return true;
+}
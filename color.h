@@ -1,6 +1,6 @@
 #pragma once
 
-#include "vec3.h"
+#include "utils.h"
 
 #include <iostream>
 
@@ -11,19 +11,27 @@ void writeColor(std::ostream& out, color pixelColor) {
         << static_cast<int>(255.999 * pixelColor.z()) << '\n';
 }
 
-void writeColor(std::ostream& out, color pixelColor, int samplesPerPixel) {
-    double red = pixelColor.x();
-    double green = pixelColor.y();
-    double blue = pixelColor.z();
+// Sums of many samples lose precision quickly in float, so accumulators stay double.
+using colorSum = vec3T<double>;
+
+// Relative luminance of a linear Rec. 709 color.
+template <typename T>
+inline T luminance(const vec3T<T>& c) {
+    return T(0.2126) * c.x() + T(0.7152) * c.y() + T(0.0722) * c.z();
+}
 
-    // Divide the color by the number of smaples and gamma-correct for gamma = 2.0.
+// Gamma-correct a linear component for gamma = 2.0 and translate it to [0, 255].
+inline unsigned char toDisplayByte(double component) {
+    double corrected = component > 0.0 ? sqrt(component) : 0.0;
+    return static_cast<unsigned char>(256 * clamp(corrected, 0.0, 0.999));
+}
+
+void writeColor(std::ostream& out, color pixelColor, int samplesPerPixel) {
+    // Divide the color by the number of samples before gamma correcting.
     double scale = 1.0 / samplesPerPixel;
-    red = sqrt(scale * red);
-    green = sqrt(scale * green);
-    blue = sqrt(scale * blue);
 
     // Write the translated [0, 255] value of each color component.
-    out << static_cast<int>(256 * clamp(red, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(green, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(blue, 0.0, 0.999)) << '\n';
-}
\ No newline at end of file
+    out << static_cast<int>(toDisplayByte(scale * pixelColor.x())) << ' '
+        << static_cast<int>(toDisplayByte(scale * pixelColor.y())) << ' '
+        << static_cast<int>(toDisplayByte(scale * pixelColor.z())) << '\n';
+}
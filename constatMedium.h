@@ -8,42 +8,43 @@
 
 class constantMedium : public hittable {
 public:
-    constantMedium(shared_ptr<hittable> b, double d, shared_ptr<texture> a)
+    constantMedium(shared_ptr<hittable> b, real d, shared_ptr<texture> a)
         : m_boundary(b),
         m_negInvDensity(-1 / d),
         m_phaseFunction(make_shared<isotropic>(a))
     {}
 
-    constantMedium(shared_ptr<hittable> b, double d, color c)
+    constantMedium(shared_ptr<hittable> b, real d, color c)
         : m_boundary(b),
         m_negInvDensity(-1 / d),
         m_phaseFunction(make_shared<isotropic>(c))
     {}
 
     virtual bool hit(
-        const ray& r, double tMin, double tMax, hitRecord& record) const override;
+        const ray& r, real tMin, real tMax, hitRecord& record) const override;
 
-    virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const override {
+    virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
         return m_boundary->getAABB(startTime, endTime, outputBox);
     }
 
 public:
     shared_ptr<hittable> m_boundary;
     shared_ptr<material> m_phaseFunction;
-    double m_negInvDensity;
+    real m_negInvDensity;
 };
 
-bool constantMedium::hit(const ray& r, double t_min, double t_max, hitRecord& record) const {
+bool constantMedium::hit(const ray& r, real t_min, real t_max, hitRecord& record) const {
     // Print occasional samples when debugging. To enable, set enableDebug true.
     const bool enableDebug = false;
     const bool debugging = enableDebug && randomDouble() < 0.00001;
 
     hitRecord rec1, rec2;
 
-    if (!m_boundary->hit(r, -infinity, infinity, rec1))
+    // Only the distances are used, so the boundary's attributes are never filled in.
+    if (!m_boundary->intersect(r, -infinity, infinity, rec1))
         return false;
 
-    if (!m_boundary->hit(r, rec1.t + 0.0001, infinity, rec2))
+    if (!m_boundary->intersect(r, rec1.t + 0.0001, infinity, rec2))
         return false;
 
     if (debugging) std::cerr << "\nt_min=" << rec1.t << ", t_max=" << rec2.t << '\n';
@@ -73,7 +74,8 @@ bool constantMedium::hit(const ray& r, double t_min, double t_max, hitRecord& re
 
     record.normal = vec3(1.0, 0.0, 0.0);  // arbitrary
     record.isFrontFace = true;            // also arbitrary
-    record.material_ptr = m_phaseFunction;
+    record.dpdu = record.dpdv = vec3(0.0, 0.0, 0.0);
+    record.material_ptr = m_phaseFunction.get();
 
     return true;
 }
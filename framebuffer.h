@@ -0,0 +1,119 @@
+#pragma once
+
+#include "utils.h"
+#include "color.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Mean radiance per pixel, row 0 at the top. This is what the image encoders consume.
+struct hdrImage {
+	int width = 0;
+	int height = 0;
+	std::vector<color> pixels;
+};
+
+// Accumulated radiance for every pixel, stored row-major with row 0 at the top of the image.
+// Each pixel also keeps its own sample count and the sum of squared sample luminances, which
+// is enough for a running mean and variance when sampling adaptively.
+class framebuffer {
+public:
+	framebuffer() : m_width(0), m_height(0) {}
+	framebuffer(int width, int height)
+		: m_width(width), m_height(height),
+		m_pixels(size_t(width) * height, colorSum(0.0, 0.0, 0.0)),
+		m_squares(size_t(width) * height, 0.0),
+		m_counts(size_t(width) * height, 0) {}
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+	size_t getPixelCount() const { return m_pixels.size(); }
+	size_t getIndex(int column, int row) const { return size_t(row) * m_width + column; }
+
+	// Adds a batch of samples to one pixel. Distinct pixels may be updated from different threads.
+	void addSamples(size_t pixel, const colorSum& sum, double luminanceSquares, std::uint32_t sampleCount) {
+		m_pixels[pixel] += sum;
+		m_squares[pixel] += luminanceSquares;
+		m_counts[pixel] += sampleCount;
+	}
+
+	std::uint32_t getSampleCount(size_t pixel) const { return m_counts[pixel]; }
+
+	std::uint64_t getTotalSamples() const {
+		std::uint64_t total = 0;
+		for (std::uint32_t count : m_counts) total += count;
+		return total;
+	}
+
+	// Standard error of the pixel's mean luminance relative to the mean. Near-black pixels are
+	// measured against a small floor instead, so invisible noise does not soak up samples.
+	double getRelativeError(size_t pixel) const {
+		const double n = m_counts[pixel];
+		if (n < 2) return infinity;
+
+		double mean = luminance(m_pixels[pixel]) / n;
+		double variance = std::max(0.0, (m_squares[pixel] - n * mean * mean) / (n - 1.0));
+		return sqrt(variance / n) / std::max(mean, 0.01);
+	}
+
+	hdrImage resolve() const {
+		hdrImage image;
+		image.width = m_width;
+		image.height = m_height;
+		image.pixels.reserve(m_pixels.size());
+
+		for (size_t i = 0; i < m_pixels.size(); i++)
+			image.pixels.push_back(m_counts[i] > 0 ? color(m_pixels[i] / m_counts[i]) : color(0.0, 0.0, 0.0));
+
+		return image;
+	}
+
+	// Samples per pixel as a blue (fewest) to red (most) ramp.
+	hdrImage sampleHeatmap() const {
+		hdrImage image;
+		image.width = m_width;
+		image.height = m_height;
+		image.pixels.reserve(m_counts.size());
+
+		std::uint32_t maxCount = 1;
+		for (std::uint32_t count : m_counts) maxCount = std::max(maxCount, count);
+
+		for (std::uint32_t count : m_counts) {
+			double t = double(count) / maxCount;
+			double r = clamp(1.5 - fabs(4.0 * t - 3.0), 0.0, 1.0);
+			double g = clamp(1.5 - fabs(4.0 * t - 2.0), 0.0, 1.0);
+			double b = clamp(1.5 - fabs(4.0 * t - 1.0), 0.0, 1.0);
+			image.pixels.push_back(color(r * r, g * g, b * b)); // Squared to undo the display gamma
+		}
+
+		return image;
+	}
+
+public:
+	int m_width, m_height;
+	std::vector<colorSum> m_pixels;      // Radiance sums
+	std::vector<double> m_squares;       // Sums of squared luminance
+	std::vector<std::uint32_t> m_counts; // Samples per pixel
+};
+
+// Rectangular block of the image, [x0, x1) x [y0, y1), rendered as one unit of work.
+struct tile {
+	int x0, y0;
+	int x1, y1;
+
+	int getWidth() const { return x1 - x0; }
+	int getHeight() const { return y1 - y0; }
+};
+
+inline std::vector<tile> splitIntoTiles(int width, int height, int tileSize) {
+	std::vector<tile> tiles;
+
+	for (int y = 0; y < height; y += tileSize) {
+		for (int x = 0; x < width; x += tileSize) {
+			tiles.push_back({ x, y, std::min(x + tileSize, width), std::min(y + tileSize, height) });
+		}
+	}
+
+	return tiles;
+}
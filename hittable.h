@@ -5,16 +5,27 @@
 #include "material.h"
 #include "aabb.h"
 
+#include <cstdint>
+
+class hittable;
+
+// Traversal writes only the leading fields: the distance, and for primitives that defer their
+// attributes, which object and which part of it was hit. Point, normal, texture coordinates and
+// material are filled in once, for the closest hit. The flag shares the word after primitive,
+// so the record carries no padding.
 struct hitRecord {
+	real t = 0.0;
+	const hittable* object = nullptr; // Primitive whose attributes are still to be filled, or null
+	std::uint32_t primitive = 0;      // Part of that object: mesh triangle, cloud sphere, box face
+	bool isFrontFace = true;
+	// Texture coords; meshes keep two barycentrics here until the attributes are filled
+	real u = 0.0;
+	real v = 0.0;
 	// Object Information
 	point3 point;
 	vec3 normal;
-	shared_ptr<material> material_ptr;
-	double t = 0.0;
-	bool isFrontFace = true;
-	// Texture Coords
-	double u = 0.0;
-	double v = 0.0;
+	vec3 dpdu, dpdv; // Surface derivatives for texture filtering, zero where u and v have none
+	const material* material_ptr = nullptr; // Owned by the object that was hit, so copies stay trivial
 
 	inline void setFaceNormal(const ray& ray, const vec3& outwardNormal) {
 		isFrontFace = dot(ray.getDirection(), outwardNormal) < 0.0;
@@ -24,26 +35,49 @@ struct hitRecord {
 
 class hittable {
 public:
-	virtual bool hit(const ray& ray, double tMin, double tMax, hitRecord& record) const = 0;
-	virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const = 0;
+	// Closest hit with every attribute filled in.
+	virtual bool hit(const ray& ray, real tMin, real tMax, hitRecord& record) const = 0;
+
+	// Closest hit by distance. Primitives that can defer their attributes record themselves in
+	// record.object and fill them in fillAttributes; everything else hits in full here.
+	virtual bool intersect(const ray& ray, real tMin, real tMax, hitRecord& record) const {
+		if (!hit(ray, tMin, tMax, record)) return false;
+		record.object = nullptr;
+		return true;
+	}
+
+	virtual void fillAttributes(const ray& ray, hitRecord& record) const {}
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const = 0;
 };
 
+// intersect, then the attribute stage for the one hit that was kept. Deferring primitives and
+// the accelerators implement hit with this.
+inline bool hitDeferred(const hittable& object, const ray& r, real tMin, real tMax, hitRecord& record) {
+	if (!object.intersect(r, tMin, tMax, record)) return false;
+	if (record.object) {
+		record.object->fillAttributes(r, record);
+		record.object = nullptr;
+	}
+	return true;
+}
+
 class translation : public hittable {
 public:
 	translation(shared_ptr<hittable> p, const vec3& displacement)
 		: m_ptr(p), m_offset(displacement) {}
 
 	virtual bool hit(
-		const ray& r, double tMin, double tMax, hitRecord& record) const override;
+		const ray& r, real tMin, real tMax, hitRecord& record) const override;
 
-	virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const override;
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override;
 
 public:
 	shared_ptr<hittable> m_ptr;
 	vec3 m_offset;
 };
 
-bool translation::hit(const ray& r, double tMin, double tMax, hitRecord& record) const {
+bool translation::hit(const ray& r, real tMin, real tMax, hitRecord& record) const {
 	ray movedR(r.getOrigin() - m_offset, r.getDirection(), r.getTime());
 	if (!m_ptr->hit(movedR, tMin, tMax, record))
 		return false;
@@ -54,7 +88,7 @@ bool translation::hit(const ray& r, double tMin, double tMax, hitRecord& record)
 	return true;
 }
 
-bool translation::getAABB(double startTime, double endTime, aabb& outputBox) const {
+bool translation::getAABB(real startTime, real endTime, aabb& outputBox) const {
 	if (!m_ptr->getAABB(startTime, endTime, outputBox))
 		return false;
 
@@ -67,25 +101,25 @@ bool translation::getAABB(double startTime, double endTime, aabb& outputBox) con
 
 class pan : public hittable {
 public:
-	pan(shared_ptr<hittable> ptr, double angle);
+	pan(shared_ptr<hittable> ptr, real angle);
 
 	virtual bool hit(
-		const ray& r, double tMin, double tMax, hitRecord& record) const override;
+		const ray& r, real tMin, real tMax, hitRecord& record) const override;
 
-	virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const override {
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
 		outputBox = m_bBox;
 		return m_hasBox;
 	}
 
 public:
 	shared_ptr<hittable> m_ptr;
-	double m_sinTheta;
-	double m_cosTheta;
+	real m_sinTheta;
+	real m_cosTheta;
 	bool m_hasBox;
 	aabb m_bBox;
 };
 
-pan::pan(shared_ptr<hittable> ptr, double angle) : m_ptr(ptr) {
+pan::pan(shared_ptr<hittable> ptr, real angle) : m_ptr(ptr) {
 	auto radians = degreesToRadians(angle);
 	m_sinTheta = sin(radians);
 	m_cosTheta = cos(radians);
@@ -117,7 +151,7 @@ pan::pan(shared_ptr<hittable> ptr, double angle) : m_ptr(ptr) {
 	m_bBox = aabb(min, max);
 }
 
-bool pan::hit(const ray& r, double tMin, double tMax, hitRecord& record) const {
+bool pan::hit(const ray& r, real tMin, real tMax, hitRecord& record) const {
 	auto origin = r.getOrigin();
 	auto direction = r.getDirection();
 
@@ -144,13 +178,11 @@ bool pan::hit(const ray& r, double tMin, double tMax, hitRecord& record) const {
 	record.point = p;
 	record.setFaceNormal(rotatedR, normal);
 
+	auto rotateBack = [this](const vec3& v) {
+		return vec3(m_cosTheta * v[0] + m_sinTheta * v[2], v[1], -m_sinTheta * v[0] + m_cosTheta * v[2]);
+	};
+	record.dpdu = rotateBack(record.dpdu);
+	record.dpdv = rotateBack(record.dpdv);
+
 	return true;
 }
-
-// class roll : public hittable {
-// 
-// };
-// 
-// class tilt : public hittable {
-// 
-// };
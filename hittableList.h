@@ -15,35 +15,39 @@ public:
 	void add(std::shared_ptr<hittable> object) { m_objects.push_back(object); }
 	inline std::vector<std::shared_ptr<hittable>> getObjects() const { return m_objects; }
 
-	virtual bool hit(
-		const ray& ray, double tMin, double tMax, hitRecord& record
+	virtual bool hit(const ray& ray, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, ray, tMin, tMax, record);
+	}
+
+	virtual bool intersect(
+		const ray& ray, real tMin, real tMax, hitRecord& record
 	) const override;
 
 	virtual bool getAABB(
-		double startTime, double endTime, aabb& outputBox
+		real startTime, real endTime, aabb& outputBox
 	) const override;
 
 public:
 	std::vector<std::shared_ptr<hittable>> m_objects;
 };
 
-bool hittableList::hit(const ray& ray, double tMin, double tMax, hitRecord& record) const {
-	hitRecord tempRecord;
+// Objects only write the record when they report a hit, so each closer hit overwrites it in
+// place and no temporary is copied.
+bool hittableList::intersect(const ray& ray, real tMin, real tMax, hitRecord& record) const {
 	bool hasHit = false;
-	double currentClosest = tMax;
+	real currentClosest = tMax;
 
 	for (const std::shared_ptr<hittable>& object : m_objects) {
-		if (object->hit(ray, tMin, currentClosest, tempRecord)) {
+		if (object->intersect(ray, tMin, currentClosest, record)) {
 			hasHit = true;
-			currentClosest = tempRecord.t;
-			record = tempRecord;
+			currentClosest = record.t;
 		}
 	}
 
 	return hasHit;
 }
 
-bool hittableList::getAABB(double startTime, double endTime, aabb& outputBox) const {
+bool hittableList::getAABB(real startTime, real endTime, aabb& outputBox) const {
 	if (m_objects.empty()) return false;
 
 	aabb tempBox;
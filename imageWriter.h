@@ -0,0 +1,265 @@
+#pragma once
+
+#include "utils.h"
+#include "color.h"
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+enum class imageFormat { ppm, pfm, png };
+
+// Picks the format from the file extension, defaulting to binary PPM.
+inline imageFormat formatFromPath(const std::string& path) {
+	auto endsWith = [&path](const char* suffix) {
+		std::string s(suffix);
+		if (path.size() < s.size()) return false;
+		for (size_t i = 0; i < s.size(); i++) {
+			if (std::tolower(static_cast<unsigned char>(path[path.size() - s.size() + i])) != s[i]) return false;
+		}
+		return true;
+	};
+
+	if (endsWith(".pfm")) return imageFormat::pfm;
+	if (endsWith(".png")) return imageFormat::png;
+	return imageFormat::ppm;
+}
+
+// Binary P6, gamma corrected the same way as writeColor.
+inline std::vector<unsigned char> encodePPM(const hdrImage& image) {
+	std::string header = "P6\n" + std::to_string(image.width) + ' ' + std::to_string(image.height) + "\n255\n";
+	std::vector<unsigned char> bytes(header.begin(), header.end());
+	bytes.reserve(bytes.size() + image.pixels.size() * 3);
+
+	for (const color& pixel : image.pixels) {
+		bytes.push_back(toDisplayByte(pixel.x()));
+		bytes.push_back(toDisplayByte(pixel.y()));
+		bytes.push_back(toDisplayByte(pixel.z()));
+	}
+
+	return bytes;
+}
+
+// Linear float RGB. PFM stores scanlines bottom to top, and a negative scale means little endian.
+inline std::vector<unsigned char> encodePFM(const hdrImage& image) {
+	std::string header = "PF\n" + std::to_string(image.width) + ' ' + std::to_string(image.height) + "\n-1.0\n";
+	std::vector<unsigned char> bytes(header.begin(), header.end());
+	bytes.reserve(bytes.size() + image.pixels.size() * 3 * sizeof(float));
+
+	auto putFloat = [&bytes](double value) {
+		float f = static_cast<float>(value);
+		std::uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		for (int i = 0; i < 4; i++) bytes.push_back(static_cast<unsigned char>(bits >> (8 * i)));
+	};
+
+	for (int y = image.height - 1; y >= 0; y--) {
+		for (int x = 0; x < image.width; x++) {
+			const color& pixel = image.pixels[size_t(y) * image.width + x];
+			putFloat(pixel.x());
+			putFloat(pixel.y());
+			putFloat(pixel.z());
+		}
+	}
+
+	return bytes;
+}
+
+namespace pngDetail {
+	inline std::uint32_t crc32(const unsigned char* data, size_t length, std::uint32_t crc = 0) {
+		static const std::vector<std::uint32_t> table = [] {
+			std::vector<std::uint32_t> t(256);
+			for (std::uint32_t n = 0; n < 256; n++) {
+				std::uint32_t c = n;
+				for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	inline void putBigEndian(std::vector<unsigned char>& out, std::uint32_t value) {
+		for (int i = 3; i >= 0; i--) out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+	}
+
+	inline void putChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data) {
+		putBigEndian(out, static_cast<std::uint32_t>(data.size()));
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		putBigEndian(out, crc32(out.data() + start, out.size() - start));
+	}
+}
+
+// 8-bit RGB PNG. The zlib stream uses stored (uncompressed) deflate blocks, which keeps the
+// encoder dependency-free and fast; the file is about the size of the equivalent P6.
+inline std::vector<unsigned char> encodePNG(const hdrImage& image) {
+	using namespace pngDetail;
+
+	const size_t rowBytes = size_t(image.width) * 3 + 1; // Leading filter byte
+	std::vector<unsigned char> raw;
+	raw.reserve(rowBytes * image.height);
+
+	for (int y = 0; y < image.height; y++) {
+		raw.push_back(0); // Filter: none
+		for (int x = 0; x < image.width; x++) {
+			const color& pixel = image.pixels[size_t(y) * image.width + x];
+			raw.push_back(toDisplayByte(pixel.x()));
+			raw.push_back(toDisplayByte(pixel.y()));
+			raw.push_back(toDisplayByte(pixel.z()));
+		}
+	}
+
+	std::vector<unsigned char> zlib = { 0x78, 0x01 };
+	const size_t maxBlock = 65535;
+	for (size_t offset = 0; offset < raw.size() || offset == 0; offset += maxBlock) {
+		size_t length = std::min(maxBlock, raw.size() - offset);
+		bool last = offset + length >= raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(static_cast<unsigned char>(length & 0xff));
+		zlib.push_back(static_cast<unsigned char>(length >> 8));
+		zlib.push_back(static_cast<unsigned char>(~length & 0xff));
+		zlib.push_back(static_cast<unsigned char>((~length >> 8) & 0xff));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		if (last) break;
+	}
+
+	std::uint32_t a = 1, b = 0; // Adler-32
+	for (unsigned char byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBigEndian(zlib, (b << 16) | a);
+
+	std::vector<unsigned char> header;
+	putBigEndian(header, static_cast<std::uint32_t>(image.width));
+	putBigEndian(header, static_cast<std::uint32_t>(image.height));
+	header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8-bit depth, RGB, deflate, no filter, no interlace
+
+	std::vector<unsigned char> bytes = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	putChunk(bytes, "IHDR", header);
+	putChunk(bytes, "IDAT", zlib);
+	putChunk(bytes, "IEND", {});
+	return bytes;
+}
+
+inline std::vector<unsigned char> encodeImage(const hdrImage& image, imageFormat format) {
+	switch (format) {
+	case imageFormat::pfm: return encodePFM(image);
+	case imageFormat::png: return encodePNG(image);
+	default:               return encodePPM(image);
+	}
+}
+
+// Writes bytes to the given path, or to stdout when the path is empty.
+inline bool writeBytes(const std::string& path, const std::vector<unsigned char>& bytes) {
+	if (path.empty()) {
+#ifdef _WIN32
+		// Keep the C runtime from expanding '\n' inside binary data.
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		size_t written = std::fwrite(bytes.data(), 1, bytes.size(), stdout);
+		std::fflush(stdout);
+		return written == bytes.size();
+	}
+
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file) {
+		std::cerr << "ERROR: Could not open '" << path << "' for writing.\n";
+		return false;
+	}
+
+	size_t written = std::fwrite(bytes.data(), 1, bytes.size(), file);
+	std::fclose(file);
+	return written == bytes.size();
+}
+
+// Single background thread that encodes and writes images in submission order, so the
+// render threads hand off a finished buffer and never wait on formatting or disk.
+class imageWriter {
+public:
+	imageWriter() : m_thread(&imageWriter::workerLoop, this) {}
+
+	~imageWriter() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wakeCondition.notify_one();
+		m_thread.join();
+	}
+
+	imageWriter(const imageWriter&) = delete;
+	imageWriter& operator=(const imageWriter&) = delete;
+
+	void submit(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(std::move(job));
+		}
+		m_wakeCondition.notify_one();
+	}
+
+	void write(hdrImage image, imageFormat format, std::string path) {
+		submit([image = std::move(image), format, path = std::move(path)] {
+			if (!writeBytes(path, encodeImage(image, format)))
+				std::cerr << "ERROR: Failed to write image '" << (path.empty() ? "<stdout>" : path) << "'.\n";
+		});
+	}
+
+	// Blocks until every submitted job has been written.
+	void flush() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idleCondition.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+	}
+
+private:
+	void workerLoop() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		while (true) {
+			m_wakeCondition.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+			if (m_jobs.empty()) return; // Stopping with nothing left to write
+
+			std::function<void()> job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			m_busy = true;
+
+			lock.unlock();
+			job();
+			lock.lock();
+
+			m_busy = false;
+			if (m_jobs.empty()) m_idleCondition.notify_all();
+		}
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_idleCondition;
+	std::deque<std::function<void()>> m_jobs;
+	bool m_busy = false;
+	bool m_stopping = false;
+	std::thread m_thread; // Declared last so the queue exists before the thread starts
+};
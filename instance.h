@@ -0,0 +1,257 @@
+#pragma once
+
+#include "utils.h"
+#include "hittable.h"
+#include "hittableList.h"
+#include "constatMedium.h"
+#include "sceneArena.h"
+
+#include <cmath>
+
+// Affine map p -> A p + b stored as the rows of the 3x4 matrix [A | b].
+class affineTransform {
+public:
+	affineTransform() : m{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } } {}
+
+	static affineTransform translate(const vec3& offset);
+	static affineTransform scale(const vec3& factors);
+
+	// Right-handed rotation about axis; rotate(vec3(0, 1, 0), a) turns like pan(object, a).
+	static affineTransform rotate(const vec3& axis, real degrees);
+	static affineTransform rotate(const vec3& axis, real sinTheta, real cosTheta);
+
+	static affineTransform tilt(real degrees) { return rotate(vec3(1, 0, 0), degrees); }
+	static affineTransform pan(real degrees) { return rotate(vec3(0, 1, 0), degrees); }
+	static affineTransform roll(real degrees) { return rotate(vec3(0, 0, 1), degrees); }
+
+	// Composition that applies other first, then this.
+	affineTransform operator*(const affineTransform& other) const;
+
+	affineTransform inverse() const;
+	bool isIdentity() const;
+
+	point3 applyToPoint(const point3& p) const {
+		return point3(
+			m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+			m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+			m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+	}
+
+	vec3 applyToVector(const vec3& v) const {
+		return vec3(
+			m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+			m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+			m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+	}
+
+	// Multiplies by the transposed linear part. Called on the inverse transform, this carries
+	// normals the same way the transform carries surfaces.
+	vec3 applyTransposed(const vec3& v) const {
+		return vec3(
+			m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2],
+			m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2],
+			m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2]);
+	}
+
+	aabb applyToBox(const aabb& box) const;
+
+public:
+	real m[3][4];
+};
+
+affineTransform affineTransform::translate(const vec3& offset) {
+	affineTransform result;
+	for (int i = 0; i < 3; i++) result.m[i][3] = offset[i];
+	return result;
+}
+
+affineTransform affineTransform::scale(const vec3& factors) {
+	affineTransform result;
+	for (int i = 0; i < 3; i++) result.m[i][i] = factors[i];
+	return result;
+}
+
+affineTransform affineTransform::rotate(const vec3& axis, real degrees) {
+	real radians = real(degreesToRadians(degrees));
+	return rotate(axis, std::sin(radians), std::cos(radians));
+}
+
+affineTransform affineTransform::rotate(const vec3& axis, real sinTheta, real cosTheta) {
+	// Rodrigues' rotation formula: cos I + sin [k]x + (1 - cos) k k^T.
+	const vec3 k = unitVector(axis);
+	const real c = 1 - cosTheta;
+
+	affineTransform result;
+	result.m[0][0] = cosTheta + k[0] * k[0] * c;
+	result.m[0][1] = k[0] * k[1] * c - k[2] * sinTheta;
+	result.m[0][2] = k[0] * k[2] * c + k[1] * sinTheta;
+	result.m[1][0] = k[1] * k[0] * c + k[2] * sinTheta;
+	result.m[1][1] = cosTheta + k[1] * k[1] * c;
+	result.m[1][2] = k[1] * k[2] * c - k[0] * sinTheta;
+	result.m[2][0] = k[2] * k[0] * c - k[1] * sinTheta;
+	result.m[2][1] = k[2] * k[1] * c + k[0] * sinTheta;
+	result.m[2][2] = cosTheta + k[2] * k[2] * c;
+	return result;
+}
+
+affineTransform affineTransform::operator*(const affineTransform& other) const {
+	affineTransform result;
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 4; j++) {
+			real sum = j == 3 ? m[i][3] : real(0);
+			for (int k = 0; k < 3; k++) sum += m[i][k] * other.m[k][j];
+			result.m[i][j] = sum;
+		}
+	}
+	return result;
+}
+
+affineTransform affineTransform::inverse() const {
+	// Adjugate of the linear part over its determinant, then the translation undone.
+	const real (*a)[4] = m;
+	real cofactor00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+	real cofactor01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+	real cofactor02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+	real determinant = a[0][0] * cofactor00 + a[0][1] * cofactor01 + a[0][2] * cofactor02;
+
+	if (determinant == 0) {
+		std::cerr << "ERROR: Transform is singular and has no inverse.\n";
+		return affineTransform();
+	}
+	real invDet = 1 / determinant;
+
+	affineTransform result;
+	result.m[0][0] = cofactor00 * invDet;
+	result.m[1][0] = cofactor01 * invDet;
+	result.m[2][0] = cofactor02 * invDet;
+	result.m[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * invDet;
+	result.m[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * invDet;
+	result.m[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * invDet;
+	result.m[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * invDet;
+	result.m[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * invDet;
+	result.m[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * invDet;
+
+	vec3 offset = result.applyToVector(vec3(a[0][3], a[1][3], a[2][3]));
+	for (int i = 0; i < 3; i++) result.m[i][3] = -offset[i];
+	return result;
+}
+
+bool affineTransform::isIdentity() const {
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 4; j++)
+			if (m[i][j] != (i == j ? real(1) : real(0))) return false;
+	return true;
+}
+
+aabb affineTransform::applyToBox(const aabb& box) const {
+	const real far = real(infinity);
+	point3 low(far, far, far);
+	point3 high(-far, -far, -far);
+
+	for (int corner = 0; corner < 8; corner++) {
+		point3 p = applyToPoint(point3(
+			corner & 1 ? box.getMax().x() : box.getMin().x(),
+			corner & 2 ? box.getMax().y() : box.getMin().y(),
+			corner & 4 ? box.getMax().z() : box.getMin().z()));
+
+		for (int c = 0; c < 3; c++) {
+			low[c] = std::fmin(low[c], p[c]);
+			high[c] = std::fmax(high[c], p[c]);
+		}
+	}
+
+	return aabb(low, high);
+}
+
+// An object placed in the world by an affine transform. Rays are carried into object space with
+// the precomputed inverse, so t is the same in both spaces, and hits are carried back out. The
+// child's isFrontFace is kept: it was decided in object space, where the ray and normal agree.
+class instance : public hittable {
+public:
+	instance(shared_ptr<hittable> object, const affineTransform& toWorld);
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		outputBox = m_box;
+		return m_hasBox;
+	}
+
+	// Moves the object; the world box follows from the cached object-space box.
+	void setTransform(const affineTransform& toWorld);
+
+public:
+	shared_ptr<hittable> m_object;
+	affineTransform m_toWorld;
+	affineTransform m_toObject;
+	bool m_hasBox;
+	aabb m_objectBox;
+	aabb m_box;
+};
+
+instance::instance(shared_ptr<hittable> object, const affineTransform& toWorld) : m_object(object) {
+	m_hasBox = object->getAABB(0.0, 1.0, m_objectBox);
+	setTransform(toWorld);
+}
+
+void instance::setTransform(const affineTransform& toWorld) {
+	m_toWorld = toWorld;
+	m_toObject = toWorld.inverse();
+	if (m_hasBox) m_box = m_toWorld.applyToBox(m_objectBox);
+}
+
+bool instance::hit(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	ray local(m_toObject.applyToPoint(r.getOrigin()), m_toObject.applyToVector(r.getDirection()), r.getTime());
+
+	if (!m_object->hit(local, tMin, tMax, record))
+		return false;
+
+	record.point = m_toWorld.applyToPoint(record.point);
+	record.normal = unitVector(m_toObject.applyTransposed(record.normal));
+	record.dpdu = m_toWorld.applyToVector(record.dpdu);
+	record.dpdv = m_toWorld.applyToVector(record.dpdv);
+	return true;
+}
+
+// Collapses chains of translation, pan and instance wrappers into one instance per object.
+// A transform over a constantMedium moves onto its boundary, so the medium samples distances
+// along the world-space ray; for rigid transforms that is the same volume. New wrappers come
+// from the scene's arena.
+inline shared_ptr<hittable> foldTransforms(
+	const shared_ptr<hittable>& object, sceneArena& arena, const affineTransform& outer = affineTransform()
+) {
+	if (auto moved = std::dynamic_pointer_cast<translation>(object))
+		return foldTransforms(moved->m_ptr, arena, outer * affineTransform::translate(moved->m_offset));
+
+	if (auto turned = std::dynamic_pointer_cast<pan>(object))
+		return foldTransforms(turned->m_ptr, arena, outer * affineTransform::rotate(vec3(0, 1, 0), turned->m_sinTheta, turned->m_cosTheta));
+
+	if (auto placed = std::dynamic_pointer_cast<instance>(object))
+		return foldTransforms(placed->m_object, arena, outer * placed->m_toWorld);
+
+	if (auto medium = std::dynamic_pointer_cast<constantMedium>(object)) {
+		auto boundary = foldTransforms(medium->m_boundary, arena, outer);
+		if (boundary == medium->m_boundary) return object;
+
+		auto folded = arena.make<constantMedium>(*medium);
+		folded->m_boundary = boundary;
+		return folded;
+	}
+
+	if (auto list = std::dynamic_pointer_cast<hittableList>(object)) {
+		if (outer.isIdentity()) {
+			auto folded = arena.make<hittableList>();
+			for (const auto& child : list->m_objects) folded->add(foldTransforms(child, arena));
+			return folded;
+		}
+	}
+
+	if (outer.isIdentity()) return object;
+	return arena.make<instance>(object, outer);
+}
+
+inline hittableList foldTransforms(const hittableList& entities, sceneArena& arena) {
+	hittableList folded;
+	for (const auto& object : entities.m_objects) folded.add(foldTransforms(object, arena));
+	return folded;
+}
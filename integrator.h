@@ -0,0 +1,138 @@
+#pragma once
+
+#include "utils.h"
+
+#include "hittable.h"
+#include "material.h"
+#include "rayDifferential.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Number of paths that terminated after each bounce count, index i holding paths with i bounces.
+class bounceHistogram {
+public:
+	bounceHistogram() {}
+	explicit bounceHistogram(int maxDepth) : m_counts(size_t(maxDepth) + 1, 0) {}
+
+	void record(int bounces) { m_counts[bounces]++; }
+
+	void merge(const bounceHistogram& other) {
+		if (m_counts.size() < other.m_counts.size()) m_counts.resize(other.m_counts.size(), 0);
+		for (size_t i = 0; i < other.m_counts.size(); i++) m_counts[i] += other.m_counts[i];
+	}
+
+	std::uint64_t getPathCount() const {
+		std::uint64_t total = 0;
+		for (std::uint64_t count : m_counts) total += count;
+		return total;
+	}
+
+	double getMeanBounces() const {
+		std::uint64_t total = getPathCount();
+		if (total == 0) return 0.0;
+
+		double sum = 0.0;
+		for (size_t i = 0; i < m_counts.size(); i++) sum += double(i) * m_counts[i];
+		return sum / total;
+	}
+
+	void print(std::ostream& out) const {
+		std::uint64_t total = getPathCount();
+		if (total == 0) return;
+
+		out << "Bounces per path (mean " << std::fixed << std::setprecision(2) << getMeanBounces() << "):\n";
+		for (size_t i = 0; i < m_counts.size(); i++) {
+			if (m_counts[i] == 0) continue;
+			out << std::setw(4) << i << std::setw(14) << m_counts[i]
+				<< std::setw(8) << std::setprecision(2) << 100.0 * m_counts[i] / total << "%\n";
+		}
+		out << std::defaultfloat;
+	}
+
+private:
+	std::vector<std::uint64_t> m_counts;
+};
+
+// Iterative path tracer. Instead of recursing once per bounce it carries the path throughput
+// forward, reuses a single hitRecord, and after a few bounces ends dim paths with Russian
+// roulette. Surviving paths are reweighted by the survival probability, so the estimate stays
+// unbiased while deep glass and smoke paths stop wasting bounces.
+class pathIntegrator {
+public:
+	pathIntegrator(int maxDepth, int rouletteDepth = 3)
+		: m_maxDepth(maxDepth), m_rouletteDepth(rouletteDepth) {}
+
+	int getMaxDepth() const { return m_maxDepth; }
+
+	// The differentials of r, if valid, follow the path through specular bounces and give
+	// textures the footprint to filter over.
+	color radiance(
+		const ray& r, const rayDifferential& differential, const hittable& entities, const color& background,
+		bounceHistogram& histogram
+	) const;
+
+private:
+	int m_maxDepth;
+	int m_rouletteDepth; // First bounce that may be terminated, negative disables roulette
+};
+
+color pathIntegrator::radiance(
+	const ray& r, const rayDifferential& differential, const hittable& entities, const color& background,
+	bounceHistogram& histogram
+) const {
+	color result(0.0, 0.0, 0.0);
+	color throughput(1.0, 1.0, 1.0);
+	ray current = r;
+	rayDifferential currentDifferential = differential;
+	hitRecord record;
+
+	int bounce = 0;
+	for (; bounce < m_maxDepth; bounce++) {
+		sampler::current().startBounce(bounce);
+
+		// If the ray hits nothing, gather the background color.
+		if (!entities.hit(current, real(0.001), real(infinity), record)) {
+			result += throughput * background;
+			break;
+		}
+
+		uvFootprint footprint;
+		if (currentDifferential.valid && currentDifferential.transfer(current, record.t, record.normal)) {
+			footprint = computeFootprint(record.dpdu, record.dpdv, currentDifferential.dOriginDx, currentDifferential.dOriginDy);
+		}
+
+		ray scattered;
+		color attenuation;
+		result += throughput * record.material_ptr->emitted(record.u, record.v, record.point, footprint);
+
+		if (!record.material_ptr->scatter(current, record.point, record.normal,
+			record.isFrontFace, record.u, record.v, footprint, attenuation, scattered))
+		{ break; }
+
+		throughput = throughput * attenuation;
+
+		if (m_rouletteDepth >= 0 && bounce >= m_rouletteDepth) {
+			double maxComponent = std::max(throughput.x(), std::max(throughput.y(), throughput.z()));
+			if (maxComponent < 1.0) {
+				double terminate = std::max(0.05, 1.0 - maxComponent);
+				if (randomDouble() < terminate) break;
+				throughput /= real(1.0 - terminate);
+			}
+		}
+
+		if (currentDifferential.valid) {
+			currentDifferential.valid = record.material_ptr->transferDifferential(
+				current, record.normal, record.isFrontFace, scattered, currentDifferential);
+		}
+
+		current = ray(offsetRayOrigin(record.point, record.normal, scattered.getDirection()),
+			scattered.getDirection(), scattered.getTime());
+	}
+
+	histogram.record(bounce);
+	return result;
+}
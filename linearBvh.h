@@ -0,0 +1,129 @@
+#pragma once
+
+#include "utils.h"
+
+#include "hittable.h"
+#include "hittableList.h"
+#include "bvhBuilder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Bounding volume hierarchy built with the surface area heuristic and flattened into one
+// depth-first array: a node's first child directly follows it and only the second child's
+// index is stored. Leaves hold up to maxLeafSize primitives, and traversal visits the child
+// on the near side of the split axis first, so closer hits shrink tMax before the far child.
+class linearBvh : public hittable {
+public:
+	linearBvh() {}
+	linearBvh(const hittableList& entities, real startTime, real endTime, int maxLeafSize = 4);
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		if (m_nodes.empty()) return false;
+		outputBox = m_nodes[0].box;
+		return true;
+	}
+
+	size_t getNodeCount() const { return m_nodes.size(); }
+
+public:
+	struct linearNode {
+		aabb box;
+		std::uint32_t offset; // Leaf: first primitive, interior: index of the second child
+		std::uint16_t count;  // Primitives in a leaf, zero for interior nodes
+		std::uint8_t axis;    // Split axis of an interior node
+	};
+
+	std::vector<shared_ptr<hittable>> m_primitives; // Reordered so every leaf is a contiguous run
+	std::vector<linearNode> m_nodes;
+
+private:
+	std::uint32_t flatten(const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects);
+};
+
+linearBvh::linearBvh(const hittableList& entities, real startTime, real endTime, int maxLeafSize) {
+	const std::vector<shared_ptr<hittable>>& objects = entities.m_objects;
+	if (objects.empty()) return;
+
+	bvhBuilder builder(gatherBounds(objects, 0, objects.size(), startTime, endTime), std::min(maxLeafSize, 0xffff));
+	builder.build();
+
+	m_nodes.reserve(builder.getNodeCount());
+	m_primitives.reserve(objects.size());
+	flatten(builder, builder.getRoot(), objects);
+
+	std::cerr << "linearBvh: " << objects.size() << " objects, " << m_nodes.size() << " nodes built in "
+		<< builder.getBuildMilliseconds() << " ms\n";
+}
+
+// Emits the subtree depth first, so a node's first child always directly follows it.
+std::uint32_t linearBvh::flatten(
+	const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects
+) {
+	const bvhBuildNode& node = builder.getNode(nodeIndex);
+	std::uint32_t flatIndex = static_cast<std::uint32_t>(m_nodes.size());
+	m_nodes.push_back({ node.box, 0, static_cast<std::uint16_t>(node.count), node.axis });
+
+	if (node.count > 0) {
+		m_nodes[flatIndex].offset = static_cast<std::uint32_t>(m_primitives.size());
+		for (std::uint32_t i = node.start; i < node.start + node.count; i++)
+			m_primitives.push_back(objects[builder.getPrimitive(i)]);
+	} else {
+		flatten(builder, node.firstChild, objects);
+		std::uint32_t second = flatten(builder, node.firstChild + 1, objects);
+		m_nodes[flatIndex].offset = second;
+	}
+
+	return flatIndex;
+}
+
+bool linearBvh::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	if (m_nodes.empty()) return false;
+
+	const vec3 direction = r.getDirection();
+	const vec3 inverseDirection(1.0 / direction.x(), 1.0 / direction.y(), 1.0 / direction.z());
+	const bool directionIsNegative[3] = { direction.x() < 0.0, direction.y() < 0.0, direction.z() < 0.0 };
+
+	// Each level pushes at most one node, and bvhBuilder caps the depth.
+	std::uint32_t stack[bvhBuilder::s_maxDepth];
+	int stackSize = 0;
+	std::uint32_t current = 0;
+	bool hasHit = false;
+
+	while (true) {
+		const linearNode& node = m_nodes[current];
+
+		if (node.box.hit(r, inverseDirection, tMin, tMax)) {
+			if (node.count > 0) {
+				for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+					if (m_primitives[i]->intersect(r, tMin, tMax, record)) {
+						hasHit = true;
+						tMax = record.t;
+					}
+				}
+			} else if (directionIsNegative[node.axis]) {
+				// The second child lies on the near side; defer the first.
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) break;
+		current = stack[--stackSize];
+	}
+
+	return hasHit;
+}
@@ -3,14 +3,36 @@
 #include "color.h"
 #include "camera.h"
 #include "material.h"
+#include "materialPool.h"
 #include "hittable.h"
 #include "hittableList.h"
 #include "sphere.h"
 #include "movingSphere.h"
+#include "sphereCloud.h"
 #include "tm.h"
+#include "box.h"
+#include "rectangle.h"
+#include "instance.h"
+#include "tlas.h"
+#include "motionBvh.h"
+#include "mesh.h"
+#include "meshLoader.h"
 #include "constatMedium.h"
 #include "bvh.h"
-
+#include "linearBvh.h"
+#include "wideBvh.h"
+#include "benchmark.h"
+#include "framebuffer.h"
+#include "renderer.h"
+#include "options.h"
+#include "imageWriter.h"
+#include "checkpoint.h"
+#include "sceneArena.h"
+#include "sceneSetup.h"
+#include "sceneCache.h"
+#include "textureRegistry.h"
+
+#include <chrono>
 #include <iostream>
 
 // This code follows the Ray Tracing In a Weekend Book cited below.
@@ -26,11 +48,15 @@
 //     Author : Daniel Young
 //     Version: Apr 10, 2023
 
-hittableList randomScene() {
+// The small spheres go into one sphere cloud, the diffuse ones moving over the shutter.
+hittableList randomScene(sceneArena& arena, materialPool& materials) {
     hittableList entities;
 
-    auto checker = make_shared<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
-    entities.add(make_shared<sphere>(point3(0.0, -1000.0, 0.0), 1000.0, make_shared<lambertian>(checker)));
+    auto checker = arena.make<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    entities.add(arena.make<sphere>(point3(0.0, -1000.0, 0.0), 1000.0, materials.makeLambertian(checker)));
+
+    sphereCloudBuffers spheres;
+    spheres.reserve(22 * 22, true);
 
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
@@ -38,148 +64,147 @@ hittableList randomScene() {
             point3 center(double(a) + 0.9 * randomDouble(), 0.2, double(b) + 0.9 * randomDouble());
 
             if ((center - point3(4.0, 0.2, 0.0)).length() > 0.9) {
-                shared_ptr<material> sphereMaterial;
-
                 if (chooseMat < 0.8) {
                     // diffuse
                     auto albedo = color::random() * color::random();
-                    sphereMaterial = make_shared<lambertian>(albedo);
+                    std::uint32_t sphereMaterial = spheres.addMaterial(materials.makeLambertian(albedo));
                     point3 endCenter = center + vec3(0.0, randomDouble(0, 0.5), 0.0);
-                    entities.add(make_shared<movingSphere>(center, endCenter, 0.0, 1.0, 0.2, sphereMaterial));
+                    spheres.addMovingSphere(center, endCenter, 0.2, sphereMaterial);
                 }
                 else if (chooseMat < 0.95) {
                     // metal
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = randomDouble(0, 0.5);
-                    sphereMaterial = make_shared<metal>(albedo, fuzz);
-                    entities.add(make_shared<sphere>(center, 0.2, sphereMaterial));
+                    std::uint32_t sphereMaterial = spheres.addMaterial(materials.makeMetal(albedo, fuzz));
+                    spheres.addSphere(center, 0.2, sphereMaterial);
                 }
                 else {
                     // glass
-                    sphereMaterial = make_shared<dielectric>(1.5);
-                    entities.add(make_shared<sphere>(center, 0.2, sphereMaterial));
+                    std::uint32_t sphereMaterial = spheres.addMaterial(materials.makeDielectric(1.5));
+                    spheres.addSphere(center, 0.2, sphereMaterial);
                 }
             }
         }
     }
 
-    auto material1 = make_shared<dielectric>(1.5);
-    entities.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+    entities.add(arena.make<sphereCloud>(std::move(spheres), 0.0, 1.0));
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    entities.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    auto material1 = materials.makeDielectric(1.5);
+    entities.add(arena.make<sphere>(point3(0, 1, 0), 1.0, material1));
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    entities.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    auto material2 = materials.makeLambertian(color(0.4, 0.2, 0.1));
+    entities.add(arena.make<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = materials.makeMetal(color(0.7, 0.6, 0.5), 0.0);
+    entities.add(arena.make<sphere>(point3(4, 1, 0), 1.0, material3));
 
     return entities;
 }
 
-hittableList twoSpheres() {
+hittableList twoSpheres(sceneArena& arena) {
     hittableList entities;
 
-    auto checker = make_shared<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    auto checker = arena.make<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
 
-    entities.add(make_shared<sphere>(point3(0.0, -10.0, 0.0), 10, make_shared<lambertian>(checker)));
-    entities.add(make_shared<sphere>(point3(0.0, 10.0, 0.0), 10, make_shared<lambertian>(checker)));
+    entities.add(arena.make<sphere>(point3(0.0, -10.0, 0.0), 10, arena.make<lambertian>(checker)));
+    entities.add(arena.make<sphere>(point3(0.0, 10.0, 0.0), 10, arena.make<lambertian>(checker)));
 
     return entities;
 }
 
-hittableList twoPerlinSpheres() {
+hittableList twoPerlinSpheres(sceneArena& arena) {
     hittableList entities;
 
-    auto perlinTex = make_shared<perlinTexture>(4.0);
-    entities.add(make_shared<sphere>(point3(0.0, -1000.0, 0.0), 1000, make_shared<lambertian>(perlinTex)));
-    entities.add(make_shared<sphere>(point3(0.0, 2.0, 0.0), 2, make_shared<lambertian>(perlinTex)));
+    auto perlinTex = arena.make<perlinTexture>(4.0);
+    entities.add(arena.make<sphere>(point3(0.0, -1000.0, 0.0), 1000, arena.make<lambertian>(perlinTex)));
+    entities.add(arena.make<sphere>(point3(0.0, 2.0, 0.0), 2, arena.make<lambertian>(perlinTex)));
+    // Around the small sphere, from just above the ground, which keeps its exact noise.
+    perlinTex->bakeTurbulence(aabb(point3(-2.0, 0.01, -2.0), point3(2.0, 4.0, 2.0)));
 
     return entities;
 }
 
-hittableList earth() {
-    auto earthTex = make_shared<imageTexture>("earthmap.jpg");
-    auto earthSurface = make_shared<lambertian>(earthTex);
-    auto globe = make_shared<sphere>(point3(0.0, 0.0, 0.0), 2, earthSurface);
+hittableList earth(sceneArena& arena) {
+    auto earthTex = arena.make<imageTexture>("earthmap.jpg");
+    auto earthSurface = arena.make<lambertian>(earthTex);
+    auto globe = arena.make<sphere>(point3(0.0, 0.0, 0.0), 2, earthSurface);
 
     return hittableList(globe);
 }
 
-hittableList simpleLight() {
+hittableList simpleLight(sceneArena& arena) {
     hittableList entities;
 
-    auto perlinTex = make_shared<perlinTexture>(4);
-    entities.add(make_shared<sphere>(point3(0.0, -1000.0, 0.0), 1000, make_shared<lambertian>(perlinTex)));
-    entities.add(make_shared<sphere>(point3(0.0, 2.0, 0.0), 2, make_shared<lambertian>(perlinTex)));
+    auto perlinTex = arena.make<perlinTexture>(4);
+    entities.add(arena.make<sphere>(point3(0.0, -1000.0, 0.0), 1000, arena.make<lambertian>(perlinTex)));
+    entities.add(arena.make<sphere>(point3(0.0, 2.0, 0.0), 2, arena.make<lambertian>(perlinTex)));
+    perlinTex->bakeTurbulence(aabb(point3(-2.0, 0.01, -2.0), point3(2.0, 4.0, 2.0)));
 
-    auto difflight = make_shared<diffuseLight>(color(4.0, 4.0, 4.0));
-    entities.add(make_shared<aaRectangle>(point3(3.0, 1.0, -2.0), point3(5.0, 3.0, -2.0), difflight));
-    //entities.add(make_shared<sphere>(point3(0.0, 8.0, 0.0), 2, difflight));
+    auto difflight = arena.make<diffuseLight>(color(4.0, 4.0, 4.0));
+    entities.add(makeRectangle(arena, point3(3.0, 1.0, -2.0), point3(5.0, 3.0, -2.0), difflight));
+    //entities.add(arena.make<sphere>(point3(0.0, 8.0, 0.0), 2, difflight));
 
     return entities;
 }
 
-hittableList cornellBox() {
+hittableList cornellBox(sceneArena& arena) {
     hittableList entities;
 
-    auto red = make_shared<lambertian>(color(0.65, 0.05, 0.05));
-    auto white = make_shared<lambertian>(color(0.73, 0.73, 0.73));
-    auto green = make_shared<lambertian>(color(0.12, 0.45, 0.15));
-    auto light = make_shared<diffuseLight>(color(15.0, 15.0, 15.0));
+    auto red = arena.make<lambertian>(color(0.65, 0.05, 0.05));
+    auto white = arena.make<lambertian>(color(0.73, 0.73, 0.73));
+    auto green = arena.make<lambertian>(color(0.12, 0.45, 0.15));
+    auto light = arena.make<diffuseLight>(color(15.0, 15.0, 15.0));
 
-    entities.add(make_shared<aaRectangle>(point3(213.0, 554.0, 227.0), point3(343.0, 554.0, 332.0), light));
+    entities.add(makeRectangle(arena, point3(213.0, 554.0, 227.0), point3(343.0, 554.0, 332.0), light));
 
-    entities.add(make_shared<aaRectangle>(point3(555.0, 0.0, 0.0), point3(555.0, 555.0, 555.0), green)); // Left
-    entities.add(make_shared<aaRectangle>(point3(0.0, 0.0, 0.0), point3(0.0, 555.0, 555.0), red)); //       Right
-    entities.add(make_shared<aaRectangle>(point3(0.0, 0.0, 0.0), point3(555.0, 0.0, 555.0), white));
-    entities.add(make_shared<aaRectangle>(point3(0.0, 555.0, 0.0), point3(555.0, 555.0, 555.0), white));
-    entities.add(make_shared<aaRectangle>(point3(0.0, 0.0, 555.0), point3(555.0, 555.0, 555.0), white));
+    entities.add(makeRectangle(arena, point3(555.0, 0.0, 0.0), point3(555.0, 555.0, 555.0), green)); // Left
+    entities.add(makeRectangle(arena, point3(0.0, 0.0, 0.0), point3(0.0, 555.0, 555.0), red)); //       Right
+    entities.add(makeRectangle(arena, point3(0.0, 0.0, 0.0), point3(555.0, 0.0, 555.0), white));
+    entities.add(makeRectangle(arena, point3(0.0, 555.0, 0.0), point3(555.0, 555.0, 555.0), white));
+    entities.add(makeRectangle(arena, point3(0.0, 0.0, 555.0), point3(555.0, 555.0, 555.0), white));
 
-    shared_ptr<hittable> box1 = make_shared<aaBox>(point3(0.0, 0.0, 0.0), point3(165.0, 330.0, 165.0), white);
-    box1 = make_shared<pan>(box1, 15);
-    box1 = make_shared<translation>(box1, vec3(265.0, 0.0, 295.0));
+    shared_ptr<hittable> box1 = arena.make<box>(point3(0.0, 0.0, 0.0), point3(165.0, 330.0, 165.0), white);
+    box1 = arena.make<instance>(box1, affineTransform::translate(vec3(265.0, 0.0, 295.0)) * affineTransform::pan(15));
     entities.add(box1);
 
-    shared_ptr<hittable> box2 = make_shared<aaBox>(point3(0.0, 0.0, 0.0), point3(165.0, 165.0, 165.0), white);
-    box2 = make_shared<pan>(box2, -18);
-    box2 = make_shared<translation>(box2, vec3(130.0, 0.0, 65.0));
+    shared_ptr<hittable> box2 = arena.make<box>(point3(0.0, 0.0, 0.0), point3(165.0, 165.0, 165.0), white);
+    box2 = arena.make<instance>(box2, affineTransform::translate(vec3(130.0, 0.0, 65.0)) * affineTransform::pan(-18));
     entities.add(box2);
 
     return entities;
 }
 
-hittableList cornellSmoke() {
+hittableList cornellSmoke(sceneArena& arena) {
     hittableList entities;
 
-    auto red = make_shared<lambertian>(color(.65, 0.05, 0.05));
-    auto white = make_shared<lambertian>(color(.73, 0.73, 0.73));
-    auto green = make_shared<lambertian>(color(.12, 0.45, 0.15));
-    auto light = make_shared<diffuseLight>(color(7.0, 7.0, 7));
+    auto red = arena.make<lambertian>(color(.65, 0.05, 0.05));
+    auto white = arena.make<lambertian>(color(.73, 0.73, 0.73));
+    auto green = arena.make<lambertian>(color(.12, 0.45, 0.15));
+    auto light = arena.make<diffuseLight>(color(7.0, 7.0, 7));
 
-    entities.add(make_shared<aaRectangle>(point3(113.0, 554.0, 127.0), point3(443.0, 554.0, 432.0), light));
+    entities.add(makeRectangle(arena, point3(113.0, 554.0, 127.0), point3(443.0, 554.0, 432.0), light));
 
-    entities.add(make_shared<aaRectangle>(point3(555.0, 0.0, 0.0), point3(555.0, 555.0, 555.0), green)); // Left
-    entities.add(make_shared<aaRectangle>(point3(0.0, 0.0, 0.0), point3(0.0, 555.0, 555.0), red)); //       Right
-    entities.add(make_shared<aaRectangle>(point3(0.0, 0.0, 0.0), point3(555.0, 0.0, 555.0), white));
-    entities.add(make_shared<aaRectangle>(point3(0.0, 555.0, 0.0), point3(555.0, 555.0, 555.0), white));
-    entities.add(make_shared<aaRectangle>(point3(0.0, 0.0, 555.0), point3(555.0, 555.0, 555.0), white));
+    entities.add(makeRectangle(arena, point3(555.0, 0.0, 0.0), point3(555.0, 555.0, 555.0), green)); // Left
+    entities.add(makeRectangle(arena, point3(0.0, 0.0, 0.0), point3(0.0, 555.0, 555.0), red)); //       Right
+    entities.add(makeRectangle(arena, point3(0.0, 0.0, 0.0), point3(555.0, 0.0, 555.0), white));
+    entities.add(makeRectangle(arena, point3(0.0, 555.0, 0.0), point3(555.0, 555.0, 555.0), white));
+    entities.add(makeRectangle(arena, point3(0.0, 0.0, 555.0), point3(555.0, 555.0, 555.0), white));
 
-    shared_ptr<hittable> box1 = make_shared<aaBox>(point3(0.0, 0.0, 0.0), point3(165.0, 330.0, 165.0), white);
-    box1 = make_shared<pan>(box1, 15);
-    box1 = make_shared<translation>(box1, vec3(265.0, 0.0, 295.0));
+    shared_ptr<hittable> box1 = arena.make<box>(point3(0.0, 0.0, 0.0), point3(165.0, 330.0, 165.0), white);
+    box1 = arena.make<instance>(box1, affineTransform::translate(vec3(265.0, 0.0, 295.0)) * affineTransform::pan(15));
 
-    shared_ptr<hittable> box2 = make_shared<aaBox>(point3(0.0, 0.0, 0.0), point3(165.0, 165.0, 165), white);
-    box2 = make_shared<pan>(box2, -18);
-    box2 = make_shared<translation>(box2, vec3(130, 0.0, 65.0));
+    shared_ptr<hittable> box2 = arena.make<box>(point3(0.0, 0.0, 0.0), point3(165.0, 165.0, 165), white);
+    box2 = arena.make<instance>(box2, affineTransform::translate(vec3(130, 0.0, 65.0)) * affineTransform::pan(-18));
 
-    entities.add(make_shared<constantMedium>(box1, 0.01, color(0.0, 0.0, 0.0)));
-    entities.add(make_shared<constantMedium>(box2, 0.01, color(1.0, 1.0, 1.0)));
+    entities.add(arena.make<constantMedium>(box1, 0.01, color(0.0, 0.0, 0.0)));
+    entities.add(arena.make<constantMedium>(box2, 0.01, color(1.0, 1.0, 1.0)));
 
     return entities;
 }
 
-hittableList finalScene() {
+hittableList finalScene(sceneArena& arena, materialPool& materials) {
     hittableList boxes1;
-    auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+    auto ground = materials.makeLambertian(color(0.48, 0.83, 0.53));
 
     const int boxesPerSide = 20;
     for (int i = 0; i < boxesPerSide; i++) {
@@ -192,78 +217,80 @@ hittableList finalScene() {
             auto y1 = randomDouble(1.0, 101.0);
             auto z1 = z0 + w;
 
-            boxes1.add(make_shared<aaBox>(point3(x0, y0, z0), point3(x1, y1, z1), ground));
+            boxes1.add(arena.make<box>(point3(x0, y0, z0), point3(x1, y1, z1), ground));
         }
     }
 
     hittableList entities;
 
-    entities.add(make_shared<bvhNode>(boxes1, 0, 1));
+    entities.add(arena.make<bvhNode>(boxes1, 0, 1));
 
     // Light
-    auto light = make_shared<diffuseLight>(color(7.0, 7.0, 7.0));
-    entities.add(make_shared<aaRectangle>(point3(123.0, 554.0, 147), point3(423.0, 554.0, 412), light));
+    auto light = materials.makeDiffuseLight(color(7.0, 7.0, 7.0));
+    entities.add(makeRectangle(arena, point3(123.0, 554.0, 147), point3(423.0, 554.0, 412), light));
 
     // Blurry sphere
     auto center1 = point3(400, 400, 200);
     auto center2 = center1 + vec3(30, 0, 0);
-    auto moving_sphere_material = make_shared<lambertian>(color(0.7, 0.3, 0.1));
-    entities.add(make_shared<movingSphere>(center1, center2, 0, 1, 50, moving_sphere_material));
+    auto moving_sphere_material = materials.makeLambertian(color(0.7, 0.3, 0.1));
+    entities.add(arena.make<movingSphere>(center1, center2, 0, 1, 50, moving_sphere_material));
 
     // Glass sphere
-    entities.add(make_shared<sphere>(point3(260, 150, 45), 50, make_shared<dielectric>(1.5)));
+    entities.add(arena.make<sphere>(point3(260, 150, 45), 50, materials.makeDielectric(1.5)));
 
     // Metal sphere
-    entities.add(make_shared<sphere>(
-        point3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.9), 1.0)
+    entities.add(arena.make<sphere>(
+        point3(0, 150, 145), 50, materials.makeMetal(color(0.8, 0.8, 0.9), 1.0)
     ));
 
     // Filled Glass Sphere
-    auto boundary = make_shared<sphere>(point3(360, 150, 145), 70, make_shared<dielectric>(1.5));
+    auto boundary = arena.make<sphere>(point3(360, 150, 145), 70, materials.makeDielectric(1.5));
     entities.add(boundary);
-    entities.add(make_shared<constantMedium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
+    entities.add(arena.make<constantMedium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
 
     // Fog
-    // boundary = make_shared<sphere>(point3(0, 0, 0), 5000, make_shared<dielectric>(1.5));
-    // entities.add(make_shared<constantMedium>(boundary, 0.0001, color(1, 1, 1)));
+    // boundary = arena.make<sphere>(point3(0, 0, 0), 5000, arena.make<dielectric>(1.5));
+    // entities.add(arena.make<constantMedium>(boundary, 0.0001, color(1, 1, 1)));
 
     // Earth
-    auto emat = make_shared<lambertian>(make_shared<imageTexture>("assets/earthmap.jpg"));
-    entities.add(make_shared<sphere>(point3(400, 200, 400), 100, emat));
+    auto emat = materials.makeLambertian(arena.make<imageTexture>("assets/earthmap.jpg"));
+    entities.add(arena.make<sphere>(point3(400, 200, 400), 100, emat));
 
     // Rough sphere
-    auto perlinTex = make_shared<perlinTexture>(0.1);
-    entities.add(make_shared<sphere>(point3(220, 280, 300), 80, make_shared<lambertian>(perlinTex)));
+    auto perlinTex = arena.make<perlinTexture>(0.1);
+    entities.add(arena.make<sphere>(point3(220, 280, 300), 80, materials.makeLambertian(perlinTex)));
 
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto white = materials.makeLambertian(color(.73, .73, .73));
 
     // Box of spheres
-    //hittableList boxes2;
-    //int ns = 1000;
-    //for (int j = 0; j < ns; j++) {
-    //    boxes2.add(make_shared<sphere>(point3::random(0.0, 165.0), 10, white));
-    //}
+    sphereCloudBuffers cloud;
+    std::uint32_t whiteIndex = cloud.addMaterial(white);
+    int ns = 1000;
+    for (int j = 0; j < ns; j++) {
+        cloud.addSphere(point3::random(0.0, 165.0), 10, whiteIndex);
+    }
 
-    //entities.add(make_shared<translation>(
-    //    make_shared<pan>(make_shared<bvhNode>(boxes2, 0.0, 1.0), 15), vec3(-100.0, 270.0, 395.0))
-    //);
+    entities.add(arena.make<instance>(
+        arena.make<sphereCloud>(std::move(cloud)),
+        affineTransform::translate(vec3(-100.0, 270.0, 395.0)) * affineTransform::pan(15)
+    ));
 
     // Box of smoke
-    auto box = make_shared<aaBox>(point3(0.0, 0.0, 0.0), point3(165.0, 165.0, 165.0), white);
-    entities.add(make_shared<translation>(
-        make_shared<pan>(
-            make_shared<constantMedium>(box, 0.1, color(1.0, 1.0, 1.0)), 15
-        ), vec3(-100.0, 270.0, 395.0)
+    auto smokeBoundary = arena.make<box>(point3(0.0, 0.0, 0.0), point3(165.0, 165.0, 165.0), white);
+    entities.add(arena.make<instance>(
+        arena.make<constantMedium>(smokeBoundary, 0.1, color(1.0, 1.0, 1.0)),
+        affineTransform::translate(vec3(-100.0, 270.0, 395.0)) * affineTransform::pan(15)
     ));
 
     return entities;
 }
 
-hittableList randomSceneBVH() {
+// The diffuse spheres rise by up to maxMotion during the shutter.
+hittableList randomSceneBVH(sceneArena& arena, materialPool& materials, double maxMotion = 0.5) {
     hittableList entities;
 
-    auto checker = make_shared<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
-    entities.add(make_shared<sphere>(point3(0.0, -1000.0, 0.0), 1000.0, make_shared<lambertian>(checker)));
+    auto checker = arena.make<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    entities.add(arena.make<sphere>(point3(0.0, -1000.0, 0.0), 1000.0, materials.makeLambertian(checker)));
 
     hittableList spheres;
 
@@ -278,186 +305,428 @@ hittableList randomSceneBVH() {
                 if (chooseMat < 0.8) {
                     // diffuse
                     auto albedo = color::random() * color::random();
-                    sphereMaterial = make_shared<lambertian>(albedo);
-                    point3 endCenter = center + vec3(0.0, randomDouble(0, 0.5), 0.0);
-                    spheres.add(make_shared<movingSphere>(center, endCenter, 0.0, 1.0, 0.2, sphereMaterial));
+                    sphereMaterial = materials.makeLambertian(albedo);
+                    point3 endCenter = center + vec3(0.0, randomDouble(0, maxMotion), 0.0);
+                    spheres.add(arena.make<movingSphere>(center, endCenter, 0.0, 1.0, 0.2, sphereMaterial));
                 }
                 else if (chooseMat < 0.95) {
                     // metal
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = randomDouble(0, 0.5);
-                    sphereMaterial = make_shared<metal>(albedo, fuzz);
-                    spheres.add(make_shared<sphere>(center, 0.2, sphereMaterial));
+                    sphereMaterial = materials.makeMetal(albedo, fuzz);
+                    spheres.add(arena.make<sphere>(center, 0.2, sphereMaterial));
                 }
                 else {
                     // glass
-                    sphereMaterial = make_shared<dielectric>(1.5);
-                    spheres.add(make_shared<sphere>(center, 0.2, sphereMaterial));
+                    sphereMaterial = materials.makeDielectric(1.5);
+                    spheres.add(arena.make<sphere>(center, 0.2, sphereMaterial));
                 }
             }
         }
     }
 
-    entities.add(make_shared<bvhNode>(spheres, 0.0, 1.0));
+    entities.add(arena.make<bvhNode>(spheres, 0.0, 1.0));
 
-    auto material1 = make_shared<dielectric>(1.5);
-    entities.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+    auto material1 = materials.makeDielectric(1.5);
+    entities.add(arena.make<sphere>(point3(0, 1, 0), 1.0, material1));
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    entities.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    auto material2 = materials.makeLambertian(color(0.4, 0.2, 0.1));
+    entities.add(arena.make<sphere>(point3(-4, 1, 0), 1.0, material2));
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    entities.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    auto material3 = materials.makeMetal(color(0.7, 0.6, 0.5), 0.0);
+    entities.add(arena.make<sphere>(point3(4, 1, 0), 1.0, material3));
 
     return entities;
 }
 
-color rayColor(const ray& r, const color& background, const hittableList& entities, int depth) {
-    hitRecord record;
+// UV sphere with shared vertices, smooth normals, and texture coordinates laid out like sphere::getUV.
+meshBuffers tessellateSphere(const point3& center, double radius, int rings, int segments) {
+    meshBuffers buffers;
+
+    for (int ring = 0; ring <= rings; ring++) {
+        double theta = pi * ring / rings;
+        for (int segment = 0; segment <= segments; segment++) {
+            double phi = 2.0 * pi * segment / segments;
+            vec3 normal(-sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+            buffers.addVertex(center + radius * normal);
+            buffers.addNormal(normal);
+            buffers.addUV(real(double(segment) / segments), real(1.0 - double(ring) / rings));
+        }
+    }
+
+    const std::uint32_t rowLength = segments + 1;
+    for (int ring = 0; ring < rings; ring++) {
+        for (int segment = 0; segment < segments; segment++) {
+            std::uint32_t a = ring * rowLength + segment;
+            std::uint32_t b = a + rowLength;
+            if (ring > 0) buffers.addTriangle(a, a + 1, b);
+            if (ring < rings - 1) buffers.addTriangle(a + 1, b + 1, b);
+        }
+    }
 
-    // Base Case
-    if (depth <= 0) return color(0.0, 0.0, 0.0);
+    return buffers;
+}
 
-    // If the ray hits nothing, return the background color.
-    if (!entities.hit(r, 0.001, infinity, record))
-        return background;
+// A finely tessellated sphere between two analytic ones; the mesh has about a million triangles.
+hittableList meshScene(sceneArena& arena) {
+    hittableList entities;
 
-    ray scattered;
-    color attenuation;
-    color emitted = record.material_ptr->emitted(record.u, record.v, record.point);
+    auto checker = arena.make<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    entities.add(arena.make<sphere>(point3(0.0, -1000.0, 0.0), 1000.0, arena.make<lambertian>(checker)));
 
-    if (!record.material_ptr->scatter(r, record.point, record.normal,
-        record.isFrontFace, record.u, record.v, attenuation, scattered))
-    { return emitted; }
+    auto earthTexture = arena.make<imageTexture>("assets/earthmap.jpg");
+    entities.add(arena.make<indexedMesh>(
+        tessellateSphere(point3(0.0, 1.0, 0.0), 1.0, 512, 1024), arena.make<lambertian>(earthTexture)
+    ));
 
-    return emitted + attenuation * rayColor(scattered, background, entities, depth - 1);
+    entities.add(arena.make<sphere>(point3(-2.2, 1.0, 0.0), 1.0, arena.make<dielectric>(1.5)));
+    entities.add(arena.make<sphere>(point3(2.2, 1.0, 0.0), 1.0, arena.make<metal>(color(0.7, 0.6, 0.5), 0.0)));
+
+    return entities;
 }
 
-int main() {
+// A field of 900 placements of two shapes, a tessellated sphere and a ring of small spheres,
+// with random rotations and sizes. Each shape exists once in memory; only the transforms repeat.
+hittableList instancedScene(sceneArena& arena, materialPool& materials) {
+    hittableList entities;
 
-    // Image
+    auto checker = arena.make<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    entities.add(arena.make<sphere>(point3(0.0, -1000.0, 0.0), 1000.0, materials.makeLambertian(checker)));
 
-    double aspectRatio = 16.0 / 9.0;
-    int imageWidth = 400;
-    int samplesPerPixel = 100;
-    const int maxDepth = 50;
+    shared_ptr<hittable> ball = arena.make<indexedMesh>(
+        tessellateSphere(point3(0.0, 1.0, 0.0), 1.0, 64, 128), materials.makeMetal(color(0.8, 0.6, 0.4), 0.2)
+    );
 
-    // Entities
-    
-    hittableList entities;
+    auto ring = arena.make<hittableList>();
+    for (int i = 0; i < 24; i++) {
+        double angle = 2.0 * pi * i / 24;
+        auto albedo = color::random(0.2, 0.9);
+        ring->add(arena.make<sphere>(point3(cos(angle), 0.15 + 0.1 * (i % 2), sin(angle)), 0.15, materials.makeLambertian(albedo)));
+    }
+
+    for (int i = 0; i < 30; i++) {
+        for (int j = 0; j < 30; j++) {
+            vec3 offset(-30.0 + 2.0 * i + randomDouble(-0.4, 0.4), 0.0, -30.0 + 2.0 * j + randomDouble(-0.4, 0.4));
+            real size = real(randomDouble(0.3, 0.7));
+            affineTransform place = affineTransform::translate(offset)
+                * affineTransform::pan(real(randomDouble(0.0, 360.0)))
+                * affineTransform::scale(vec3(size, size, size));
+            entities.add(arena.make<instance>((i + j) % 2 ? ball : ring, place));
+        }
+    }
+
+    return entities;
+}
+
+// A mesh file on a ground plane under a sky, with the camera framing its bounding box. meshHash
+// receives the geometry's content hash, which tells checkpoints of different files apart.
+bool meshFileScene(const std::string& path, unsigned threadCount, sceneSetup& scene, std::uint64_t& meshHash) {
+    meshBuffers buffers;
+    if (!loadMesh(path, buffers, threadCount)) return false;
+    if (buffers.getTriangleCount() == 0) {
+        std::cerr << "ERROR: '" << path << "' contains no triangles.\n";
+        return false;
+    }
+    meshHash = buffers.getContentHash();
+
+    auto mesh = scene.arena.make<indexedMesh>(std::move(buffers), scene.arena.make<lambertian>(color(0.6, 0.6, 0.6)));
+    aabb bounds;
+    mesh->getAABB(0.0, 1.0, bounds);
+
+    point3 center = 0.5 * (bounds.getMin() + bounds.getMax());
+    double radius = 0.5 * (bounds.getMax() - bounds.getMin()).length();
 
-    point3 lookFrom;
-    point3 lookAt;
-    double vFOV = 0.0;
-    double aperture = 0.0;
-    color background(0.0, 0.0, 0.0);
+    scene.entities.add(mesh);
+    scene.entities.add(scene.arena.make<sphere>(
+        point3(center.x(), bounds.getMin().y() - 1000.0 * radius, center.z()), 1000.0 * radius,
+        scene.arena.make<lambertian>(color(0.5, 0.5, 0.5))
+    ));
+
+    scene.accelerator = acceleratorType::sah;
+    scene.background = color(0.70, 0.80, 1.00);
+    scene.vFOV = 30.0;
+    scene.lookAt = center;
+    scene.lookFrom = center + (1.3 * radius / std::tan(degreesToRadians(0.5 * scene.vFOV))) * unitVector(vec3(0.4, 0.3, 1.0));
+    return true;
+}
+
+sceneSetup makeScene(int sceneId) {
+    sceneSetup scene;
 
-    switch (8) {
+    switch (sceneId) {
     case 1:
-        entities = randomScene();
-        background = color(0.70, 0.80, 1.00);
-        lookFrom = point3(13.0, 2.0, 3.0);
-        lookAt = point3(0.0, 0.0, 0.0);
-        vFOV = 20.0;
-        aperture = 0.1;
+        scene.entities = randomScene(scene.arena, scene.materials);
+        scene.accelerator = acceleratorType::sah;
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(13.0, 2.0, 3.0);
+        scene.lookAt = point3(0.0, 0.0, 0.0);
+        scene.vFOV = 20.0;
+        scene.aperture = 0.1;
         break;
     case 2:
-        entities = twoSpheres();
-        background = color(0.70, 0.80, 1.00);
-        lookFrom = point3(13.0, 2.0, 3.0);
-        lookAt = point3(0.0, 0.0, 0.0);
-        vFOV = 20.0;
+        scene.entities = twoSpheres(scene.arena);
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(13.0, 2.0, 3.0);
+        scene.lookAt = point3(0.0, 0.0, 0.0);
+        scene.vFOV = 20.0;
         break;
     case 3:
-        entities = twoPerlinSpheres();
-        background = color(0.70, 0.80, 1.00);
-        lookFrom = point3(13.0, 2.0, 3.0);
-        lookAt = point3(0.0, 0.0, 0.0);
-        vFOV = 20.0;
+        scene.entities = twoPerlinSpheres(scene.arena);
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(13.0, 2.0, 3.0);
+        scene.lookAt = point3(0.0, 0.0, 0.0);
+        scene.vFOV = 20.0;
         break;
     case 4:
-        entities = earth();
-        background = color(0.70, 0.80, 1.00);
-        lookFrom = point3(13.0, 2.0, 3.0);
-        lookAt = point3(0.0, 0.0, 0.0);
-        vFOV = 20.0;
+        scene.entities = earth(scene.arena);
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(13.0, 2.0, 3.0);
+        scene.lookAt = point3(0.0, 0.0, 0.0);
+        scene.vFOV = 20.0;
         break;
     case 5:
-        entities = simpleLight();
-        samplesPerPixel = 400;
-        background = color(0.0, 0.0, 0.0);
-        lookFrom = point3(26.0, 3.0, 6.0);
-        lookAt = point3(0.0, 2.0, 0.0);
-        vFOV = 20.0;
+        scene.entities = simpleLight(scene.arena);
+        scene.samplesPerPixel = 400;
+        scene.background = color(0.0, 0.0, 0.0);
+        scene.lookFrom = point3(26.0, 3.0, 6.0);
+        scene.lookAt = point3(0.0, 2.0, 0.0);
+        scene.vFOV = 20.0;
         break;
     case 6:
-        entities = cornellBox();
-        aspectRatio = 1.0;
-        imageWidth = 600;
-        samplesPerPixel = 200;
-        background = color(0.0, 0.0, 0.0);
-        lookFrom = point3(278.0, 278.0, -800.0);
-        lookAt = point3(278.0, 278.0, 0.0);
-        vFOV = 40.0;
+        scene.entities = cornellBox(scene.arena);
+        scene.aspectRatio = 1.0;
+        scene.imageWidth = 600;
+        scene.samplesPerPixel = 200;
+        scene.background = color(0.0, 0.0, 0.0);
+        scene.lookFrom = point3(278.0, 278.0, -800.0);
+        scene.lookAt = point3(278.0, 278.0, 0.0);
+        scene.vFOV = 40.0;
         break;
     case 7:
-        entities = cornellSmoke();
-        aspectRatio = 1.0;
-        imageWidth = 600;
-        samplesPerPixel = 200;
-        background = color(0.0, 0.0, 0.0);
-        lookFrom = point3(278.0, 278.0, -800.0);
-        lookAt = point3(278.0, 278.0, 0.0);
-        vFOV = 40.0;
+        scene.entities = cornellSmoke(scene.arena);
+        scene.aspectRatio = 1.0;
+        scene.imageWidth = 600;
+        scene.samplesPerPixel = 200;
+        scene.background = color(0.0, 0.0, 0.0);
+        scene.lookFrom = point3(278.0, 278.0, -800.0);
+        scene.lookAt = point3(278.0, 278.0, 0.0);
+        scene.vFOV = 40.0;
         break;
     case 8:
-        entities = finalScene();
-        aspectRatio = 1.0;
-        imageWidth = 600;
-        samplesPerPixel = 5000;
-        background = color(0, 0, 0);
-        lookFrom = point3(478, 278, -600);
-        lookAt = point3(278, 278, 0);
-        vFOV = 40.0;
+        scene.entities = finalScene(scene.arena, scene.materials);
+        scene.accelerator = acceleratorType::sah;
+        scene.aspectRatio = 1.0;
+        scene.imageWidth = 600;
+        scene.samplesPerPixel = 5000;
+        scene.background = color(0, 0, 0);
+        scene.lookFrom = point3(478, 278, -600);
+        scene.lookAt = point3(278, 278, 0);
+        scene.vFOV = 40.0;
         break;
     case 9:
-        entities = randomSceneBVH();
-        background = color(0.70, 0.80, 1.00);
-        lookFrom = point3(13.0, 2.0, 3.0);
-        lookAt = point3(0.0, 0.0, 0.0);
-        vFOV = 20.0;
-        aperture = 0.1;
+        scene.entities = randomSceneBVH(scene.arena, scene.materials);
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(13.0, 2.0, 3.0);
+        scene.lookAt = point3(0.0, 0.0, 0.0);
+        scene.vFOV = 20.0;
+        scene.aperture = 0.1;
+        break;
+    case 10:
+        scene.entities = meshScene(scene.arena);
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(0.0, 3.0, 12.0);
+        scene.lookAt = point3(0.0, 1.0, 0.0);
+        scene.vFOV = 25.0;
+        break;
+    case 11:
+        scene.entities = instancedScene(scene.arena, scene.materials);
+        scene.accelerator = acceleratorType::tlas;
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(0.0, 6.0, 24.0);
+        scene.lookAt = point3(0.0, 0.0, 0.0);
+        scene.vFOV = 35.0;
+        break;
+    case 12:
+        // Scene 9 with long motion: the diffuse spheres travel up to 15 radii. The 8-wide tree
+        // traces it fastest in --benchmark; the motion tree keeps a single segment here.
+        scene.entities = randomSceneBVH(scene.arena, scene.materials, 3.0);
+        scene.accelerator = acceleratorType::bvh8;
+        scene.background = color(0.70, 0.80, 1.00);
+        scene.lookFrom = point3(13.0, 2.0, 3.0);
+        scene.lookAt = point3(0.0, 0.0, 0.0);
+        scene.vFOV = 20.0;
+        scene.aperture = 0.1;
         break;
     default:
-        background = color(0.0, 0.0, 0.0);
         break;
     }
-    
-    // Camera
 
+    scene.entities = foldTransforms(scene.entities, scene.arena);
+    return scene;
+}
+
+camera makeCamera(const sceneSetup& scene) {
     vec3 vUp(0.0, 1.0, 0.0);
     double focusDistance = 10.0;
-    int imageHeight = static_cast<int>(double(imageWidth) / aspectRatio);
 
-    camera camera(lookFrom, lookAt, vUp, vFOV, aspectRatio, aperture, focusDistance, 0.0, 1.0);
+    return camera(scene.lookFrom, scene.lookAt, vUp, scene.vFOV, scene.aspectRatio, scene.aperture, focusDistance, 0.0, 1.0);
+}
 
-    // Render
+shared_ptr<hittable> buildAccelerator(const hittableList& entities, acceleratorType type) {
+    switch (type) {
+    case acceleratorType::bvh:
+        return make_shared<bvhNode>(flattenHierarchy(entities), 0.0, 1.0);
+    case acceleratorType::sah:
+        return make_shared<linearBvh>(flattenHierarchy(entities), 0.0, 1.0);
+    case acceleratorType::bvh4:
+        return make_shared<bvh4>(flattenHierarchy(entities), 0.0, 1.0);
+    case acceleratorType::bvh8:
+        return make_shared<bvh8>(flattenHierarchy(entities), 0.0, 1.0);
+    case acceleratorType::tlas:
+        return make_shared<tlas>(entities, 0.0, 1.0);
+    case acceleratorType::motion:
+        return make_shared<motionBvh>(flattenHierarchy(entities), 0.0, 1.0);
+    default:
+        return make_shared<hittableList>(entities);
+    }
+}
 
-    std::cout << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
-
-    for (int row = imageHeight - 1; row >= 0; --row) {
-        std::cerr << "\rScanlines remaining: " << row << ' ' << std::flush;
-        for (int column = 0; column < imageWidth; ++column) {
-            color pixelColor(0.0, 0.0, 0.0);
-            for (int s = 0; s < samplesPerPixel; s++) {
-                double u = (double(column) + randomDouble()) / (imageWidth - 1);
-                double v = (double(row) + randomDouble()) / (imageHeight - 1);
-                ray r = camera.getRay(u, v);
-                pixelColor += rayColor(r, background, entities, maxDepth);
-            }
-            writeColor(std::cout, pixelColor, samplesPerPixel);
+int main(int argc, char* argv[]) {
+    using clock = std::chrono::steady_clock;
+    const auto launchTime = clock::now();
+
+    renderOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    textureRegistry::global().setNoiseVolumeResolution(options.noiseVolumeResolution);
+
+    if (options.benchmark) {
+        // Many small spheres, large boxes, instanced shapes, and long motion blur.
+        const int benchmarkScenes[] = { 9, 8, 11, 12 };
+        for (int id : benchmarkScenes) {
+            sceneSetup scene = makeScene(id);
+            int height = static_cast<int>(double(scene.imageWidth) / scene.aspectRatio);
+            benchmarkAccelerators("Scene " + std::to_string(id), scene.entities, makeCamera(scene), scene.imageWidth, height);
         }
+
+        sceneSetup instanced = makeScene(11);
+        benchmarkRefit("Scene 11 refit", instanced.entities, makeCamera(instanced), instanced.imageWidth,
+            static_cast<int>(double(instanced.imageWidth) / instanced.aspectRatio));
+
+        sceneSetup boxScene = makeScene(8);
+        benchmarkBoxes(makeCamera(boxScene), boxScene.imageWidth, static_cast<int>(double(boxScene.imageWidth) / boxScene.aspectRatio));
+        benchmarkSphereCloud(1000000, makeCamera(boxScene), boxScene.imageWidth, static_cast<int>(double(boxScene.imageWidth) / boxScene.aspectRatio));
+        return 0;
+    }
+
+    const int maxDepth = options.maxDepth;
+    const int sceneId = options.sceneId > 0 ? options.sceneId : 8;
+    const bool useCache = !options.sceneCachePath.empty() && options.meshPath.empty();
+
+    // A cached scene may come with its SAH tree, which is used when that is the accelerator.
+    sceneSetup scene;
+    shared_ptr<hittable> world;
+    bool fromCache = false;
+    std::uint64_t meshHash = 0;
+    if (!options.meshPath.empty()) {
+        if (!meshFileScene(options.meshPath, options.threadCount > 0 ? options.threadCount : threadPool::defaultThreadCount(), scene, meshHash)) return 1;
+    } else {
+        fromCache = useCache && loadSceneCache(options.sceneCachePath, sceneId, scene, world);
+        if (!fromCache) scene = makeScene(sceneId);
     }
+    if (scene.materials.getRequestCount() > 0) scene.materials.printStatistics(std::cerr);
+    if (scene.arena.getObjectCount() > 0) scene.arena.printStatistics(std::cerr);
+    const color background = scene.background;
+    const auto sceneReadyTime = clock::now();
+
+    acceleratorType accelerator = scene.accelerator;
+    if (options.accelerator != acceleratorType::sceneDefault) accelerator = options.accelerator;
+    if (!world || accelerator != acceleratorType::sah) world = buildAccelerator(scene.entities, accelerator);
+    const auto worldReadyTime = clock::now();
+    if (useCache && !fromCache) saveSceneCache(options.sceneCachePath, sceneId, scene, world);
+
+    int imageWidth = scene.imageWidth;
+    int samplesPerPixel = scene.samplesPerPixel;
+    if (options.imageWidth > 0) imageWidth = options.imageWidth;
+    if (options.samplesPerPixel > 0) samplesPerPixel = options.samplesPerPixel;
+
+    // Camera
+
+    int imageHeight = static_cast<int>(double(imageWidth) / scene.aspectRatio);
+    camera camera = makeCamera(scene);
+
+    // Render
+
+    renderSettings settings;
+    settings.imageWidth = imageWidth;
+    settings.imageHeight = imageHeight;
+    settings.samplesPerPixel = samplesPerPixel;
+    settings.maxDepth = maxDepth;
+    settings.rouletteDepth = options.rouletteDepth;
+    settings.tileSize = options.tileSize;
+    settings.seed = options.seed;
+    settings.textureFiltering = options.textureFiltering;
+    if (options.threadCount > 0) settings.threadCount = options.threadCount;
+
+    imageWriter writer;
+    framebuffer image(imageWidth, imageHeight);
+    renderer pathTracer(camera, *world, background, settings);
+
+    checkpointInfo progress;
+    progress.sceneId = options.meshPath.empty() ? sceneId : 0;
+    progress.seed = options.seed;
+    progress.width = imageWidth;
+    progress.height = imageHeight;
+    progress.maxDepth = maxDepth;
+    progress.textureFiltering = options.textureFiltering ? 1 : 0;
+    progress.noiseVolumeResolution = options.noiseVolumeResolution;
+    progress.meshHash = meshHash;
+
+    if (options.resume && loadCheckpoint(options.checkpointPath, progress, image)) {
+        std::cerr << "Resuming from '" << options.checkpointPath << "' at "
+            << image.getTotalSamples() / double(image.getPixelCount()) << " of "
+            << samplesPerPixel << " samples per pixel.\n";
+    }
+
+    auto milliseconds = [](clock::duration span) { return std::chrono::duration<double, std::milli>(span).count(); };
+    std::cerr << "Time to first pixel: " << milliseconds(clock::now() - launchTime) << " ms (scene "
+        << (fromCache ? "loaded" : "built") << " in " << milliseconds(sceneReadyTime - launchTime) << " ms, accelerator "
+        << milliseconds(worldReadyTime - sceneReadyTime) << " ms)\n";
+
+    if (options.passSamples <= 0) {
+        pathTracer.render(image);
+    } else {
+        // Progressive: accumulate passes, snapshotting the sums to disk every interval.
+        auto lastCheckpoint = clock::now();
+
+        progressiveSettings progressive;
+        progressive.passSamples = options.passSamples;
+        progressive.adaptiveThreshold = options.adaptiveThreshold;
+        progressive.maxSamplesPerPixel = options.adaptiveMaxSamples;
+
+        pathTracer.renderProgressive(image, progressive, [&](bool finished) {
+            double elapsed = std::chrono::duration<double>(clock::now() - lastCheckpoint).count();
+            if (options.checkpointPath.empty() || (!finished && elapsed < options.checkpointInterval)) return;
+
+            // The writer thread gets its own copy, so the next pass starts immediately.
+            writer.submit([snapshot = image, progress, path = options.checkpointPath] {
+                saveCheckpoint(path, progress, snapshot);
+            });
+            if (!finished && !options.outputPath.empty())
+                writer.write(image.resolve(), formatFromPath(options.outputPath), options.outputPath);
+            if (!finished && !options.heatmapPath.empty())
+                writer.write(image.sampleHeatmap(), formatFromPath(options.heatmapPath), options.heatmapPath);
+
+            lastCheckpoint = clock::now();
+        });
+    }
+
+    // Encoding and writing happen on the writer thread; its destructor waits for them.
+    writer.write(image.resolve(), formatFromPath(options.outputPath), options.outputPath);
+    if (!options.heatmapPath.empty())
+        writer.write(image.sampleHeatmap(), formatFromPath(options.heatmapPath), options.heatmapPath);
 
     std::cerr << "\nDone.\n";
+    if (textureRegistry::global().getRequestCount() > 0) textureRegistry::global().printStatistics(std::cerr);
+
+    if (options.printHistogram) pathTracer.getHistogram().print(std::cerr);
 }
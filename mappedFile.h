@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file mapped into memory. Pages are read in by the OS as they are
+// touched, so parsers can walk the bytes directly without copying them into buffers first.
+class mappedFile {
+public:
+	mappedFile() {}
+	explicit mappedFile(const std::string& path) { open(path); }
+	~mappedFile() { close(); }
+
+	mappedFile(const mappedFile&) = delete;
+	mappedFile& operator=(const mappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return m_opened; }
+	const char* begin() const { return m_data; }
+	const char* end() const { return m_data + m_size; }
+	size_t getSize() const { return m_size; }
+
+private:
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_opened = false;
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#endif
+};
+
+inline bool mappedFile::open(const std::string& path) {
+	close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		std::cerr << "ERROR: Could not open '" << path << "'.\n";
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(m_file, &size);
+	m_size = static_cast<size_t>(size.QuadPart);
+	m_opened = true;
+	if (m_size == 0) return true;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping) m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	int descriptor = ::open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		std::cerr << "ERROR: Could not open '" << path << "'.\n";
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(descriptor, &status) == 0) {
+		m_size = static_cast<size_t>(status.st_size);
+		m_opened = true;
+		if (m_size > 0) {
+			void* address = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (address != MAP_FAILED) {
+				madvise(address, m_size, MADV_SEQUENTIAL);
+				m_data = static_cast<const char*>(address);
+			}
+		}
+	}
+	::close(descriptor); // The mapping keeps its own reference
+#endif
+
+	if (m_size > 0 && !m_data) {
+		std::cerr << "ERROR: Could not map '" << path << "' into memory.\n";
+		close();
+		return false;
+	}
+
+	return m_opened;
+}
+
+inline void mappedFile::close() {
+#ifdef _WIN32
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data) munmap(const_cast<char*>(m_data), m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+	m_opened = false;
+}
@@ -2,16 +2,24 @@
 
 #include "utils.h"
 #include "texture.h"
+#include "rayDifferential.h"
 
 class material {
 public:
 	virtual bool scatter(
-		const ray& inRay, const point3& point, const vec3& normal, const bool& isFrontFace, double u, double v, color& attenuation, ray& scattered
+		const ray& inRay, const point3& point, const vec3& normal, const bool& isFrontFace, real u, real v,
+		const uvFootprint& footprint, color& attenuation, ray& scattered
 	) const = 0;
 
-	virtual color emitted(double u, double v, const point3& p) const {
+	virtual color emitted(real u, real v, const point3& p, const uvFootprint& footprint) const {
 		return color(0.0, 0.0, 0.0);
 	}
+
+	// Carries the differentials of inRay across a scatter into scattered. Only specular
+	// materials can; the rest drop them.
+	virtual bool transferDifferential(
+		const ray& inRay, const vec3& normal, bool isFrontFace, const ray& scattered, rayDifferential& differential
+	) const { return false; }
 };
 
 class lambertian : public material {
@@ -21,14 +29,14 @@ public:
 
 	virtual bool scatter(
 		const ray& inRay, const point3& point, const vec3& normal,
-		const bool& isFrontFace, double u, double v, color& attenuation, ray& scattered
+		const bool& isFrontFace, real u, real v, const uvFootprint& footprint, color& attenuation, ray& scattered
 	) const override {
 		vec3 scatterDir = normal + randomUnitVector();
 
 		if (scatterDir.nearZero()) scatterDir = normal;
 
 		scattered = ray(point, scatterDir, inRay.getTime());
-		attenuation = m_albedo->getValue(u, v, point);
+		attenuation = m_albedo->getFilteredValue(u, v, point, footprint);
 		return true;
 	}
 
@@ -38,11 +46,11 @@ public:
 
 class metal : public material {
 public:
-	metal(const color& albedo, double roughness) : m_albedo(albedo), m_reflectionFuzz(roughness < 1.0 ? roughness : 1.0) {}
+	metal(const color& albedo, real roughness) : m_albedo(albedo), m_reflectionFuzz(roughness < 1.0 ? roughness : 1.0) {}
 
 	virtual bool scatter(
 		const ray& inRay, const point3& point, const vec3& normal,
-		const bool& isFrontFace, double u, double v, color& attenuation, ray& scattered
+		const bool& isFrontFace, real u, real v, const uvFootprint& footprint, color& attenuation, ray& scattered
 	) const override {
 		vec3 reflected = reflect(unitVector(inRay.getDirection()), normal);
 		scattered = ray(point, reflected + m_reflectionFuzz * randomInUnitSphere(), inRay.getTime());
@@ -50,25 +58,34 @@ public:
 		return dot(scattered.getDirection(), normal) > 0.0;
 	}
 
+	// Fuzzy reflections spread far more than a mirror's differentials would say.
+	virtual bool transferDifferential(
+		const ray& inRay, const vec3& normal, bool isFrontFace, const ray& scattered, rayDifferential& differential
+	) const override {
+		if (m_reflectionFuzz != 0) return false;
+		differential.reflectAt(normal);
+		return true;
+	}
+
 public:
 	color m_albedo;
-	double m_reflectionFuzz;
+	real m_reflectionFuzz;
 };
 
 class dielectric : public material {
 public:
-	dielectric(double refractionIndex) : m_refractionIndex(refractionIndex) {}
+	dielectric(real refractionIndex) : m_refractionIndex(refractionIndex) {}
 
 	virtual bool scatter(
 		const ray& inRay, const point3& point, const vec3& normal,
-		const bool& isFrontFace, double u, double v, color& attenuation, ray& scattered
+		const bool& isFrontFace, real u, real v, const uvFootprint& footprint, color& attenuation, ray& scattered
 	) const override {
 		attenuation = color(1.0, 1.0, 1.0);
-		double refractionRatio = isFrontFace ? (1.0 / m_refractionIndex) : m_refractionIndex;
+		real refractionRatio = isFrontFace ? (1.0 / m_refractionIndex) : m_refractionIndex;
 
 		vec3 unitDir = unitVector(inRay.getDirection());
-		double cosTheta = fmin(dot(-unitDir, normal), 1.0);
-		double sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+		real cosTheta = fmin(dot(-unitDir, normal), 1.0);
+		real sinTheta = sqrt(1.0 - cosTheta * cosTheta);
 
 		bool cannotRefract = refractionRatio * sinTheta > 1.0;
 		vec3 direction = cannotRefract || reflectance(cosTheta, refractionRatio) > randomDouble() ?
@@ -78,12 +95,24 @@ public:
 		
 		return true;
 	}
+
+	// scatter picked reflection when the new direction leaves on the incoming side.
+	virtual bool transferDifferential(
+		const ray& inRay, const vec3& normal, bool isFrontFace, const ray& scattered, rayDifferential& differential
+	) const override {
+		if (dot(scattered.getDirection(), normal) > 0.0) {
+			differential.reflectAt(normal);
+			return true;
+		}
+		real refractionRatio = isFrontFace ? (1.0 / m_refractionIndex) : m_refractionIndex;
+		return differential.refractAt(unitVector(inRay.getDirection()), normal, refractionRatio);
+	}
 public:
-	double m_refractionIndex;
+	real m_refractionIndex;
 private:
-	static double reflectance(double cosine, double refractionRatio) {
+	static real reflectance(real cosine, real refractionRatio) {
 		// Use Schlick's approximation for reflectance.
-		double r0 = (1.0 - refractionRatio) / (1.0 + refractionRatio);
+		real r0 = (1.0 - refractionRatio) / (1.0 + refractionRatio);
 		r0 = r0 * r0;
 		return r0 + (1 - r0) * pow(1.0 - cosine, 5);
 	}
@@ -96,11 +125,11 @@ public:
 
 	virtual bool scatter(
 		const ray& inRay, const point3& point, const vec3& normal,
-		const bool& isFrontFace, double u, double v, color& attenuation, ray& scattered
+		const bool& isFrontFace, real u, real v, const uvFootprint& footprint, color& attenuation, ray& scattered
 	) const override { return false; }
 
-	virtual color emitted(double u, double v, const point3& p) const override {
-		return m_emit->getValue(u, v, p);
+	virtual color emitted(real u, real v, const point3& p, const uvFootprint& footprint) const override {
+		return m_emit->getFilteredValue(u, v, p, footprint);
 	}
 
 public:
@@ -114,10 +143,10 @@ public:
 
 	virtual bool scatter(
 		const ray& inRay, const point3& point, const vec3& normal,
-		const bool& isFrontFace, double u, double v, color& attenuation, ray& scattered
+		const bool& isFrontFace, real u, real v, const uvFootprint& footprint, color& attenuation, ray& scattered
 	) const override {
 		scattered = ray(point, randomInUnitSphere(), inRay.getTime());
-		attenuation = albedo->getValue(u, v, point);
+		attenuation = albedo->getFilteredValue(u, v, point, footprint);
 		return true;
 	}
 
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "utils.h"
+#include "material.h"
+#include "texture.h"
+#include "sceneArena.h"
+
+#include <iostream>
+#include <map>
+#include <tuple>
+
+// Materials and solid-color textures owned by a scene. Requests with the same type and
+// parameters return the one instance already made, so scenes that assign a material per object
+// keep one copy of each distinct material. Textured materials are keyed on the texture object.
+// New materials and colors are allocated from the scene's arena.
+class materialPool {
+public:
+	materialPool() {}
+	explicit materialPool(const sceneArena& arena) : m_arena(arena) {}
+
+	shared_ptr<texture> makeSolidColor(const color& c);
+
+	shared_ptr<material> makeLambertian(const color& albedo) { return makeLambertian(makeSolidColor(albedo)); }
+	shared_ptr<material> makeLambertian(shared_ptr<texture> albedo);
+	shared_ptr<material> makeMetal(const color& albedo, real roughness);
+	shared_ptr<material> makeDielectric(real refractionIndex);
+	shared_ptr<material> makeDiffuseLight(const color& emit);
+
+	size_t getMaterialCount() const { return m_materials.size(); }
+	size_t getRequestCount() const { return m_requestCount; }
+
+	void printStatistics(std::ostream& out) const {
+		out << "materialPool: " << m_requestCount << " material requests, " << m_materials.size() << " distinct materials, "
+			<< m_textures.size() << " solid colors\n";
+	}
+
+private:
+	enum class kind { lambertian, metal, dielectric, diffuseLight };
+
+	struct key {
+		kind type;
+		real value[4];
+		const texture* source;
+
+		bool operator<(const key& other) const {
+			return std::tie(type, value[0], value[1], value[2], value[3], source)
+				< std::tie(other.type, other.value[0], other.value[1], other.value[2], other.value[3], other.source);
+		}
+	};
+
+	template <typename Make>
+	shared_ptr<material> find(const key& k, Make make) {
+		m_requestCount++;
+		auto found = m_materials.find(k);
+		if (found != m_materials.end()) return found->second;
+		return m_materials.emplace(k, make()).first->second;
+	}
+
+private:
+	sceneArena m_arena;
+	std::map<key, shared_ptr<material>> m_materials;
+	std::map<std::tuple<real, real, real>, shared_ptr<texture>> m_textures;
+	size_t m_requestCount = 0;
+};
+
+shared_ptr<texture> materialPool::makeSolidColor(const color& c) {
+	auto found = m_textures.find(std::make_tuple(c.x(), c.y(), c.z()));
+	if (found != m_textures.end()) return found->second;
+	return m_textures.emplace(std::make_tuple(c.x(), c.y(), c.z()), m_arena.make<solidColor>(c)).first->second;
+}
+
+shared_ptr<material> materialPool::makeLambertian(shared_ptr<texture> albedo) {
+	return find({ kind::lambertian, { 0, 0, 0, 0 }, albedo.get() }, [&] { return m_arena.make<lambertian>(albedo); });
+}
+
+shared_ptr<material> materialPool::makeMetal(const color& albedo, real roughness) {
+	return find({ kind::metal, { albedo.x(), albedo.y(), albedo.z(), roughness }, nullptr },
+		[&] { return m_arena.make<metal>(albedo, roughness); });
+}
+
+shared_ptr<material> materialPool::makeDielectric(real refractionIndex) {
+	return find({ kind::dielectric, { refractionIndex, 0, 0, 0 }, nullptr },
+		[&] { return m_arena.make<dielectric>(refractionIndex); });
+}
+
+shared_ptr<material> materialPool::makeDiffuseLight(const color& emit) {
+	return find({ kind::diffuseLight, { emit.x(), emit.y(), emit.z(), 0 }, nullptr },
+		[&] { return m_arena.make<diffuseLight>(makeSolidColor(emit)); });
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "utils.h"
+
+#include "hittable.h"
+#include "linearBvh.h"
+#include "bvhBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Vertex attributes as separate arrays (structure of arrays) plus three 32-bit indices per
+// triangle. Normals and texture coordinates are optional; when present there is one per vertex.
+struct meshBuffers {
+	std::vector<real> px, py, pz;
+	std::vector<real> nx, ny, nz;
+	std::vector<real> u, v;
+	std::vector<std::uint32_t> indices;
+
+	size_t getVertexCount() const { return px.size(); }
+	size_t getTriangleCount() const { return indices.size() / 3; }
+	bool hasNormals() const { return !nx.empty() && nx.size() == px.size(); }
+	bool hasUVs() const { return !u.empty() && u.size() == px.size(); }
+
+	std::uint32_t addVertex(const point3& p) {
+		px.push_back(p.x());
+		py.push_back(p.y());
+		pz.push_back(p.z());
+		return static_cast<std::uint32_t>(px.size() - 1);
+	}
+
+	void addNormal(const vec3& n) {
+		nx.push_back(n.x());
+		ny.push_back(n.y());
+		nz.push_back(n.z());
+	}
+
+	void addUV(real s, real t) {
+		u.push_back(s);
+		v.push_back(t);
+	}
+
+	void addTriangle(std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+
+	point3 getPosition(std::uint32_t i) const { return point3(px[i], py[i], pz[i]); }
+
+	// FNV-1a over every array, a word at a time; tells the geometry of two files apart.
+	std::uint64_t getContentHash() const;
+
+	size_t getByteSize() const {
+		return (px.capacity() + py.capacity() + pz.capacity() + nx.capacity() + ny.capacity() + nz.capacity()
+			+ u.capacity() + v.capacity()) * sizeof(real) + indices.capacity() * sizeof(std::uint32_t);
+	}
+};
+
+std::uint64_t meshBuffers::getContentHash() const {
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	auto mix = [&hash](const void* data, size_t byteCount) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < byteCount; i += sizeof(std::uint64_t)) {
+			std::uint64_t word = 0;
+			std::memcpy(&word, bytes + i, std::min(sizeof(word), byteCount - i));
+			hash = (hash ^ word) * 0x100000001b3ull;
+		}
+		hash = (hash ^ byteCount) * 0x100000001b3ull; // Separates the arrays
+	};
+	for (const std::vector<real>* values : { &px, &py, &pz, &nx, &ny, &nz, &u, &v })
+		mix(values->data(), values->size() * sizeof(real));
+	mix(indices.data(), indices.size() * sizeof(std::uint32_t));
+	return hash;
+}
+
+// Triangle mesh over shared vertex buffers with its own BVH. Triangles are reordered so each
+// leaf is a contiguous run of the index buffer, which leaves no per-triangle objects at all.
+// Traversal only records the distance, triangle and barycentrics of the closest hit; the
+// point, normals and texture coordinates are interpolated in fillAttributes.
+class indexedMesh : public hittable {
+public:
+	indexedMesh(meshBuffers buffers, shared_ptr<material> material, int maxLeafSize = 4);
+
+	// Restores a mesh saved with its tree, buffers already in leaf order.
+	indexedMesh(meshBuffers buffers, std::vector<linearBvh::linearNode> nodes, shared_ptr<material> material)
+		: m_buffers(std::move(buffers)), m_material_ptr(material), m_nodes(std::move(nodes)) {}
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	// Keeps the triangle as primitive and its second and third barycentrics in u and v.
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+	virtual void fillAttributes(const ray& r, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		if (m_nodes.empty()) return false;
+		outputBox = m_nodes[0].box;
+		return true;
+	}
+
+	const meshBuffers& getBuffers() const { return m_buffers; }
+	const std::vector<linearBvh::linearNode>& getNodes() const { return m_nodes; }
+	const shared_ptr<material>& getMaterial() const { return m_material_ptr; }
+	size_t getByteSize() const { return m_buffers.getByteSize() + m_nodes.capacity() * sizeof(linearBvh::linearNode); }
+
+private:
+	// Ray transformed for the watertight test: the largest direction axis becomes z, and the
+	// shear maps the direction onto +z, so every triangle is tested in the same 2D frame.
+	struct shearedRay {
+		point3 origin;
+		int kx, ky, kz;
+		real sx, sy, sz;
+	};
+
+	static shearedRay prepareRay(const ray& r);
+	bool intersectTriangle(const shearedRay& sr, std::uint32_t triangle, real tMin, real tMax, real& t, real b[3]) const;
+	std::uint32_t flatten(const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<std::uint32_t>& sourceIndices);
+
+private:
+	meshBuffers m_buffers;
+	shared_ptr<material> m_material_ptr;
+	std::vector<linearBvh::linearNode> m_nodes;
+};
+
+indexedMesh::indexedMesh(meshBuffers buffers, shared_ptr<material> material, int maxLeafSize)
+	: m_buffers(std::move(buffers)), m_material_ptr(material) {
+
+	const size_t triangleCount = m_buffers.getTriangleCount();
+	if (triangleCount == 0) return;
+
+	std::vector<aabb> bounds(triangleCount);
+	for (size_t i = 0; i < triangleCount; i++) {
+		const std::uint32_t* tri = &m_buffers.indices[3 * i];
+		point3 p0 = m_buffers.getPosition(tri[0]), p1 = m_buffers.getPosition(tri[1]), p2 = m_buffers.getPosition(tri[2]);
+		aabb box(p0, p0);
+		growBox(box, aabb(p1, p1));
+		growBox(box, aabb(p2, p2));
+
+		// Axis-aligned triangles have flat boxes, which the slab test never enters.
+		vec3 extent = box.getMax() - box.getMin();
+		real pad = std::max(real(1e-4) * std::max(extent.x(), std::max(extent.y(), extent.z())), real(1e-6));
+		for (int a = 0; a < 3; a++) {
+			if (extent[a] > 0) continue;
+			box.m_min[a] -= pad;
+			box.m_max[a] += pad;
+		}
+		bounds[i] = box;
+	}
+
+	bvhBuilder builder(std::move(bounds), std::min(maxLeafSize, 0xffff));
+	builder.build();
+
+	std::vector<std::uint32_t> sourceIndices;
+	sourceIndices.swap(m_buffers.indices);
+	m_buffers.indices.reserve(sourceIndices.size());
+	m_nodes.reserve(builder.getNodeCount());
+	flatten(builder, builder.getRoot(), sourceIndices);
+
+	std::cerr << "indexedMesh: " << triangleCount << " triangles, " << m_buffers.getVertexCount() << " vertices, "
+		<< m_nodes.size() << " nodes built in " << builder.getBuildMilliseconds() << " ms, "
+		<< getByteSize() / (1024.0 * 1024.0) << " MB\n";
+}
+
+// Same depth-first layout as linearBvh, but leaves index the reordered triangles directly.
+std::uint32_t indexedMesh::flatten(
+	const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<std::uint32_t>& sourceIndices
+) {
+	const bvhBuildNode& node = builder.getNode(nodeIndex);
+	std::uint32_t flatIndex = static_cast<std::uint32_t>(m_nodes.size());
+	m_nodes.push_back({ node.box, 0, static_cast<std::uint16_t>(node.count), node.axis });
+
+	if (node.count > 0) {
+		m_nodes[flatIndex].offset = static_cast<std::uint32_t>(m_buffers.indices.size() / 3);
+		for (std::uint32_t i = node.start; i < node.start + node.count; i++) {
+			const std::uint32_t* tri = &sourceIndices[3 * size_t(builder.getPrimitive(i))];
+			m_buffers.addTriangle(tri[0], tri[1], tri[2]);
+		}
+	} else {
+		flatten(builder, node.firstChild, sourceIndices);
+		std::uint32_t second = flatten(builder, node.firstChild + 1, sourceIndices);
+		m_nodes[flatIndex].offset = second;
+	}
+
+	return flatIndex;
+}
+
+indexedMesh::shearedRay indexedMesh::prepareRay(const ray& r) {
+	shearedRay sr;
+	sr.origin = r.getOrigin();
+
+	const vec3 d = r.getDirection();
+	vec3 absD(std::fabs(d.x()), std::fabs(d.y()), std::fabs(d.z()));
+	sr.kz = absD.x() > absD.y() ? (absD.x() > absD.z() ? 0 : 2) : (absD.y() > absD.z() ? 1 : 2);
+	sr.kx = (sr.kz + 1) % 3;
+	sr.ky = (sr.kx + 1) % 3;
+
+	sr.sx = -d[sr.kx] / d[sr.kz];
+	sr.sy = -d[sr.ky] / d[sr.kz];
+	sr.sz = 1 / d[sr.kz];
+	return sr;
+}
+
+// Watertight ray/triangle test of Woop, Benthin and Wald (JCGT 2013), as in pbrt-v3: edge
+// functions are evaluated in the sheared ray frame, so a ray through a shared edge or vertex
+// hits at least one of the adjacent triangles.
+bool indexedMesh::intersectTriangle(
+	const shearedRay& sr, std::uint32_t triangle, real tMin, real tMax, real& t, real b[3]
+) const {
+	const std::uint32_t* tri = &m_buffers.indices[3 * size_t(triangle)];
+	vec3 p0 = m_buffers.getPosition(tri[0]) - sr.origin;
+	vec3 p1 = m_buffers.getPosition(tri[1]) - sr.origin;
+	vec3 p2 = m_buffers.getPosition(tri[2]) - sr.origin;
+
+	real x0 = p0[sr.kx] + sr.sx * p0[sr.kz], y0 = p0[sr.ky] + sr.sy * p0[sr.kz];
+	real x1 = p1[sr.kx] + sr.sx * p1[sr.kz], y1 = p1[sr.ky] + sr.sy * p1[sr.kz];
+	real x2 = p2[sr.kx] + sr.sx * p2[sr.kz], y2 = p2[sr.ky] + sr.sy * p2[sr.kz];
+
+	real e0 = x1 * y2 - y1 * x2;
+	real e1 = x2 * y0 - y2 * x0;
+	real e2 = x0 * y1 - y0 * x1;
+
+	// In float, an edge function of exactly zero is resolved again in double.
+	if (sizeof(real) < sizeof(double) && (e0 == 0 || e1 == 0 || e2 == 0)) {
+		e0 = real(double(x1) * double(y2) - double(y1) * double(x2));
+		e1 = real(double(x2) * double(y0) - double(y2) * double(x0));
+		e2 = real(double(x0) * double(y1) - double(y0) * double(x1));
+	}
+
+	if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0)) return false;
+	real det = e0 + e1 + e2;
+	if (det == 0) return false;
+
+	// Distance scaled by det, compared against the range without dividing first.
+	real tScaled = (e0 * p0[sr.kz] + e1 * p1[sr.kz] + e2 * p2[sr.kz]) * sr.sz;
+	if (det < 0 && (tScaled > tMin * det || tScaled < tMax * det)) return false;
+	if (det > 0 && (tScaled < tMin * det || tScaled > tMax * det)) return false;
+
+	real inverseDet = 1 / det;
+	t = tScaled * inverseDet;
+	b[0] = e0 * inverseDet;
+	b[1] = e1 * inverseDet;
+	b[2] = e2 * inverseDet;
+	return true;
+}
+
+bool indexedMesh::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	if (m_nodes.empty()) return false;
+
+	const shearedRay sr = prepareRay(r);
+	const vec3 direction = r.getDirection();
+	const vec3 inverseDirection(1 / direction.x(), 1 / direction.y(), 1 / direction.z());
+	const bool directionIsNegative[3] = { direction.x() < 0, direction.y() < 0, direction.z() < 0 };
+
+	std::uint32_t stack[bvhBuilder::s_maxDepth];
+	int stackSize = 0;
+	std::uint32_t current = 0;
+
+	std::uint32_t closest = 0;
+	real closestB[3] = {};
+	bool hasHit = false;
+
+	while (true) {
+		const linearBvh::linearNode& node = m_nodes[current];
+
+		if (node.box.hit(r, inverseDirection, tMin, tMax)) {
+			if (node.count > 0) {
+				for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+					real t, b[3];
+					if (intersectTriangle(sr, i, tMin, tMax, t, b)) {
+						hasHit = true;
+						tMax = t;
+						closest = i;
+						std::copy(b, b + 3, closestB);
+					}
+				}
+			} else if (directionIsNegative[node.axis]) {
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) break;
+		current = stack[--stackSize];
+	}
+
+	if (!hasHit) return false;
+
+	record.t = tMax;
+	record.object = this;
+	record.primitive = closest;
+	record.u = closestB[1];
+	record.v = closestB[2];
+	return true;
+}
+
+void indexedMesh::fillAttributes(const ray& r, hitRecord& record) const {
+	const real closestB[3] = { 1 - record.u - record.v, record.u, record.v };
+	const std::uint32_t* tri = &m_buffers.indices[3 * size_t(record.primitive)];
+	const point3 p0 = m_buffers.getPosition(tri[0]);
+	const point3 p1 = m_buffers.getPosition(tri[1]);
+	const point3 p2 = m_buffers.getPosition(tri[2]);
+
+	record.point = closestB[0] * p0 + closestB[1] * p1 + closestB[2] * p2;
+
+	vec3 normal = unitVector(cross(p1 - p0, p2 - p0));
+	if (m_buffers.hasNormals()) {
+		vec3 shading(0, 0, 0);
+		for (int k = 0; k < 3; k++) {
+			std::uint32_t i = tri[k];
+			shading += closestB[k] * vec3(m_buffers.nx[i], m_buffers.ny[i], m_buffers.nz[i]);
+		}
+		// The vertex normals decide which side is outside; file windings are often inconsistent.
+		if (shading.lengthSquared() > 0) normal = unitVector(shading);
+	}
+	record.setFaceNormal(r, normal);
+
+	// Without texture coordinates the barycentrics already in u and v stay.
+	record.dpdu = p1 - p0;
+	record.dpdv = p2 - p0;
+	if (m_buffers.hasUVs()) {
+		record.u = closestB[0] * m_buffers.u[tri[0]] + closestB[1] * m_buffers.u[tri[1]] + closestB[2] * m_buffers.u[tri[2]];
+		record.v = closestB[0] * m_buffers.v[tri[0]] + closestB[1] * m_buffers.v[tri[1]] + closestB[2] * m_buffers.v[tri[2]];
+
+		const real du02 = m_buffers.u[tri[0]] - m_buffers.u[tri[2]], dv02 = m_buffers.v[tri[0]] - m_buffers.v[tri[2]];
+		const real du12 = m_buffers.u[tri[1]] - m_buffers.u[tri[2]], dv12 = m_buffers.v[tri[1]] - m_buffers.v[tri[2]];
+		const real determinant = du02 * dv12 - dv02 * du12;
+		if (std::fabs(determinant) > real(1e-12)) {
+			record.dpdu = (dv12 * (p0 - p2) - dv02 * (p1 - p2)) / determinant;
+			record.dpdv = (du02 * (p1 - p2) - du12 * (p0 - p2)) / determinant;
+		} else {
+			record.dpdu = record.dpdv = vec3(0, 0, 0);
+		}
+	}
+
+	record.material_ptr = m_material_ptr.get();
+}
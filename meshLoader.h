@@ -0,0 +1,689 @@
+#pragma once
+
+#include "utils.h"
+
+#include "mesh.h"
+#include "mappedFile.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory-mapped OBJ and binary PLY readers that parse straight into meshBuffers. The file is
+// cut into chunks that are parsed on a thread pool; numbers are read in place from the mapped
+// bytes, so no line is ever copied into a std::string.
+namespace meshLoaderDetail {
+	const std::uint32_t noIndex = 0xffffffffu;
+
+	inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char* skipBlanks(const char* p, const char* end) {
+		while (p < end && isBlank(*p)) p++;
+		return p;
+	}
+
+	inline const char* nextLine(const char* p, const char* end) {
+		const void* newline = std::memchr(p, '\n', size_t(end - p));
+		return newline ? static_cast<const char*>(newline) + 1 : end;
+	}
+
+	inline bool parseInteger(const char*& p, const char* end, long long& value) {
+		bool negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+')) p++;
+		if (p >= end || *p < '0' || *p > '9') return false;
+
+		value = 0;
+		while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+		if (negative) value = -value;
+		return true;
+	}
+
+	// Decimal number with optional fraction and exponent. Mantissa digits beyond 19 are dropped,
+	// far below the precision of either scalar type.
+	inline bool parseNumber(const char*& p, const char* end, real& value) {
+		static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		bool negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+')) p++;
+
+		std::uint64_t mantissa = 0;
+		int exponent = 0, digits = 0;
+		bool any = false;
+		for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+			if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; }
+			else exponent++;
+		}
+		if (p < end && *p == '.') {
+			for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+				if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); exponent--; if (mantissa) digits++; }
+			}
+		}
+		if (!any) return false;
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			long long e = 0;
+			const char* start = ++p;
+			if (parseInteger(p, end, e)) exponent += static_cast<int>(std::max(-400LL, std::min(400LL, e)));
+			else p = start - 1;
+		}
+
+		double result = double(mantissa);
+		while (exponent > 22) { result *= 1e22; exponent -= 22; }
+		while (exponent < -22) { result /= 1e22; exponent += 22; }
+		result = exponent >= 0 ? result * powersOfTen[exponent] : result / powersOfTen[-exponent];
+
+		value = real(negative ? -result : result);
+		return true;
+	}
+
+	// Splits [begin, end) into about pieces ranges that start at line beginnings.
+	inline std::vector<const char*> splitAtLines(const char* begin, const char* end, size_t pieces) {
+		std::vector<const char*> bounds = { begin };
+		const size_t step = std::max<size_t>(size_t(end - begin) / std::max<size_t>(pieces, 1), 1);
+
+		for (const char* p = begin + step; p < end; p += step) {
+			p = nextLine(p, end);
+			if (p >= end || p <= bounds.back()) break;
+			bounds.push_back(p);
+		}
+
+		bounds.push_back(end);
+		return bounds;
+	}
+
+	struct objCounts {
+		size_t positions = 0, uvs = 0, normals = 0, triangles = 0;
+	};
+
+	// Line keyword: 1 = v, 2 = vt, 3 = vn, 4 = f, 0 = anything else.
+	inline int objKeyword(const char*& p, const char* end) {
+		p = skipBlanks(p, end);
+		if (p + 1 >= end) return 0;
+		if (p[0] == 'f' && isBlank(p[1])) { p += 2; return 4; }
+		if (p[0] != 'v') return 0;
+		if (isBlank(p[1])) { p += 2; return 1; }
+		if (p + 2 < end && isBlank(p[2])) {
+			if (p[1] == 't') { p += 3; return 2; }
+			if (p[1] == 'n') { p += 3; return 3; }
+		}
+		return 0;
+	}
+
+	inline objCounts countOBJ(const char* p, const char* end) {
+		objCounts counts;
+
+		while (p < end) {
+			const char* lineEnd = nextLine(p, end);
+			switch (objKeyword(p, end)) {
+			case 1: counts.positions++; break;
+			case 2: counts.uvs++; break;
+			case 3: counts.normals++; break;
+			case 4: {
+				int corners = 0;
+				while (true) {
+					p = skipBlanks(p, lineEnd);
+					if (p >= lineEnd || *p == '\n' || *p == '#') break;
+					corners++;
+					while (p < lineEnd && !isBlank(*p) && *p != '\n') p++;
+				}
+				if (corners >= 3) counts.triangles += corners - 2;
+				break;
+			}
+			default: break;
+			}
+			p = lineEnd;
+		}
+
+		return counts;
+	}
+
+	// Resolves a 1-based or negative (relative) OBJ index against the count defined so far.
+	inline std::uint32_t objIndex(long long index, size_t definedSoFar) {
+		if (index > 0) return static_cast<std::uint32_t>(index - 1);
+		if (index < 0) return static_cast<std::uint32_t>(static_cast<long long>(definedSoFar) + index);
+		return noIndex;
+	}
+
+	// A face corner's position, texture coordinate and normal, noIndex where it gave none.
+	struct objCorner {
+		std::uint32_t v, vt, vn;
+		bool operator==(const objCorner& other) const { return v == other.v && vt == other.vt && vn == other.vn; }
+	};
+
+	struct objCornerHash {
+		size_t operator()(const objCorner& corner) const {
+			std::uint64_t h = ((std::uint64_t(corner.v) << 32) | corner.vt) * 0x9e3779b97f4a7c15ull;
+			h ^= (h >> 29) + corner.vn * 0xbf58476d1ce4e5b9ull;
+			return static_cast<size_t>(h ^ (h >> 32));
+		}
+	};
+}
+
+// Loads an OBJ file's triangles, triangulating polygons as fans. Positions are the mesh vertices,
+// and every further (v, vt, vn) combination a face corner names becomes a vertex of its own,
+// since one index buffer cannot give a position several normals or texture coordinates, as
+// hard edges and texture seams do.
+// fileSize receives the size of the mapped file.
+inline bool loadOBJ(const std::string& path, meshBuffers& mesh, size_t& fileSize, unsigned threadCount = threadPool::defaultThreadCount()) {
+	using namespace meshLoaderDetail;
+
+	mappedFile file(path);
+	if (!file.isOpen()) return false;
+	fileSize = file.getSize();
+
+	std::vector<const char*> bounds = splitAtLines(file.begin(), file.end(), size_t(threadCount) * 4);
+	const size_t chunkCount = bounds.size() - 1;
+
+	// Pass 1: count every chunk's entries, which gives each chunk its output offsets.
+	std::vector<objCounts> counts(chunkCount + 1);
+	threadPool pool(threadCount);
+	for (size_t c = 0; c < chunkCount; c++)
+		pool.submit([&, c] { counts[c + 1] = countOBJ(bounds[c], bounds[c + 1]); });
+	pool.wait();
+
+	for (size_t c = 1; c <= chunkCount; c++) {
+		counts[c].positions += counts[c - 1].positions;
+		counts[c].uvs += counts[c - 1].uvs;
+		counts[c].normals += counts[c - 1].normals;
+		counts[c].triangles += counts[c - 1].triangles;
+	}
+	const objCounts& total = counts[chunkCount];
+
+	// Pass 2: parse into the final arrays. Corner uv/normal references are kept per corner.
+	mesh.px.resize(total.positions);
+	mesh.py.resize(total.positions);
+	mesh.pz.resize(total.positions);
+	mesh.indices.resize(total.triangles * 3);
+
+	std::vector<real> uvs(total.uvs * 2), normals(total.normals * 3);
+	std::vector<std::uint32_t> cornerUVs(total.uvs ? total.triangles * 3 : 0, noIndex);
+	std::vector<std::uint32_t> cornerNormals(total.normals ? total.triangles * 3 : 0, noIndex);
+	std::atomic<size_t> badLines(0);
+	std::vector<size_t> written(chunkCount); // Triangles each chunk wrote; a malformed face writes fewer than counted
+
+	for (size_t c = 0; c < chunkCount; c++) {
+		pool.submit([&, c] {
+			objCounts at = counts[c];
+			size_t bad = 0;
+
+			for (const char* p = bounds[c]; p < bounds[c + 1];) {
+				const char* lineEnd = nextLine(p, bounds[c + 1]);
+				int keyword = objKeyword(p, lineEnd);
+
+				if (keyword == 1 || keyword == 3) {
+					real xyz[3] = {};
+					for (int k = 0; k < 3; k++) {
+						p = skipBlanks(p, lineEnd);
+						if (!parseNumber(p, lineEnd, xyz[k])) bad++;
+					}
+					if (keyword == 1) {
+						mesh.px[at.positions] = xyz[0];
+						mesh.py[at.positions] = xyz[1];
+						mesh.pz[at.positions] = xyz[2];
+						at.positions++;
+					} else {
+						std::copy(xyz, xyz + 3, &normals[3 * at.normals++]);
+					}
+				} else if (keyword == 2) {
+					real st[2] = {};
+					for (int k = 0; k < 2; k++) {
+						p = skipBlanks(p, lineEnd);
+						if (!parseNumber(p, lineEnd, st[k]) && k == 0) bad++;
+					}
+					std::copy(st, st + 2, &uvs[2 * at.uvs++]);
+				} else if (keyword == 4) {
+					std::uint32_t first[3] = {}, previous[3] = {};
+					int corner = 0;
+
+					while (true) {
+						p = skipBlanks(p, lineEnd);
+						if (p >= lineEnd || *p == '\n' || *p == '#') break;
+
+						// v, v/vt, v//vn or v/vt/vn
+						long long v = 0, vt = 0, vn = 0;
+						if (!parseInteger(p, lineEnd, v)) { bad++; break; }
+						if (p < lineEnd && *p == '/') {
+							p++;
+							if (p < lineEnd && *p != '/') parseInteger(p, lineEnd, vt);
+							if (p < lineEnd && *p == '/') { p++; parseInteger(p, lineEnd, vn); }
+						}
+						while (p < lineEnd && !isBlank(*p) && *p != '\n') p++;
+
+						std::uint32_t current[3] = {
+							objIndex(v, at.positions), objIndex(vt, at.uvs), objIndex(vn, at.normals)
+						};
+
+						if (corner >= 2) {
+							size_t t = at.triangles++;
+							const std::uint32_t* corners[3] = { first, previous, current };
+							for (int k = 0; k < 3; k++) {
+								mesh.indices[3 * t + k] = corners[k][0];
+								if (!cornerUVs.empty()) cornerUVs[3 * t + k] = corners[k][1];
+								if (!cornerNormals.empty()) cornerNormals[3 * t + k] = corners[k][2];
+							}
+						}
+
+						if (corner == 0) std::copy(current, current + 3, first);
+						std::copy(current, current + 3, previous);
+						corner++;
+					}
+				}
+
+				p = lineEnd;
+			}
+
+			written[c] = at.triangles - counts[c].triangles;
+			badLines += bad;
+		});
+	}
+	pool.wait();
+
+	if (badLines > 0) std::cerr << "WARNING: " << badLines << " malformed entries in '" << path << "'.\n";
+
+	// Close the gaps left by malformed faces and drop triangles with indices outside the file's
+	// vertices.
+	size_t kept = 0, parsed = 0;
+	for (size_t c = 0; c < chunkCount; c++) {
+		parsed += written[c];
+		for (size_t t = counts[c].triangles; t < counts[c].triangles + written[c]; t++) {
+			const std::uint32_t* tri = &mesh.indices[3 * t];
+			if (tri[0] >= total.positions || tri[1] >= total.positions || tri[2] >= total.positions) continue;
+			for (int k = 0; k < 3; k++) {
+				mesh.indices[3 * kept + k] = tri[k];
+				if (!cornerUVs.empty()) cornerUVs[3 * kept + k] = cornerUVs[3 * t + k];
+				if (!cornerNormals.empty()) cornerNormals[3 * kept + k] = cornerNormals[3 * t + k];
+			}
+			kept++;
+		}
+	}
+	mesh.indices.resize(kept * 3);
+	if (kept < parsed)
+		std::cerr << "WARNING: Dropped " << parsed - kept << " triangles with invalid indices from '" << path << "'.\n";
+
+	if (cornerUVs.empty() && cornerNormals.empty()) return true;
+
+	// The first corner to use a position keeps it as its vertex; corners that name another
+	// texture coordinate or normal for it get vertices appended after the positions, one per
+	// distinct (v, vt, vn). Smooth meshes name one of each per position and append nothing.
+	std::vector<objCorner> firstUse(total.positions, { noIndex, noIndex, noIndex }); // v is noIndex until used
+	std::unordered_map<objCorner, std::uint32_t, objCornerHash> appended;
+	std::vector<objCorner> extra;
+	for (size_t i = 0; i < kept * 3; i++) {
+		objCorner corner = { mesh.indices[i], noIndex, noIndex };
+		if (!cornerUVs.empty() && cornerUVs[i] < total.uvs) corner.vt = cornerUVs[i];
+		if (!cornerNormals.empty() && cornerNormals[i] < total.normals) corner.vn = cornerNormals[i];
+
+		objCorner& first = firstUse[corner.v];
+		if (first.v == noIndex) first = corner;
+		if (first == corner) continue;
+
+		auto found = appended.emplace(corner, static_cast<std::uint32_t>(total.positions + extra.size()));
+		if (found.second) extra.push_back(corner);
+		mesh.indices[i] = found.first->second;
+	}
+
+	// Positions no face uses, and corners without a texture coordinate or normal, get zeros.
+	const size_t vertexCount = total.positions + extra.size();
+	if (!cornerUVs.empty()) {
+		mesh.u.resize(vertexCount, 0);
+		mesh.v.resize(vertexCount, 0);
+	}
+	if (!cornerNormals.empty()) {
+		mesh.nx.resize(vertexCount, 0);
+		mesh.ny.resize(vertexCount, 0);
+		mesh.nz.resize(vertexCount, 0);
+	}
+	auto setAttributes = [&](size_t vertex, const objCorner& corner) {
+		if (corner.vt != noIndex) {
+			mesh.u[vertex] = uvs[2 * size_t(corner.vt)];
+			mesh.v[vertex] = uvs[2 * size_t(corner.vt) + 1];
+		}
+		if (corner.vn != noIndex) {
+			mesh.nx[vertex] = normals[3 * size_t(corner.vn)];
+			mesh.ny[vertex] = normals[3 * size_t(corner.vn) + 1];
+			mesh.nz[vertex] = normals[3 * size_t(corner.vn) + 2];
+		}
+	};
+	for (size_t i = 0; i < total.positions; i++) setAttributes(i, firstUse[i]);
+	for (size_t k = 0; k < extra.size(); k++) {
+		mesh.addVertex(mesh.getPosition(extra[k].v));
+		setAttributes(total.positions + k, extra[k]);
+	}
+
+	return true;
+}
+
+namespace meshLoaderDetail {
+	enum class plyType { none, int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+	inline plyType plyTypeFromName(const std::string& name) {
+		if (name == "char" || name == "int8") return plyType::int8;
+		if (name == "uchar" || name == "uint8") return plyType::uint8;
+		if (name == "short" || name == "int16") return plyType::int16;
+		if (name == "ushort" || name == "uint16") return plyType::uint16;
+		if (name == "int" || name == "int32") return plyType::int32;
+		if (name == "uint" || name == "uint32") return plyType::uint32;
+		if (name == "float" || name == "float32") return plyType::float32;
+		if (name == "double" || name == "float64") return plyType::float64;
+		return plyType::none;
+	}
+
+	inline size_t plyTypeSize(plyType type) {
+		switch (type) {
+		case plyType::int8: case plyType::uint8: return 1;
+		case plyType::int16: case plyType::uint16: return 2;
+		case plyType::int32: case plyType::uint32: case plyType::float32: return 4;
+		case plyType::float64: return 8;
+		default: return 0;
+		}
+	}
+
+	inline double readPlyValue(const char* p, plyType type, bool swapBytes) {
+		unsigned char bytes[8];
+		const size_t size = plyTypeSize(type);
+		std::memcpy(bytes, p, size);
+		if (swapBytes) std::reverse(bytes, bytes + size);
+
+		switch (type) {
+		case plyType::int8:    { std::int8_t x;   std::memcpy(&x, bytes, 1); return x; }
+		case plyType::uint8:   { std::uint8_t x;  std::memcpy(&x, bytes, 1); return x; }
+		case plyType::int16:   { std::int16_t x;  std::memcpy(&x, bytes, 2); return x; }
+		case plyType::uint16:  { std::uint16_t x; std::memcpy(&x, bytes, 2); return x; }
+		case plyType::int32:   { std::int32_t x;  std::memcpy(&x, bytes, 4); return x; }
+		case plyType::uint32:  { std::uint32_t x; std::memcpy(&x, bytes, 4); return x; }
+		case plyType::float32: { float x;         std::memcpy(&x, bytes, 4); return x; }
+		case plyType::float64: { double x;        std::memcpy(&x, bytes, 8); return x; }
+		default: return 0.0;
+		}
+	}
+
+	struct plyProperty {
+		std::string name;
+		plyType type = plyType::none;     // Scalar type, or the item type of a list
+		plyType countType = plyType::none; // Set for list properties
+		size_t offset = 0;                 // Byte offset inside a fixed-size element
+	};
+
+	struct plyElement {
+		std::string name;
+		size_t count = 0;
+		std::vector<plyProperty> properties;
+		size_t stride = 0; // Zero when the element contains lists
+
+		int find(const char* property) const {
+			for (size_t i = 0; i < properties.size(); i++)
+				if (properties[i].name == property) return int(i);
+			return -1;
+		}
+	};
+}
+
+// Loads a binary (either endianness) PLY file. Vertex records have a fixed size, so they are
+// decoded in parallel ranges; faces are triangulated as fans. Every read and skip of the
+// binary body is checked against the end of the mapping first.
+inline bool loadPLY(const std::string& path, meshBuffers& mesh, size_t& fileSize, unsigned threadCount = threadPool::defaultThreadCount()) {
+	using namespace meshLoaderDetail;
+
+	mappedFile file(path);
+	if (!file.isOpen()) return false;
+	fileSize = file.getSize();
+
+	const char* p = file.begin();
+	const char* end = file.end();
+	if (end - p < 4 || std::memcmp(p, "ply", 3) != 0) {
+		std::cerr << "ERROR: '" << path << "' is not a PLY file.\n";
+		return false;
+	}
+
+	// The header is a few short text lines, read with ordinary strings.
+	std::vector<plyElement> elements;
+	bool bigEndian = false, formatKnown = false;
+	while (true) {
+		if (p >= end) {
+			std::cerr << "ERROR: '" << path << "' has no end_header.\n";
+			return false;
+		}
+		const char* lineEnd = nextLine(p, end);
+		std::string line(p, lineEnd);
+		p = lineEnd;
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+
+		std::vector<std::string> words;
+		for (size_t i = 0; i < line.size();) {
+			size_t j = line.find(' ', i);
+			if (j == std::string::npos) j = line.size();
+			if (j > i) words.push_back(line.substr(i, j - i));
+			i = j + 1;
+		}
+		if (words.empty()) continue;
+
+		if (words[0] == "end_header") break;
+		if (words[0] == "format" && words.size() > 1) {
+			if (words[1] == "ascii") {
+				std::cerr << "ERROR: '" << path << "' is an ASCII PLY; only binary PLY files are supported.\n";
+				return false;
+			}
+			bigEndian = words[1] == "binary_big_endian";
+			formatKnown = true;
+		} else if (words[0] == "element" && words.size() > 2) {
+			plyElement element;
+			element.name = words[1];
+			element.count = std::strtoull(words[2].c_str(), nullptr, 10);
+			elements.push_back(element);
+		} else if (words[0] == "property" && !elements.empty()) {
+			plyProperty property;
+			if (words.size() > 4 && words[1] == "list") {
+				property.countType = plyTypeFromName(words[2]);
+				property.type = plyTypeFromName(words[3]);
+				property.name = words[4];
+			} else if (words.size() > 2) {
+				property.type = plyTypeFromName(words[1]);
+				property.name = words[2];
+			}
+			if (property.type == plyType::none) {
+				std::cerr << "ERROR: Unsupported property '" << line << "' in '" << path << "'.\n";
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+	}
+
+	if (!formatKnown) {
+		std::cerr << "ERROR: '" << path << "' has no format line.\n";
+		return false;
+	}
+
+	const std::uint16_t probe = 1;
+	const bool hostIsLittle = *reinterpret_cast<const std::uint8_t*>(&probe) == 1;
+	const bool swap = bigEndian == hostIsLittle;
+
+	for (plyElement& element : elements) {
+		size_t offset = 0;
+		bool fixed = true;
+		for (plyProperty& property : element.properties) {
+			property.offset = offset;
+			if (property.countType != plyType::none) fixed = false;
+			offset += plyTypeSize(property.type);
+		}
+		element.stride = fixed ? offset : 0;
+	}
+
+	threadPool pool(threadCount);
+
+	auto truncated = [&]() {
+		std::cerr << "ERROR: '" << path << "' is truncated.\n";
+		return false;
+	};
+	auto fits = [&](size_t count, size_t size) { return size == 0 || count <= size_t(end - p) / size; };
+
+	// Reads the length in front of a list and moves past it; negative lengths are rejected.
+	auto readListSize = [&](const plyProperty& prop, size_t& items) {
+		if (!fits(1, plyTypeSize(prop.countType))) return truncated();
+		const double value = readPlyValue(p, prop.countType, swap);
+		if (value < 0) {
+			std::cerr << "ERROR: Negative list length in '" << path << "'.\n";
+			return false;
+		}
+		items = static_cast<size_t>(value);
+		p += plyTypeSize(prop.countType);
+		return true;
+	};
+
+	for (const plyElement& element : elements) {
+		if (element.name == "vertex") {
+			if (element.stride == 0 || !fits(element.count, element.stride)) {
+				std::cerr << "ERROR: Vertex data in '" << path << "' is truncated or has lists.\n";
+				return false;
+			}
+
+			int position[3] = { element.find("x"), element.find("y"), element.find("z") };
+			int normal[3] = { element.find("nx"), element.find("ny"), element.find("nz") };
+			int uv[2] = { element.find("u"), element.find("v") };
+			if (uv[0] < 0) { uv[0] = element.find("s"); uv[1] = element.find("t"); }
+			if (uv[0] < 0) { uv[0] = element.find("texture_u"); uv[1] = element.find("texture_v"); }
+
+			if (position[0] < 0 || position[1] < 0 || position[2] < 0) {
+				std::cerr << "ERROR: '" << path << "' has no vertex positions.\n";
+				return false;
+			}
+			const bool hasNormals = normal[0] >= 0 && normal[1] >= 0 && normal[2] >= 0;
+			const bool hasUVs = uv[0] >= 0 && uv[1] >= 0;
+
+			const size_t n = element.count;
+			mesh.px.resize(n); mesh.py.resize(n); mesh.pz.resize(n);
+			if (hasNormals) { mesh.nx.resize(n); mesh.ny.resize(n); mesh.nz.resize(n); }
+			if (hasUVs) { mesh.u.resize(n); mesh.v.resize(n); }
+
+			const char* data = p;
+			auto read = [&](size_t i, int property) {
+				const plyProperty& prop = element.properties[property];
+				return real(readPlyValue(data + i * element.stride + prop.offset, prop.type, swap));
+			};
+
+			const size_t chunkSize = 65536;
+			for (size_t first = 0; first < n; first += chunkSize) {
+				pool.submit([&, first] {
+					for (size_t i = first; i < std::min(first + chunkSize, n); i++) {
+						mesh.px[i] = read(i, position[0]);
+						mesh.py[i] = read(i, position[1]);
+						mesh.pz[i] = read(i, position[2]);
+						if (hasNormals) {
+							mesh.nx[i] = read(i, normal[0]);
+							mesh.ny[i] = read(i, normal[1]);
+							mesh.nz[i] = read(i, normal[2]);
+						}
+						if (hasUVs) {
+							mesh.u[i] = read(i, uv[0]);
+							mesh.v[i] = read(i, uv[1]);
+						}
+					}
+				});
+			}
+			pool.wait();
+
+			p += element.stride * element.count;
+		} else if (element.name == "face") {
+			int list = element.find("vertex_indices");
+			if (list < 0) list = element.find("vertex_index");
+			if (list < 0 || element.properties[list].countType == plyType::none) {
+				std::cerr << "ERROR: '" << path << "' has no face index lists.\n";
+				return false;
+			}
+
+			mesh.indices.reserve(element.count * 3);
+			for (size_t f = 0; f < element.count; f++) {
+				for (size_t k = 0; k < element.properties.size(); k++) {
+					const plyProperty& prop = element.properties[k];
+					const size_t itemSize = plyTypeSize(prop.type);
+
+					if (prop.countType == plyType::none) {
+						if (!fits(1, itemSize)) return truncated();
+						p += itemSize;
+						continue;
+					}
+
+					size_t corners = 0;
+					if (!readListSize(prop, corners)) return false;
+					if (!fits(corners, itemSize)) return truncated();
+
+					if (int(k) == list) {
+						auto index = [&](size_t c) {
+							const double value = readPlyValue(p + c * itemSize, prop.type, swap);
+							return value >= 0 && value < double(noIndex) ? static_cast<std::uint32_t>(value) : noIndex;
+						};
+						for (size_t c = 2; c < corners; c++) mesh.addTriangle(index(0), index(c - 1), index(c));
+					}
+					p += corners * itemSize;
+				}
+			}
+		} else if (element.stride > 0) {
+			if (!fits(element.count, element.stride)) return truncated();
+			p += element.stride * element.count; // Unused fixed-size element
+		} else {
+			// Unused element with lists: walk it record by record.
+			for (size_t e = 0; e < element.count; e++) {
+				for (const plyProperty& prop : element.properties) {
+					if (prop.countType != plyType::none) {
+						size_t items = 0;
+						if (!readListSize(prop, items)) return false;
+						if (!fits(items, plyTypeSize(prop.type))) return truncated();
+						p += items * plyTypeSize(prop.type);
+					} else {
+						if (!fits(1, plyTypeSize(prop.type))) return truncated();
+						p += plyTypeSize(prop.type);
+					}
+				}
+			}
+		}
+	}
+
+	// Drop triangles with indices outside the vertex list.
+	const std::uint32_t vertexCount = static_cast<std::uint32_t>(mesh.getVertexCount());
+	size_t kept = 0;
+	for (size_t t = 0; t < mesh.getTriangleCount(); t++) {
+		const std::uint32_t* tri = &mesh.indices[3 * t];
+		if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount) continue;
+		for (int k = 0; k < 3; k++) mesh.indices[3 * kept + k] = tri[k];
+		kept++;
+	}
+	if (kept < mesh.getTriangleCount())
+		std::cerr << "WARNING: Dropped " << mesh.getTriangleCount() - kept << " triangles with invalid indices from '" << path << "'.\n";
+	mesh.indices.resize(kept * 3);
+
+	return true;
+}
+
+// Loads an .obj or .ply file by extension and reports the parse throughput.
+inline bool loadMesh(const std::string& path, meshBuffers& mesh, unsigned threadCount = threadPool::defaultThreadCount()) {
+	auto startTime = std::chrono::steady_clock::now();
+
+	std::string extension = path.substr(path.find_last_of('.') == std::string::npos ? path.size() : path.find_last_of('.'));
+	for (char& c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+	bool ok;
+	size_t fileSize = 0;
+	if (extension == ".obj") ok = loadOBJ(path, mesh, fileSize, threadCount);
+	else if (extension == ".ply") ok = loadPLY(path, mesh, fileSize, threadCount);
+	else {
+		std::cerr << "ERROR: Unknown mesh format '" << path << "', expected .obj or .ply.\n";
+		return false;
+	}
+	if (!ok) return false;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	const double megabytes = fileSize / (1024.0 * 1024.0);
+
+	std::cerr << "Loaded '" << path << "': " << mesh.getVertexCount() << " vertices, " << mesh.getTriangleCount()
+		<< " triangles, " << megabytes << " MB in " << seconds * 1000.0 << " ms ("
+		<< (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s)\n";
+	return true;
+}
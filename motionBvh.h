@@ -0,0 +1,312 @@
+#pragma once
+
+#include "utils.h"
+
+#include "hittable.h"
+#include "hittableList.h"
+#include "bvhBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// BVH for moving geometry. Every node stores its bounds at the start and at the end of its time
+// range, and traversal tests the box interpolated to the ray's time, which encloses linearly
+// moving primitives at that time instead of over the whole shutter. Long motions, where the
+// children of a node drift apart and the interpolated boxes grow loose, can be split into time
+// segments with a separate tree each; a ray only visits the tree of the segment it falls in.
+// Segments cost a tree each in build time and memory, and rays at different times walk
+// different trees, so they are only used when they lower the SAH cost by more than that.
+class motionBvh : public hittable {
+public:
+	motionBvh() {}
+
+	// Zero segments builds one tree over the shutter and doubles the segments only while the SAH
+	// cost of the segmented trees, each at its mean ray time, beats the fewer trees before them.
+	motionBvh(const hittableList& entities, real startTime, real endTime, int timeSegments = 0, int maxLeafSize = 4);
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override;
+
+	size_t getSegmentCount() const { return m_segments.size(); }
+
+public:
+	struct motionNode {
+		aabb startBox;
+		aabb endBox;
+		std::uint32_t offset; // Leaf: first primitive, interior: index of the second child
+		std::uint16_t count;  // Primitives in a leaf, zero for interior nodes
+		std::uint8_t axis;    // Split axis of an interior node
+	};
+
+	struct segment {
+		real startTime;
+		real endTime;
+		std::vector<motionNode> nodes;
+		std::vector<shared_ptr<hittable>> primitives; // Reordered so every leaf is a contiguous run
+	};
+
+	std::vector<segment> m_segments;
+	real m_startTime = 0;
+	real m_endTime = 1;
+
+private:
+	// Slab test against the node's box interpolated to fraction of its segment.
+	static bool hitNodeAt(
+		const motionNode& node, real fraction, const point3& origin, const vec3& inverseDirection, real tMin, real tMax
+	) {
+		const real remaining = 1 - fraction;
+		for (int a = 0; a < 3; a++) {
+			real low = remaining * node.startBox.m_min[a] + fraction * node.endBox.m_min[a];
+			real high = remaining * node.startBox.m_max[a] + fraction * node.endBox.m_max[a];
+			real tClose = (low - origin[a]) * inverseDirection[a];
+			real tFar = (high - origin[a]) * inverseDirection[a];
+			if (inverseDirection[a] < 0) std::swap(tClose, tFar);
+			tMin = tClose > tMin ? tClose : tMin;
+			tMax = tFar < tMax ? tFar : tMax;
+			if (tMax <= tMin) return false;
+		}
+		return true;
+	}
+
+	// Surface area of the box interpolated halfway between two boxes.
+	static double middleArea(const aabb& startBox, const aabb& endBox) {
+		return surfaceArea(aabb(real(0.5) * (startBox.m_min + endBox.m_min), real(0.5) * (startBox.m_max + endBox.m_max)));
+	}
+
+	// Node visits plus primitive tests, like bvhBuilder's SAH.
+	static double nodeCost(const motionNode& node) { return bvhBuilder::s_traversalCost + node.count; }
+
+	// SAH cost of a ray at a uniform time in the shutter, with every tree's boxes taken at the
+	// middle of its segment, the mean time of its rays. Relative to a fixed area so trees of
+	// different segment counts compare.
+	static double getSahCost(const std::vector<segment>& segments, double referenceArea);
+
+	// Cost of count segments, estimated by refitting the single tree in m_segments to each
+	// segment's endpoints. Rebuilt trees do at least about as well, so this only rules out
+	// motions too short to pay for any segments without building them.
+	double estimateSegmentedCost(int count, double referenceArea) const;
+
+	// Trace time the SAH does not see: each doubling of the segments measured about a quarter
+	// slower than its cost predicts, from rays of neighbouring times using different trees.
+	static double segmentPenalty(int count) { return 1.0 + 0.25 * std::log2(double(count)); }
+
+	void buildCheapestSegments(const std::vector<shared_ptr<hittable>>& objects, int maxLeafSize);
+
+	void buildSegments(const std::vector<shared_ptr<hittable>>& objects, int count, int maxLeafSize);
+	void buildSegment(segment& part, const std::vector<shared_ptr<hittable>>& objects, int maxLeafSize);
+
+	std::uint32_t flatten(
+		segment& part, const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects,
+		const std::vector<aabb>& startBounds, const std::vector<aabb>& endBounds
+	);
+};
+
+double motionBvh::getSahCost(const std::vector<segment>& segments, double referenceArea) {
+	double cost = 0.0;
+	for (const segment& part : segments) {
+		for (const motionNode& node : part.nodes) cost += middleArea(node.startBox, node.endBox) * nodeCost(node);
+	}
+	return cost / (segments.size() * referenceArea);
+}
+
+double motionBvh::estimateSegmentedCost(int count, double referenceArea) const {
+	const segment& single = m_segments[0];
+	std::vector<aabb> previous, current(single.nodes.size());
+	double cost = 0.0;
+
+	for (int s = 0; s <= count; s++) {
+		const real time = m_startTime + (m_endTime - m_startTime) * s / count;
+		const std::vector<aabb> bounds = gatherBounds(single.primitives, 0, single.primitives.size(), time, time);
+
+		// Children follow their parent, so a backwards pass sees them first.
+		for (size_t i = single.nodes.size(); i-- > 0;) {
+			const motionNode& node = single.nodes[i];
+			if (node.count > 0) {
+				current[i] = bounds[node.offset];
+				for (std::uint32_t p = node.offset + 1; p < node.offset + node.count; p++) growBox(current[i], bounds[p]);
+			} else {
+				current[i] = aabb::surroundingBox(current[i + 1], current[node.offset]);
+			}
+		}
+
+		if (s > 0) {
+			for (size_t i = 0; i < single.nodes.size(); i++) cost += middleArea(previous[i], current[i]) * nodeCost(single.nodes[i]);
+		}
+		std::swap(previous, current);
+		current.resize(single.nodes.size());
+	}
+
+	return cost / (count * referenceArea);
+}
+
+void motionBvh::buildCheapestSegments(const std::vector<shared_ptr<hittable>>& objects, int maxLeafSize) {
+	const int maxSegments = 8;
+
+	buildSegments(objects, 1, maxLeafSize);
+	const motionNode& root = m_segments[0].nodes[0];
+	const double referenceArea = std::max(surfaceArea(aabb::surroundingBox(root.startBox, root.endBox)), 1e-300);
+
+	double bestCost = getSahCost(m_segments, referenceArea);
+	if (estimateSegmentedCost(2, referenceArea) * segmentPenalty(2) >= bestCost) return;
+
+	std::vector<segment> best = std::move(m_segments);
+	for (int count = 2; count <= maxSegments; count *= 2) {
+		buildSegments(objects, count, maxLeafSize);
+		const double cost = getSahCost(m_segments, referenceArea) * segmentPenalty(count);
+		if (cost >= bestCost) break;
+		best = std::move(m_segments);
+		bestCost = cost;
+	}
+	m_segments = std::move(best);
+}
+
+motionBvh::motionBvh(const hittableList& entities, real startTime, real endTime, int timeSegments, int maxLeafSize)
+	: m_startTime(startTime), m_endTime(endTime) {
+	const std::vector<shared_ptr<hittable>>& objects = entities.m_objects;
+	if (objects.empty()) return;
+
+	auto buildStart = std::chrono::steady_clock::now();
+	if (timeSegments > 0) buildSegments(objects, timeSegments, maxLeafSize);
+	else buildCheapestSegments(objects, maxLeafSize);
+
+	size_t nodeCount = 0;
+	for (const segment& part : m_segments) nodeCount += part.nodes.size();
+
+	std::cerr << "motionBvh: " << objects.size() << " objects, " << m_segments.size() << " time segments, " << nodeCount
+		<< " nodes built in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count()
+		<< " ms\n";
+}
+
+void motionBvh::buildSegments(const std::vector<shared_ptr<hittable>>& objects, int count, int maxLeafSize) {
+	m_segments.clear();
+	m_segments.resize(count);
+	for (int s = 0; s < count; s++) {
+		segment& part = m_segments[s];
+		part.startTime = m_startTime + (m_endTime - m_startTime) * s / count;
+		part.endTime = m_startTime + (m_endTime - m_startTime) * (s + 1) / count;
+		buildSegment(part, objects, maxLeafSize);
+	}
+}
+
+// The split search runs on the boxes at the middle of the segment; the stored node bounds
+// come from the endpoint boxes afterwards.
+void motionBvh::buildSegment(segment& part, const std::vector<shared_ptr<hittable>>& objects, int maxLeafSize) {
+	const real middle = real(0.5) * (part.startTime + part.endTime);
+
+	std::vector<aabb> startBounds = gatherBounds(objects, 0, objects.size(), part.startTime, part.startTime);
+	std::vector<aabb> endBounds = gatherBounds(objects, 0, objects.size(), part.endTime, part.endTime);
+	std::vector<aabb> middleBounds = gatherBounds(objects, 0, objects.size(), middle, middle);
+
+	bvhBuilder builder(std::move(middleBounds), std::min(maxLeafSize, 0xffff));
+	builder.build();
+
+	part.nodes.reserve(builder.getNodeCount());
+	part.primitives.reserve(objects.size());
+	flatten(part, builder, builder.getRoot(), objects, startBounds, endBounds);
+}
+
+std::uint32_t motionBvh::flatten(
+	segment& part, const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects,
+	const std::vector<aabb>& startBounds, const std::vector<aabb>& endBounds
+) {
+	const bvhBuildNode& node = builder.getNode(nodeIndex);
+	std::uint32_t flatIndex = static_cast<std::uint32_t>(part.nodes.size());
+	part.nodes.push_back({ aabb(), aabb(), 0, static_cast<std::uint16_t>(node.count), node.axis });
+
+	aabb startBox, endBox;
+	if (node.count > 0) {
+		part.nodes[flatIndex].offset = static_cast<std::uint32_t>(part.primitives.size());
+		for (std::uint32_t i = node.start; i < node.start + node.count; i++) {
+			std::uint32_t primitive = builder.getPrimitive(i);
+			part.primitives.push_back(objects[primitive]);
+
+			if (i == node.start) {
+				startBox = startBounds[primitive];
+				endBox = endBounds[primitive];
+			} else {
+				growBox(startBox, startBounds[primitive]);
+				growBox(endBox, endBounds[primitive]);
+			}
+		}
+	} else {
+		std::uint32_t first = flatten(part, builder, node.firstChild, objects, startBounds, endBounds);
+		std::uint32_t second = flatten(part, builder, node.firstChild + 1, objects, startBounds, endBounds);
+		part.nodes[flatIndex].offset = second;
+
+		startBox = part.nodes[first].startBox;
+		endBox = part.nodes[first].endBox;
+		growBox(startBox, part.nodes[second].startBox);
+		growBox(endBox, part.nodes[second].endBox);
+	}
+
+	part.nodes[flatIndex].startBox = startBox;
+	part.nodes[flatIndex].endBox = endBox;
+	return flatIndex;
+}
+
+bool motionBvh::getAABB(real startTime, real endTime, aabb& outputBox) const {
+	if (m_segments.empty()) return false;
+
+	outputBox = aabb::surroundingBox(m_segments[0].nodes[0].startBox, m_segments[0].nodes[0].endBox);
+	for (const segment& part : m_segments) {
+		growBox(outputBox, part.nodes[0].startBox);
+		growBox(outputBox, part.nodes[0].endBox);
+	}
+	return true;
+}
+
+bool motionBvh::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	if (m_segments.empty()) return false;
+
+	const real time = std::clamp(r.getTime(), m_startTime, m_endTime);
+	const size_t segmentIndex = std::min(m_segments.size() - 1,
+		static_cast<size_t>((time - m_startTime) / (m_endTime - m_startTime) * m_segments.size()));
+	const segment& part = m_segments[segmentIndex];
+	const real fraction = std::clamp((time - part.startTime) / (part.endTime - part.startTime), real(0), real(1));
+
+	const point3 origin = r.getOrigin();
+	const vec3 direction = r.getDirection();
+	const vec3 inverseDirection(1.0 / direction.x(), 1.0 / direction.y(), 1.0 / direction.z());
+	const bool directionIsNegative[3] = { direction.x() < 0.0, direction.y() < 0.0, direction.z() < 0.0 };
+
+	std::uint32_t stack[bvhBuilder::s_maxDepth];
+	int stackSize = 0;
+	std::uint32_t current = 0;
+	bool hasHit = false;
+
+	while (true) {
+		const motionNode& node = part.nodes[current];
+
+		if (hitNodeAt(node, fraction, origin, inverseDirection, tMin, tMax)) {
+			if (node.count > 0) {
+				for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+					if (part.primitives[i]->intersect(r, tMin, tMax, record)) {
+						hasHit = true;
+						tMax = record.t;
+					}
+				}
+			} else if (directionIsNegative[node.axis]) {
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) break;
+		current = stack[--stackSize];
+	}
+
+	return hasHit;
+}
@@ -7,57 +7,50 @@
 class movingSphere : public sphere {
 public:
 	movingSphere() : m_startCenter(), m_endCenter(), m_startTime(0.0), m_endTime(0.0), m_radius(0.0), m_mat_ptr(nullptr) {}
-	movingSphere(point3 startCenter, point3 endCenter, double startTime, double endTime, double radius, shared_ptr<material> mat)
+	movingSphere(point3 startCenter, point3 endCenter, real startTime, real endTime, real radius, shared_ptr<material> mat)
 		: m_startCenter(startCenter), m_endCenter(endCenter), m_startTime(startTime), m_endTime(endTime), m_radius(radius), m_mat_ptr(mat) {};
 	
-	virtual bool hit(
-		const ray& r, double tMin, double tMax, hitRecord& record
-    ) const override;
+	// hit comes from sphere and runs these two.
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+	virtual void fillAttributes(const ray& r, hitRecord& record) const override;
 	
     virtual bool getAABB(
-        double startTime, double endTime, aabb& outputBox
+        real startTime, real endTime, aabb& outputBox
     ) const override;
     
-    point3 getCenter(double time) const;
+    point3 getCenter(real time) const;
 public:
 	point3 m_startCenter, m_endCenter;
-	double m_startTime, m_endTime;
-	double m_radius;
+	real m_startTime, m_endTime;
+	real m_radius;
 	shared_ptr<material> m_mat_ptr;
 };
 
-point3 movingSphere::getCenter(double time) const {
+point3 movingSphere::getCenter(real time) const {
 	return m_startCenter + ((time - m_startTime) / (m_endTime - m_startTime)) * (m_endCenter - m_startCenter);
 }
 
-bool movingSphere::hit(const ray& r, double tMin, double tMax, hitRecord& record) const {
-    vec3 oc = r.getOrigin() - getCenter(r.getTime());
-    double a = r.getDirection().lengthSquared();
-    double half_b = dot(oc, r.getDirection());
-    double c = oc.lengthSquared() - m_radius * m_radius;
-
-    double discriminant = half_b * half_b - a * c;
-    if (discriminant < 0.0) return false; // No intersection
-    double sqrtd = sqrt(discriminant);
-
-    // Find the nearest root that lies in the acceptable range.
-    double root = (-half_b - sqrtd) / a;
-    if (root < tMin || tMax < root) {
-        root = (-half_b + sqrtd) / a;
-        if (root < tMin || tMax < root)
-            return false;
-    }
+bool movingSphere::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+    real root;
+    if (!intersectSphere(r.getOrigin() - getCenter(r.getTime()), r.getDirection(), m_radius, tMin, tMax, root))
+        return false;
 
     record.t = root;
-    record.point = r.resize(record.t);
-    vec3 outwardNormal = (record.point - getCenter(r.getTime())) / m_radius;
-    record.setFaceNormal(r, outwardNormal);
-    record.material_ptr = m_mat_ptr;
-
+    record.object = this;
     return true;
 }
 
-bool movingSphere::getAABB(double startTime, double endTime, aabb& outputBox) const {
+void movingSphere::fillAttributes(const ray& r, hitRecord& record) const {
+    const point3 center = getCenter(r.getTime());
+    record.point = projectOntoSphere(r.resize(record.t), center, m_radius);
+    vec3 outwardNormal = (record.point - center) / m_radius;
+    record.setFaceNormal(r, outwardNormal);
+    sphere::getUV(outwardNormal, record.u, record.v);
+    sphere::getTangents(outwardNormal, m_radius, record.dpdu, record.dpdv);
+    record.material_ptr = m_mat_ptr.get();
+}
+
+bool movingSphere::getAABB(real startTime, real endTime, aabb& outputBox) const {
     aabb startBox(
         getCenter(startTime) - vec3(m_radius, m_radius, m_radius),
         getCenter(startTime) + vec3(m_radius, m_radius, m_radius)
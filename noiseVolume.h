@@ -0,0 +1,85 @@
+#pragma once
+
+#include "utils.h"
+#include "aabb.h"
+#include "perlin.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Turbulence of a perlin sampled on a regular grid over a box, for scenes where an approximation
+// is acceptable: a lookup blends eight stored samples instead of summing the octaves. Octaves
+// finer than the grid spacing blur away, so the resolution decides how much detail survives.
+class noiseVolume {
+public:
+	// resolution cells along each axis of region, baked on all hardware threads.
+	noiseVolume(const perlin& noise, const aabb& region, int resolution, int depth = 7);
+
+	bool contains(const point3& p) const {
+		for (int axis = 0; axis < 3; axis++)
+			if (p[axis] < m_region.m_min[axis] || p[axis] > m_region.m_max[axis]) return false;
+		return true;
+	}
+
+	// Trilinear blend of the samples around p, which must lie inside the region.
+	real turbulence(const point3& p) const;
+
+	const aabb& getRegion() const { return m_region; }
+	int getResolution() const { return m_resolution; }
+	size_t getByteSize() const { return m_samples.size() * sizeof(float); }
+
+private:
+	size_t getIndex(int i, int j, int k) const { return (size_t(k) * m_stride + j) * m_stride + i; }
+
+private:
+	aabb m_region;
+	int m_resolution;
+	int m_stride;                 // Samples along each axis, resolution + 1
+	vec3 m_cellsPerUnit;
+	std::vector<float> m_samples; // x fastest, then y, then z
+};
+
+noiseVolume::noiseVolume(const perlin& noise, const aabb& region, int resolution, int depth)
+	: m_region(region), m_resolution(std::max(1, resolution)), m_stride(m_resolution + 1) {
+	const vec3 extent = region.m_max - region.m_min;
+	for (int axis = 0; axis < 3; axis++)
+		m_cellsPerUnit[axis] = extent[axis] > 0 ? m_resolution / extent[axis] : 0;
+	m_samples.resize(size_t(m_stride) * m_stride * m_stride);
+
+	// One task per z slice; each writes only its own samples.
+	threadPool pool;
+	for (int k = 0; k < m_stride; k++) {
+		pool.submit([this, &noise, &extent, depth, k] {
+			for (int j = 0; j < m_stride; j++) {
+				for (int i = 0; i < m_stride; i++) {
+					const vec3 offset(extent.x() * i / m_resolution, extent.y() * j / m_resolution, extent.z() * k / m_resolution);
+					m_samples[getIndex(i, j, k)] = static_cast<float>(noise.turbulant(m_region.m_min + offset, depth));
+				}
+			}
+		});
+	}
+	pool.wait();
+}
+
+real noiseVolume::turbulence(const point3& p) const {
+	int cell[3];
+	real fraction[3];
+	for (int axis = 0; axis < 3; axis++) {
+		const real position = (p[axis] - m_region.m_min[axis]) * m_cellsPerUnit[axis];
+		cell[axis] = std::min(std::max(static_cast<int>(std::floor(position)), 0), m_resolution - 1);
+		fraction[axis] = std::min(std::max(position - cell[axis], real(0)), real(1));
+	}
+
+	real sum = 0;
+	for (int dk = 0; dk < 2; dk++) {
+		const real wz = dk ? fraction[2] : 1 - fraction[2];
+		for (int dj = 0; dj < 2; dj++) {
+			const real wy = dj ? fraction[1] : 1 - fraction[1];
+			const size_t row = getIndex(cell[0], cell[1] + dj, cell[2] + dk);
+			sum += wz * wy * ((1 - fraction[0]) * m_samples[row] + fraction[0] * m_samples[row + 1]);
+		}
+	}
+	return sum;
+}
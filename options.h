@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// How the scene's top-level objects are searched for hits.
+enum class acceleratorType { sceneDefault, list, bvh, sah, bvh4, bvh8, tlas, motion };
+
+// Command line settings. Zero means "keep the value chosen by the scene".
+struct renderOptions {
+	unsigned threadCount = 0;
+	int tileSize = 32;
+	int samplesPerPixel = 0;
+	int imageWidth = 0;
+	unsigned int seed = 0;
+	int maxDepth = 50;
+	int rouletteDepth = 3;
+	bool printHistogram = false;
+	std::string outputPath; // Empty writes a binary PPM to stdout
+	int passSamples = 0;    // Samples per progressive pass, zero renders in one pass
+	std::string checkpointPath;
+	double checkpointInterval = 300.0;
+	bool resume = false;
+	double adaptiveThreshold = 0.0; // Zero spends the same samples on every pixel
+	int adaptiveMaxSamples = 0;     // Zero allows up to 8x --spp
+	std::string heatmapPath;
+	acceleratorType accelerator = acceleratorType::sceneDefault;
+	bool benchmark = false; // Time the accelerators instead of rendering
+	std::string meshPath;   // Render this .obj or .ply file instead of the built-in scene
+	int sceneId = 0;        // Zero renders the default scene
+	std::string sceneCachePath; // Compiled scene to load, or to write when it is missing or stale
+	bool textureFiltering = true;
+	int noiseVolumeResolution = 0; // Zero evaluates Perlin turbulence exactly
+};
+
+inline void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " [options] [> image.ppm]\n"
+		<< "  --output PATH    write to PATH; .png, .pfm or .ppm picks the format (default: P6 on stdout)\n"
+		<< "  --threads N      worker threads (default: all hardware threads)\n"
+		<< "  --tile-size N    tile edge length in pixels (default: 32)\n"
+		<< "  --spp N          samples per pixel (default: scene setting)\n"
+		<< "  --width N        image width in pixels (default: scene setting)\n"
+		<< "  --max-depth N    maximum bounces per path (default: 50)\n"
+		<< "  --roulette N     first bounce eligible for Russian roulette, -1 disables (default: 3)\n"
+		<< "  --histogram      print the bounce-count histogram after rendering\n"
+		<< "  --progressive N  render in passes of N samples per pixel\n"
+		<< "  --checkpoint P   save progress to P after passes (implies --progressive)\n"
+		<< "  --checkpoint-interval S  seconds between checkpoints (default: 300)\n"
+		<< "  --resume         continue from the --checkpoint file if it matches this render\n"
+		<< "  --adaptive T     stop sampling pixels whose relative error is below T (implies --progressive)\n"
+		<< "  --adaptive-max N sample cap for noisy pixels (default: 8x --spp)\n"
+		<< "  --heatmap PATH   write an image of the samples spent per pixel\n"
+		<< "  --accel TYPE     list, bvh (binary node tree), sah (flattened SAH tree), bvh4 or bvh8 (SIMD wide trees), tlas (two-level, shared per-shape trees),\n"
+		<< "                   motion (bounds interpolated to the ray time)\n"
+		<< "  --scene N        built-in scene 1-12 (default: 8)\n"
+		<< "  --scene-cache P  load the compiled scene from P, or build it and save it there\n"
+		<< "  --mesh PATH      render a binary .ply or .obj mesh framed from the front\n"
+		<< "  --benchmark      time every accelerator on scenes 9, 8, 11 and 12, two-level refit against\n"
+		<< "                   rebuild, box against aaBox and 1M spheres against a sphereCloud, then exit\n"
+		<< "  --seed N         base seed of the sampler (default: 0)\n"
+		<< "  --texture-filter MODE  trilinear (MIP levels picked by ray differentials) or nearest (default: trilinear)\n"
+		<< "  --noise-volume N bake Perlin turbulence into N^3-cell volumes where scenes allow it (default: 0, exact)\n";
+}
+
+inline bool parseOptions(int argc, char* argv[], renderOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(arg, "--threads") == 0 && hasValue) {
+			options.threadCount = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+		} else if (std::strcmp(arg, "--tile-size") == 0 && hasValue) {
+			options.tileSize = std::atoi(argv[++i]);
+		} else if (std::strcmp(arg, "--spp") == 0 && hasValue) {
+			options.samplesPerPixel = std::atoi(argv[++i]);
+		} else if (std::strcmp(arg, "--width") == 0 && hasValue) {
+			options.imageWidth = std::atoi(argv[++i]);
+		} else if (std::strcmp(arg, "--seed") == 0 && hasValue) {
+			options.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+		} else if (std::strcmp(arg, "--max-depth") == 0 && hasValue) {
+			options.maxDepth = std::atoi(argv[++i]);
+		} else if (std::strcmp(arg, "--roulette") == 0 && hasValue) {
+			options.rouletteDepth = std::atoi(argv[++i]);
+		} else if (std::strcmp(arg, "--histogram") == 0) {
+			options.printHistogram = true;
+		} else if (std::strcmp(arg, "--progressive") == 0 && hasValue) {
+			options.passSamples = std::atoi(argv[++i]);
+		} else if (std::strcmp(arg, "--checkpoint") == 0 && hasValue) {
+			options.checkpointPath = argv[++i];
+		} else if (std::strcmp(arg, "--checkpoint-interval") == 0 && hasValue) {
+			options.checkpointInterval = std::atof(argv[++i]);
+		} else if (std::strcmp(arg, "--resume") == 0) {
+			options.resume = true;
+		} else if (std::strcmp(arg, "--adaptive") == 0 && hasValue) {
+			options.adaptiveThreshold = std::atof(argv[++i]);
+		} else if (std::strcmp(arg, "--adaptive-max") == 0 && hasValue) {
+			options.adaptiveMaxSamples = std::atoi(argv[++i]);
+		} else if (std::strcmp(arg, "--heatmap") == 0 && hasValue) {
+			options.heatmapPath = argv[++i];
+		} else if (std::strcmp(arg, "--accel") == 0 && hasValue) {
+			const char* type = argv[++i];
+			if (std::strcmp(type, "list") == 0) options.accelerator = acceleratorType::list;
+			else if (std::strcmp(type, "bvh") == 0) options.accelerator = acceleratorType::bvh;
+			else if (std::strcmp(type, "sah") == 0) options.accelerator = acceleratorType::sah;
+			else if (std::strcmp(type, "bvh4") == 0) options.accelerator = acceleratorType::bvh4;
+			else if (std::strcmp(type, "bvh8") == 0) options.accelerator = acceleratorType::bvh8;
+			else if (std::strcmp(type, "tlas") == 0) options.accelerator = acceleratorType::tlas;
+			else if (std::strcmp(type, "motion") == 0) options.accelerator = acceleratorType::motion;
+			else {
+				std::cerr << "Unknown accelerator '" << type << "'.\n";
+				return false;
+			}
+		} else if (std::strcmp(arg, "--scene") == 0 && hasValue) {
+			options.sceneId = std::atoi(argv[++i]);
+			if (options.sceneId < 1 || options.sceneId > 12) {
+				std::cerr << "Scene must be between 1 and 12.\n";
+				return false;
+			}
+		} else if (std::strcmp(arg, "--scene-cache") == 0 && hasValue) {
+			options.sceneCachePath = argv[++i];
+		} else if (std::strcmp(arg, "--mesh") == 0 && hasValue) {
+			options.meshPath = argv[++i];
+		} else if (std::strcmp(arg, "--benchmark") == 0) {
+			options.benchmark = true;
+		} else if (std::strcmp(arg, "--texture-filter") == 0 && hasValue) {
+			const char* mode = argv[++i];
+			if (std::strcmp(mode, "trilinear") == 0) options.textureFiltering = true;
+			else if (std::strcmp(mode, "nearest") == 0) options.textureFiltering = false;
+			else {
+				std::cerr << "Unknown texture filter '" << mode << "'.\n";
+				return false;
+			}
+		} else if (std::strcmp(arg, "--noise-volume") == 0 && hasValue) {
+			options.noiseVolumeResolution = std::atoi(argv[++i]);
+			if (options.noiseVolumeResolution < 0) {
+				std::cerr << "Noise volume resolution must not be negative.\n";
+				return false;
+			}
+		} else if (std::strcmp(arg, "--output") == 0 && hasValue) {
+			options.outputPath = argv[++i];
+		} else {
+			std::cerr << "Unknown or incomplete option '" << arg << "'.\n";
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+
+	if (options.maxDepth <= 0) {
+		std::cerr << "Maximum depth must be positive.\n";
+		return false;
+	}
+
+	if (options.resume && options.checkpointPath.empty()) {
+		std::cerr << "--resume needs a --checkpoint file.\n";
+		return false;
+	}
+
+	if ((!options.checkpointPath.empty() || options.adaptiveThreshold > 0.0) && options.passSamples <= 0)
+		options.passSamples = 16;
+
+	if (options.tileSize <= 0) {
+		std::cerr << "Tile size must be positive.\n";
+		return false;
+	}
+
+	return true;
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "utils.h"
+#include "simd.h"
+
+#include <algorithm>
 
 class perlin {
 public:
@@ -13,8 +16,25 @@ public:
 		m_permX = perlinGeneratePerm();
 		m_permY = perlinGeneratePerm();
 		m_permZ = perlinGeneratePerm();
+		prepareGradients();
 	}
 
+	// Copies tables saved from another perlin, e.g. by the scene cache.
+	perlin(const vec3* randVec, const int* permX, const int* permY, const int* permZ) {
+		m_randVec = new vec3[m_pointCount];
+		m_permX = new int[m_pointCount];
+		m_permY = new int[m_pointCount];
+		m_permZ = new int[m_pointCount];
+		std::copy(randVec, randVec + m_pointCount, m_randVec);
+		std::copy(permX, permX + m_pointCount, m_permX);
+		std::copy(permY, permY + m_pointCount, m_permY);
+		std::copy(permZ, permZ + m_pointCount, m_permZ);
+		prepareGradients();
+	}
+
+	perlin(const perlin&) = delete;
+	perlin& operator=(const perlin&) = delete;
+
 	~perlin() {
 		delete[] m_randVec;
 		delete[] m_permX;
@@ -22,10 +42,14 @@ public:
 		delete[] m_permZ;
 	}
 
-	double genNoise(const point3& p) const {
-		double u = p.x() - floor(p.x());
-		double v = p.y() - floor(p.y());
-		double w = p.z() - floor(p.z());
+	static int getPointCount() { return m_pointCount; }
+	const vec3* getRandomVectors() const { return m_randVec; }
+	const int* getPermutation(int axis) const { return axis == 0 ? m_permX : axis == 1 ? m_permY : m_permZ; }
+
+	real genNoise(const point3& p) const {
+		real u = p.x() - floor(p.x());
+		real v = p.y() - floor(p.y());
+		real w = p.z() - floor(p.z());
 
 		int i = static_cast<int>(floor(p.x()));
 		int j = static_cast<int>(floor(p.y()));
@@ -44,10 +68,21 @@ public:
 		return trilinearInterpolation(c, u, v, w);
 	}
 
-	double turbulant(const point3& p, int depth = 7) const {
-		double accum = 0.0;
+	// Sum of depth octaves of noise, each at twice the frequency and half the weight of the one
+	// before. Builds with SSE evaluate the lattice corners in vector lanes, in float.
+	real turbulant(const point3& p, int depth = 7) const {
+#ifdef RT_SIMD_SSE
+		return turbulantLanes(p, depth);
+#else
+		return turbulantScalar(p, depth);
+#endif
+	}
+
+	// Reference version, one corner at a time in the scalar type.
+	real turbulantScalar(const point3& p, int depth = 7) const {
+		real accum = 0.0;
 		point3 pTemp = p;
-		double weight = 1.0;
+		real weight = 1.0;
 
 		for (int i = 0; i < depth; i++) {
 			accum += weight * genNoise(pTemp);
@@ -58,6 +93,10 @@ public:
 		return fabs(accum);
 	}
 
+#ifdef RT_SIMD_SSE
+	real turbulantLanes(const point3& p, int depth = 7) const;
+#endif
+
 private:
 	static int* perlinGeneratePerm() {
 		int* p = new int[m_pointCount];
@@ -80,7 +119,7 @@ private:
 		}
 	}
 
-	static double trilinearInterpolation(vec3 c[2][2][2], double u, double v, double w) {
+	static real trilinearInterpolation(vec3 c[2][2][2], real u, real v, real w) {
 		// c: 2 x 2 x 2 cube
 		//		/---/---/ |
 		//     /- -/- -/| |
@@ -90,10 +129,10 @@ private:
 		//    |   |   | /
 		//    |---|---|/
 
-		double uu = u * u * (3.0 - 2.0 * u);
-		double vv = v * v * (3.0 - 2.0 * v);
-		double ww = w * w * (3.0 - 2.0 * w);
-		double accum = 0.0;
+		real uu = u * u * (3.0 - 2.0 * u);
+		real vv = v * v * (3.0 - 2.0 * v);
+		real ww = w * w * (3.0 - 2.0 * w);
+		real accum = 0.0;
 
 		for (int i = 0; i < 2; i++) {
 			for (int j = 0; j < 2; j++) {
@@ -110,10 +149,100 @@ private:
 		return accum;
 	}
 
+	// Float copies of the random vectors, padded to four components so one load fetches a corner.
+	void prepareGradients() {
+		for (int i = 0; i < m_pointCount; i++) {
+			for (int axis = 0; axis < 3; axis++) m_gradients[i][axis] = static_cast<float>(m_randVec[i][axis]);
+			m_gradients[i][3] = 0.0f;
+		}
+	}
+
 private:
 	static const int m_pointCount = 256;
+	alignas(16) float m_gradients[m_pointCount][4];
 	vec3* m_randVec;
 	int* m_permX;
 	int* m_permY;
 	int* m_permZ;
 };
+
+#ifdef RT_SIMD_SSE
+// The eight corners of an octave's lattice cell sit in the lanes of two SSE registers, one per
+// x face of the cell, with corner (dj, dk) in lane 2 dj + dk. The y and z factors are shared by
+// both faces, so an AVX register would save nothing. Corner gradients are loaded whole and
+// transposed into x, y and z rows. Every lane accumulates its weighted contribution over all
+// octaves, and the lanes are summed once at the end; only the cell coordinates and the
+// permutation lookups stay scalar.
+real perlin::turbulantLanes(const point3& p, int depth) const {
+	const __m128 dj = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	const __m128 dk = _mm_setr_ps(0.0f, 1.0f, 0.0f, 1.0f);
+	__m128 accumLow = _mm_setzero_ps();  // Corners with di = 0
+	__m128 accumHigh = _mm_setzero_ps(); // Corners with di = 1
+	float weight = 1.0f;
+
+	// Doubling the point doubles its cell index and fraction, carrying into the index when the
+	// fraction reaches one. That is exact, so floor is only needed for the first octave.
+	int cell[3];
+	real fraction[3];
+	for (int axis = 0; axis < 3; axis++) {
+		const real f = floor(p[axis]);
+		cell[axis] = static_cast<int>(f);
+		fraction[axis] = p[axis] - f;
+	}
+
+	for (int octave = 0; octave < depth; octave++) {
+		if (octave > 0) {
+			for (int axis = 0; axis < 3; axis++) {
+				const real doubled = 2 * fraction[axis];
+				const int carry = static_cast<int>(doubled); // 0 or 1, without a branch
+				fraction[axis] = doubled - carry;
+				cell[axis] = 2 * cell[axis] + carry;
+			}
+		}
+		const int i = cell[0], j = cell[1], k = cell[2];
+		const float u = static_cast<float>(fraction[0]);
+		const float v = static_cast<float>(fraction[1]);
+		const float w = static_cast<float>(fraction[2]);
+
+		const int xs[2] = { m_permX[i & 255], m_permX[(i + 1) & 255] };
+		const int ys[2] = { m_permY[j & 255], m_permY[(j + 1) & 255] };
+		const int zs[2] = { m_permZ[k & 255], m_permZ[(k + 1) & 255] };
+
+		// Corner (di, dj, dk) takes the gradient at xs[di] ^ ys[dj] ^ zs[dk].
+		const int y0z0 = ys[0] ^ zs[0], y0z1 = ys[0] ^ zs[1], y1z0 = ys[1] ^ zs[0], y1z1 = ys[1] ^ zs[1];
+		__m128 low[4] = {
+			_mm_load_ps(m_gradients[xs[0] ^ y0z0]), _mm_load_ps(m_gradients[xs[0] ^ y0z1]),
+			_mm_load_ps(m_gradients[xs[0] ^ y1z0]), _mm_load_ps(m_gradients[xs[0] ^ y1z1])
+		};
+		__m128 high[4] = {
+			_mm_load_ps(m_gradients[xs[1] ^ y0z0]), _mm_load_ps(m_gradients[xs[1] ^ y0z1]),
+			_mm_load_ps(m_gradients[xs[1] ^ y1z0]), _mm_load_ps(m_gradients[xs[1] ^ y1z1])
+		};
+		_MM_TRANSPOSE4_PS(low[0], low[1], low[2], low[3]);
+		_MM_TRANSPOSE4_PS(high[0], high[1], high[2], high[3]);
+
+		// Hermite weights: 1 - s toward the low corner, s toward the high one.
+		const float uu = u * u * (3.0f - 2.0f * u);
+		const __m128 vv = _mm_set1_ps(v * v * (3.0f - 2.0f * v));
+		const __m128 ww = _mm_set1_ps(w * w * (3.0f - 2.0f * w));
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 hy = _mm_add_ps(_mm_sub_ps(one, vv), _mm_mul_ps(dj, _mm_sub_ps(_mm_add_ps(vv, vv), one)));
+		const __m128 hz = _mm_add_ps(_mm_sub_ps(one, ww), _mm_mul_ps(dk, _mm_sub_ps(_mm_add_ps(ww, ww), one)));
+		const __m128 wy = _mm_sub_ps(_mm_set1_ps(v), dj);
+		const __m128 wz = _mm_sub_ps(_mm_set1_ps(w), dk);
+		const __m128 hyz = _mm_mul_ps(_mm_mul_ps(hy, hz), _mm_set1_ps(weight));
+		const __m128 dotLow = _mm_add_ps(_mm_mul_ps(low[0], _mm_set1_ps(u)),
+			_mm_add_ps(_mm_mul_ps(low[1], wy), _mm_mul_ps(low[2], wz)));
+		const __m128 dotHigh = _mm_add_ps(_mm_mul_ps(high[0], _mm_set1_ps(u - 1.0f)),
+			_mm_add_ps(_mm_mul_ps(high[1], wy), _mm_mul_ps(high[2], wz)));
+		accumLow = _mm_add_ps(accumLow, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(1.0f - uu), hyz), dotLow));
+		accumHigh = _mm_add_ps(accumHigh, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(uu), hyz), dotHigh));
+
+		weight *= 0.5f;
+	}
+
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, _mm_add_ps(accumLow, accumHigh));
+	return std::fabs(real(lanes[0] + lanes[1] + lanes[2] + lanes[3]));
+}
+#endif
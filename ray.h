@@ -2,22 +2,40 @@
 
 #include "vec3.h"
 
-class ray {
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+template <typename T>
+class rayT {
 public:
-    ray() : m_time(0.0) {}
-    ray(const point3& origin, const vec3& direction, double time = 0.0)
+    rayT() : m_time(0) {}
+    rayT(const vec3T<T>& origin, const vec3T<T>& direction, T time = 0)
         : m_origin(origin), m_direction(direction), m_time(time) {}
 
-    point3 getOrigin() const { return m_origin; }
-    vec3 getDirection() const { return m_direction; }
-    double getTime() const { return m_time; }
+    vec3T<T> getOrigin() const { return m_origin; }
+    vec3T<T> getDirection() const { return m_direction; }
+    T getTime() const { return m_time; }
 
-    point3 resize(double t) const {
+    vec3T<T> resize(T t) const {
         return m_origin + t * m_direction;
     }
 
 private:
-    point3 m_origin;
-    vec3 m_direction;
-    double m_time;
-};
\ No newline at end of file
+    vec3T<T> m_origin;
+    vec3T<T> m_direction;
+    T m_time;
+};
+
+using ray = rayT<real>;
+
+// Start point for a ray leaving a surface at p in direction w. A computed hit point is only
+// accurate to a few ulps of its largest coordinate, so it is pushed that far along the normal
+// to the side w leaves from; otherwise the new ray can hit the surface it starts on, which a
+// fixed tMin cannot prevent once coordinates are large and the scalar type is float.
+template <typename T>
+inline vec3T<T> offsetRayOrigin(const vec3T<T>& p, const vec3T<T>& normal, const vec3T<T>& w) {
+    T magnitude = std::max(std::fabs(p.x()), std::max(std::fabs(p.y()), std::fabs(p.z())));
+    T distance = (magnitude + 1) * 64 * std::numeric_limits<T>::epsilon();
+    return p + (dot(w, normal) < 0 ? -distance : distance) * normal;
+}
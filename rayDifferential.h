@@ -0,0 +1,95 @@
+#pragma once
+
+#include "utils.h"
+
+#include <cmath>
+
+// How far texture coordinates move between neighbouring pixels, in x and in y. Textures that
+// filter pick their detail level from it; invalid means unknown, and lookups stay unfiltered.
+struct uvFootprint {
+	real dudx = 0, dvdx = 0;
+	real dudy = 0, dvdy = 0;
+	bool valid = false;
+};
+
+// Change of a ray's origin and unit direction from one pixel to the next, after Igehy,
+// "Tracing Ray Differentials" (SIGGRAPH 1999). Camera rays start with them and specular
+// bounces carry them on; any other bounce drops them. Surfaces are treated as flat at the
+// hit point, so curved mirrors and lenses widen or narrow the footprint less than they should.
+struct rayDifferential {
+	vec3 dOriginDx, dOriginDy;
+	vec3 dDirectionDx, dDirectionDy; // Of the unit direction
+	bool valid = false;
+
+	// Moves the differentials to the hit at distance t along r, where the surface has the given
+	// normal: afterwards the origin derivatives are those of the hit point.
+	bool transfer(const ray& r, real t, const vec3& normal);
+
+	// Turns the direction derivatives into those of the mirror reflection, or of the refraction
+	// with eta the ratio of refractive indices, of the unit direction inDirection about normal,
+	// which faces the incoming side.
+	void reflectAt(const vec3& normal);
+	bool refractAt(const vec3& inDirection, const vec3& normal, real eta);
+};
+
+// Derivative of v / |v| for a change dv of v.
+inline vec3 unitVectorDerivative(const vec3& v, const vec3& dv) {
+	real length = v.length();
+	vec3 direction = v / length;
+	return (dv - dot(direction, dv) * direction) / length;
+}
+
+bool rayDifferential::transfer(const ray& r, real t, const vec3& normal) {
+	const vec3 direction = r.getDirection();
+	const real length = direction.length();
+	const vec3 unitDirection = direction / length;
+	const real cosine = dot(unitDirection, normal);
+	if (std::fabs(cosine) < real(1e-6)) return valid = false; // Grazing: the footprint is unbounded
+
+	// The ray moves in t with the unit direction, so the hit is t * length along it.
+	const real distance = t * length;
+	vec3 dPdx = dOriginDx + distance * dDirectionDx;
+	vec3 dPdy = dOriginDy + distance * dDirectionDy;
+	dOriginDx = dPdx - (dot(dPdx, normal) / cosine) * unitDirection;
+	dOriginDy = dPdy - (dot(dPdy, normal) / cosine) * unitDirection;
+	return true;
+}
+
+void rayDifferential::reflectAt(const vec3& normal) {
+	dDirectionDx = dDirectionDx - 2 * dot(dDirectionDx, normal) * normal;
+	dDirectionDy = dDirectionDy - 2 * dot(dDirectionDy, normal) * normal;
+}
+
+// The refracted direction is eta * d + mu * n with mu = eta cos(i) - cos(t).
+bool rayDifferential::refractAt(const vec3& inDirection, const vec3& normal, real eta) {
+	const real cosIn = -dot(inDirection, normal);
+	const real cosOutSquared = 1 - eta * eta * (1 - cosIn * cosIn);
+	if (cosOutSquared <= 0) return valid = false;
+
+	const real muPerCosIn = eta - eta * eta * cosIn / std::sqrt(cosOutSquared);
+	dDirectionDx = eta * dDirectionDx + (muPerCosIn * -dot(dDirectionDx, normal)) * normal;
+	dDirectionDy = eta * dDirectionDy + (muPerCosIn * -dot(dDirectionDy, normal)) * normal;
+	return true;
+}
+
+// Texture coordinate derivatives of a hit, from the position derivatives of the surface and of
+// the ray differentials there, by least squares as in pbrt. Zero surface derivatives, which
+// primitives without a parameterization report, give an invalid footprint.
+inline uvFootprint computeFootprint(const vec3& dpdu, const vec3& dpdv, const vec3& dPdx, const vec3& dPdy) {
+	uvFootprint footprint;
+	const real uu = dot(dpdu, dpdu);
+	const real uv = dot(dpdu, dpdv);
+	const real vv = dot(dpdv, dpdv);
+	const real determinant = uu * vv - uv * uv;
+	if (!(std::fabs(determinant) > real(1e-20))) return footprint;
+
+	const real inverse = 1 / determinant;
+	const real ux = dot(dpdu, dPdx), vx = dot(dpdv, dPdx);
+	const real uy = dot(dpdu, dPdy), vy = dot(dpdv, dPdy);
+	footprint.dudx = (vv * ux - uv * vx) * inverse;
+	footprint.dvdx = (uu * vx - uv * ux) * inverse;
+	footprint.dudy = (vv * uy - uv * vy) * inverse;
+	footprint.dvdy = (uu * vy - uv * uy) * inverse;
+	footprint.valid = std::isfinite(footprint.dudx + footprint.dvdx + footprint.dudy + footprint.dvdy);
+	return footprint;
+}
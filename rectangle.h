@@ -0,0 +1,100 @@
+#pragma once
+
+#include "utils.h"
+#include "hittable.h"
+#include "sceneArena.h"
+
+#include <iostream>
+
+// Rectangle in the plane where coordinate Axis equals m_k, spanning [m_a0, m_a1] x [m_b0, m_b1]
+// on the other two axes (x before y before z). The plane is fixed at compile time, so hit is a
+// single straight-line kernel. Texture coordinates match aaRectangle and box faces.
+template <int Axis>
+class axisRectangle : public hittable {
+public:
+	static const int uAxis = Axis == 0 ? 1 : 0;
+	static const int vAxis = Axis == 2 ? 1 : 2;
+
+	axisRectangle() {}
+	axisRectangle(const point3& p0, const point3& p1, shared_ptr<material> material_ptr)
+		: m_a0(p0[uAxis]), m_a1(p1[uAxis]), m_b0(p0[vAxis]), m_b1(p1[vAxis]), m_k(p0[Axis]),
+		  m_material_ptr(material_ptr) {}
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+	virtual void fillAttributes(const ray& r, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		// Pad the flat axis so the box has non-zero width in every dimension.
+		point3 low, high;
+		low[uAxis] = m_a0; high[uAxis] = m_a1;
+		low[vAxis] = m_b0; high[vAxis] = m_b1;
+		low[Axis] = m_k - real(0.0001); high[Axis] = m_k + real(0.0001);
+		outputBox = aabb(low, high);
+		return true;
+	}
+
+public:
+	real m_a0 = 0, m_a1 = 0, m_b0 = 0, m_b1 = 0, m_k = 0;
+	shared_ptr<material> m_material_ptr;
+};
+
+using yzRectangle = axisRectangle<0>;
+using xzRectangle = axisRectangle<1>;
+using xyRectangle = axisRectangle<2>;
+
+template <int Axis>
+bool axisRectangle<Axis>::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	const point3& origin = r.getOrigin();
+	const vec3& direction = r.getDirection();
+
+	real t = (m_k - origin[Axis]) / direction[Axis];
+	if (t < tMin || t > tMax) return false;
+
+	real a = origin[uAxis] + t * direction[uAxis];
+	real b = origin[vAxis] + t * direction[vAxis];
+	if (a < m_a0 || a > m_a1 || b < m_b0 || b > m_b1) return false;
+
+	record.t = t;
+	record.object = this;
+	return true;
+}
+
+// Recomputes the in-plane coordinates the same way intersect did.
+template <int Axis>
+void axisRectangle<Axis>::fillAttributes(const ray& r, hitRecord& record) const {
+	const real t = record.t;
+	real a = r.getOrigin()[uAxis] + t * r.getDirection()[uAxis];
+	real b = r.getOrigin()[vAxis] + t * r.getDirection()[vAxis];
+
+	record.u = (a - m_a0) / (m_a1 - m_a0);
+	record.v = (b - m_b0) / (m_b1 - m_b0);
+
+	point3 p;
+	p[uAxis] = a;
+	p[vAxis] = b;
+	p[Axis] = m_k;
+	record.point = p;
+
+	vec3 outwardNormal;
+	outwardNormal[Axis] = 1;
+	record.setFaceNormal(r, outwardNormal);
+	record.dpdu = record.dpdv = vec3(0, 0, 0);
+	record.dpdu[uAxis] = m_a1 - m_a0;
+	record.dpdv[vAxis] = m_b1 - m_b0;
+	record.material_ptr = m_material_ptr.get();
+}
+
+// Picks the specialization from the coordinate the two corners share; p0 is the low corner.
+inline shared_ptr<hittable> makeRectangle(
+	sceneArena& arena, const point3& p0, const point3& p1, shared_ptr<material> material_ptr
+) {
+	if (p0.z() == p1.z()) return arena.make<xyRectangle>(p0, p1, material_ptr);
+	if (p0.y() == p1.y()) return arena.make<xzRectangle>(p0, p1, material_ptr);
+	if (p0.x() != p1.x())
+		std::cerr << "ERROR: Rectangle corners " << p0 << " and " << p1 << " are not in an axis-aligned plane.\n";
+	return arena.make<yzRectangle>(p0, p1, material_ptr);
+}
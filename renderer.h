@@ -0,0 +1,226 @@
+#pragma once
+
+#include "utils.h"
+
+#include "camera.h"
+#include "hittable.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+
+struct renderSettings {
+	int imageWidth = 400;
+	int imageHeight = 225;
+	int samplesPerPixel = 100;
+	int maxDepth = 50;
+	int rouletteDepth = 3;
+	int tileSize = 32;
+	unsigned threadCount = threadPool::defaultThreadCount();
+	unsigned int seed = 0;
+	bool textureFiltering = true; // Ray differentials and MIP lookups; off samples the nearest texel
+};
+
+// Progressive rendering in passes. With a positive adaptive threshold, a pixel stops receiving
+// samples once the relative error of its mean drops below the threshold, and the samples it
+// saves go to the pixels that are still noisy, up to maxSamplesPerPixel each.
+struct progressiveSettings {
+	int passSamples = 16;
+	double adaptiveThreshold = 0.0;
+	int maxSamplesPerPixel = 0;
+};
+
+// Splits the image into tiles and renders them on a work-stealing pool. Random numbers are
+// keyed by (seed, pixel, sample, bounce), so the image only depends on the seed, never on the
+// thread count, the tile size or the order in which tiles finish.
+class renderer {
+public:
+	renderer(const camera& cam, const hittable& entities, const color& background, const renderSettings& settings)
+		: m_camera(cam), m_entities(entities), m_background(background), m_settings(settings),
+		m_integrator(settings.maxDepth, settings.rouletteDepth), m_histogram(settings.maxDepth) {}
+
+	// Renders until every pixel holds the configured number of samples.
+	void render(framebuffer& image) {
+		renderPass(image, m_settings.samplesPerPixel - int(image.getTotalSamples() / image.getPixelCount()));
+	}
+
+	// Adds the next sampleCount samples to every pixel, or only to the pixels flagged in
+	// activePixels. Sample indices continue from each pixel's own count, so passes of any size
+	// add up to the same samples as a single render.
+	void renderPass(framebuffer& image, int sampleCount, const std::vector<unsigned char>* activePixels = nullptr);
+
+	// Renders passes until the image holds samplesPerPixel samples per pixel on average, or
+	// every pixel has converged. afterPass runs on the calling thread between passes.
+	void renderProgressive(
+		framebuffer& image, const progressiveSettings& progressive, const std::function<void(bool finished)>& afterPass
+	);
+
+	const bounceHistogram& getHistogram() const { return m_histogram; }
+
+private:
+	struct tileBuffer {
+		std::vector<colorSum> sums;
+		std::vector<double> squares;
+	};
+
+	void renderTile(
+		const tile& region, const framebuffer& image, int sampleCount, const std::vector<unsigned char>* activePixels,
+		tileBuffer& buffer, bounceHistogram& histogram
+	) const;
+
+	size_t selectActivePixels(
+		const framebuffer& image, const progressiveSettings& progressive, std::vector<unsigned char>& activePixels
+	) const;
+
+private:
+	const camera& m_camera;
+	const hittable& m_entities;
+	color m_background;
+	renderSettings m_settings;
+	pathIntegrator m_integrator;
+	bounceHistogram m_histogram;
+};
+
+void renderer::renderPass(framebuffer& image, int sampleCount, const std::vector<unsigned char>* activePixels) {
+	if (sampleCount <= 0) return;
+
+	std::vector<tile> tiles = splitIntoTiles(m_settings.imageWidth, m_settings.imageHeight, m_settings.tileSize);
+	std::atomic<size_t> tilesRemaining(tiles.size());
+	std::mutex progressMutex;
+
+	threadPool pool(m_settings.threadCount);
+
+	for (size_t i = 0; i < tiles.size(); i++) {
+		pool.submit([&, i] {
+			const tile& region = tiles[i];
+			const size_t tileSize = size_t(region.getWidth()) * region.getHeight();
+			tileBuffer buffer{ std::vector<colorSum>(tileSize, colorSum(0.0, 0.0, 0.0)), std::vector<double>(tileSize, 0.0) };
+
+			bounceHistogram histogram(m_settings.maxDepth);
+
+			renderTile(region, image, sampleCount, activePixels, buffer, histogram);
+
+			// Tiles never overlap, so merging a private buffer needs no lock on the framebuffer.
+			for (int y = region.y0; y < region.y1; y++) {
+				for (int x = region.x0; x < region.x1; x++) {
+					size_t pixel = image.getIndex(x, y);
+					if (activePixels && !(*activePixels)[pixel]) continue;
+
+					size_t local = size_t(y - region.y0) * region.getWidth() + (x - region.x0);
+					image.addSamples(pixel, buffer.sums[local], buffer.squares[local], sampleCount);
+				}
+			}
+
+			size_t remaining = --tilesRemaining;
+			std::lock_guard<std::mutex> lock(progressMutex);
+			m_histogram.merge(histogram);
+			std::cerr << "\rTiles remaining: " << remaining << ' ' << std::flush;
+		});
+	}
+
+	pool.wait();
+}
+
+void renderer::renderProgressive(
+	framebuffer& image, const progressiveSettings& progressive, const std::function<void(bool finished)>& afterPass
+) {
+	const std::uint64_t budget = std::uint64_t(m_settings.samplesPerPixel) * image.getPixelCount();
+	const bool adaptive = progressive.adaptiveThreshold > 0.0;
+	std::vector<unsigned char> activePixels;
+
+	while (image.getTotalSamples() < budget) {
+		const std::uint64_t remaining = budget - image.getTotalSamples();
+		size_t activeCount = image.getPixelCount();
+
+		if (adaptive) {
+			activeCount = selectActivePixels(image, progressive, activePixels);
+			if (activeCount == 0) break;
+		}
+
+		// Never overshoot the budget by more than one sample per active pixel.
+		std::uint64_t passSamples = std::min<std::uint64_t>(progressive.passSamples, (remaining + activeCount - 1) / activeCount);
+		renderPass(image, int(passSamples), adaptive ? &activePixels : nullptr);
+
+		std::cerr << "\rPass done: " << image.getTotalSamples() / double(image.getPixelCount())
+			<< " / " << m_settings.samplesPerPixel << " mean spp";
+		if (adaptive) std::cerr << ", " << activeCount << " active pixels";
+		std::cerr << std::endl;
+
+		afterPass(image.getTotalSamples() >= budget);
+	}
+
+	// Converged early: still report the final state.
+	if (image.getTotalSamples() < budget) afterPass(true);
+}
+
+size_t renderer::selectActivePixels(
+	const framebuffer& image, const progressiveSettings& progressive, std::vector<unsigned char>& activePixels
+) const {
+	const std::uint32_t minSamples = std::uint32_t(std::max(progressive.passSamples, 2));
+	const std::uint32_t maxSamples = std::uint32_t(progressive.maxSamplesPerPixel > 0
+		? progressive.maxSamplesPerPixel : 8 * m_settings.samplesPerPixel);
+
+	activePixels.assign(image.getPixelCount(), 0);
+	size_t activeCount = 0;
+
+	for (size_t i = 0; i < image.getPixelCount(); i++) {
+		std::uint32_t count = image.getSampleCount(i);
+		bool active = count < minSamples
+			|| (count < maxSamples && image.getRelativeError(i) > progressive.adaptiveThreshold);
+
+		activePixels[i] = active ? 1 : 0;
+		if (active) activeCount++;
+	}
+
+	return activeCount;
+}
+
+void renderer::renderTile(
+	const tile& region, const framebuffer& image, int sampleCount, const std::vector<unsigned char>* activePixels,
+	tileBuffer& buffer, bounceHistogram& histogram
+) const {
+	sampler& rng = sampler::current();
+	rng.setSeed(m_settings.seed);
+
+	const int imageWidth = m_settings.imageWidth;
+	const int imageHeight = m_settings.imageHeight;
+	const real pixelWidth = real(1.0 / (imageWidth - 1));
+	const real pixelHeight = real(1.0 / (imageHeight - 1));
+
+	for (int y = region.y0; y < region.y1; y++) {
+		int row = imageHeight - 1 - y; // Camera v runs bottom to top
+		for (int column = region.x0; column < region.x1; column++) {
+			size_t pixel = image.getIndex(column, y);
+			if (activePixels && !(*activePixels)[pixel]) continue;
+
+			colorSum pixelColor(0.0, 0.0, 0.0);
+			double luminanceSquares = 0.0;
+
+			const int firstSample = int(image.getSampleCount(pixel));
+			for (int s = firstSample; s < firstSample + sampleCount; s++) {
+				rng.startSample(pixel, s);
+				real u = real((double(column) + randomDouble()) / (imageWidth - 1));
+				real v = real((double(row) + randomDouble()) / (imageHeight - 1));
+				rayDifferential differential;
+				ray r = m_settings.textureFiltering
+					? m_camera.getRay(u, v, pixelWidth, pixelHeight, differential)
+					: m_camera.getRay(u, v);
+
+				color sample = m_integrator.radiance(r, differential, m_entities, m_background, histogram);
+				pixelColor += colorSum(sample);
+				double sampleLuminance = luminance(colorSum(sample));
+				luminanceSquares += sampleLuminance * sampleLuminance;
+			}
+
+			size_t local = size_t(y - region.y0) * region.getWidth() + (column - region.x0);
+			buffer.sums[local] = pixelColor;
+			buffer.squares[local] = luminanceSquares;
+		}
+	}
+}
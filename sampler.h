@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// Counter-based random numbers. Every draw hashes a stream key with a running counter
+// (SplitMix64 finalizer), and the key is derived from (seed, pixel, sample, bounce). A pixel's
+// numbers therefore depend only on where they are used, never on which thread renders the
+// pixel or in what order, so renders are bit-reproducible for any thread count or tile layout.
+class sampler {
+public:
+	sampler() : m_seed(0), m_pixel(0), m_sample(0), m_key(0), m_counter(0) { rekey(0); }
+
+	// Every thread owns one sampler; randomDouble() and friends draw from it.
+	static sampler& current() {
+		static thread_local sampler instance;
+		return instance;
+	}
+
+	void setSeed(std::uint64_t seed) {
+		m_seed = seed;
+		rekey(0);
+	}
+
+	// Selects the camera stream (lens, pixel jitter, shutter time) of one pixel sample.
+	void startSample(std::uint64_t pixel, std::uint32_t sample) {
+		m_pixel = pixel;
+		m_sample = sample;
+		rekey(0);
+	}
+
+	// Selects the stream for one path vertex. Bounce 0 is reserved for the camera.
+	void startBounce(std::uint32_t bounce) {
+		rekey(bounce + 1);
+	}
+
+	std::uint64_t nextBits() {
+		return mix(m_key ^ (++m_counter * 0xd1b54a32d192ed03ull));
+	}
+
+	// Uniform double in [0, 1) built from the top 53 bits.
+	double nextDouble() {
+		return static_cast<double>(nextBits() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+private:
+	static std::uint64_t mix(std::uint64_t z) {
+		z += 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	void rekey(std::uint64_t stream) {
+		m_key = mix(m_seed ^ mix(m_pixel ^ mix((std::uint64_t(m_sample) << 32) ^ stream)));
+		m_counter = 0;
+	}
+
+private:
+	std::uint64_t m_seed;
+	std::uint64_t m_pixel;
+	std::uint32_t m_sample;
+	std::uint64_t m_key;
+	std::uint64_t m_counter;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+// Bump allocation for scene objects. Each type gets its own pool of large chunks, so objects of
+// one kind are packed next to each other instead of scattered over the heap. make<T> returns
+// an ordinary shared_ptr whose control block shares the object's slot. Releasing an object
+// runs its destructor but returns no memory; all chunks are freed at once with the arena.
+// Copies of a sceneArena share the same storage, and the last copy must outlive every object
+// made from it, like a scene's arena outlives its entities and the accelerators over them.
+// The arena is not thread-safe, so scenes are built on one thread.
+class sceneArena {
+public:
+	sceneArena() : m_state(make_shared<state>()) {}
+
+	template <typename T, typename... Args>
+	shared_ptr<T> make(Args&&... args) {
+		return std::allocate_shared<T>(allocator<T>(&m_state->getPool<T>()), std::forward<Args>(args)...);
+	}
+
+	size_t getObjectCount() const;
+	size_t getByteSize() const;     // Bytes handed out, control blocks included
+	size_t getReservedSize() const; // Bytes held in chunks
+
+	void printStatistics(std::ostream& out) const;
+
+private:
+	struct pool {
+		void* allocate(size_t size, size_t alignment);
+
+		std::string name;
+		std::vector<std::unique_ptr<unsigned char[]>> chunks;
+		unsigned char* cursor = nullptr;
+		size_t remaining = 0;
+		size_t chunkSize = 4 * 1024; // Doubles per chunk up to s_maxChunkSize
+		size_t reserved = 0;
+		size_t objectCount = 0;
+		size_t byteCount = 0;
+	};
+
+	struct state {
+		std::vector<std::unique_ptr<pool>> pools; // Indexed by typeSlot, null for unused types
+
+		template <typename T>
+		pool& getPool() {
+			const size_t slot = typeSlot<T>();
+			if (slot >= pools.size()) pools.resize(slot + 1);
+			if (!pools[slot]) {
+				pools[slot].reset(new pool());
+				pools[slot]->name = typeName(typeid(T));
+			}
+			return *pools[slot];
+		}
+	};
+
+	template <typename T>
+	struct allocator {
+		using value_type = T;
+
+		explicit allocator(pool* target) : m_pool(target) {}
+
+		template <typename U>
+		allocator(const allocator<U>& other) : m_pool(other.m_pool) {}
+
+		T* allocate(size_t n) { return static_cast<T*>(m_pool->allocate(n * sizeof(T), alignof(T))); }
+		void deallocate(T*, size_t) {} // Returned with the whole arena
+
+		template <typename U>
+		bool operator==(const allocator<U>& other) const { return m_pool == other.m_pool; }
+		template <typename U>
+		bool operator!=(const allocator<U>& other) const { return m_pool != other.m_pool; }
+
+		pool* m_pool;
+	};
+
+	// Small dense index per type, the same in every arena.
+	template <typename T>
+	static size_t typeSlot() {
+		static const size_t slot = s_nextSlot++;
+		return slot;
+	}
+
+	static std::string typeName(const std::type_info& type);
+
+	static constexpr size_t s_maxChunkSize = 4 * 1024 * 1024;
+	static inline std::atomic<size_t> s_nextSlot{ 0 };
+
+	shared_ptr<state> m_state;
+};
+
+void* sceneArena::pool::allocate(size_t size, size_t alignment) {
+	auto padding = [alignment](const unsigned char* at) {
+		return (alignment - reinterpret_cast<std::uintptr_t>(at) % alignment) % alignment;
+	};
+	objectCount++;
+	byteCount += size;
+
+	// Large requests get a chunk of their own, so the current chunk keeps its free space.
+	if (size + alignment > chunkSize / 4) {
+		chunks.emplace_back(new unsigned char[size + alignment]);
+		reserved += size + alignment;
+		unsigned char* own = chunks.back().get();
+		return own + padding(own);
+	}
+
+	if (!cursor || padding(cursor) + size > remaining) {
+		chunks.emplace_back(new unsigned char[chunkSize]);
+		reserved += chunkSize;
+		cursor = chunks.back().get();
+		remaining = chunkSize;
+		chunkSize = std::min(2 * chunkSize, s_maxChunkSize);
+	}
+
+	unsigned char* result = cursor + padding(cursor);
+	remaining -= result + size - cursor;
+	cursor = result + size;
+	return result;
+}
+
+// GCC and Clang return mangled names, MSVC prefixes "class ".
+std::string sceneArena::typeName(const std::type_info& type) {
+#if defined(__GNUG__)
+	int status = 0;
+	std::unique_ptr<char, void (*)(void*)> demangled(abi::__cxa_demangle(type.name(), nullptr, nullptr, &status), std::free);
+	if (status == 0 && demangled) return demangled.get();
+#endif
+	const char* name = type.name();
+	if (std::strncmp(name, "class ", 6) == 0) name += 6;
+	else if (std::strncmp(name, "struct ", 7) == 0) name += 7;
+	return name;
+}
+
+size_t sceneArena::getObjectCount() const {
+	size_t count = 0;
+	for (const auto& p : m_state->pools)
+		if (p) count += p->objectCount;
+	return count;
+}
+
+size_t sceneArena::getByteSize() const {
+	size_t bytes = 0;
+	for (const auto& p : m_state->pools)
+		if (p) bytes += p->byteCount;
+	return bytes;
+}
+
+size_t sceneArena::getReservedSize() const {
+	size_t bytes = 0;
+	for (const auto& p : m_state->pools)
+		if (p) bytes += p->reserved;
+	return bytes;
+}
+
+void sceneArena::printStatistics(std::ostream& out) const {
+	std::vector<const pool*> sorted;
+	for (const auto& p : m_state->pools)
+		if (p) sorted.push_back(p.get());
+	std::sort(sorted.begin(), sorted.end(), [](const pool* a, const pool* b) { return a->byteCount > b->byteCount; });
+
+	out << "sceneArena: " << getObjectCount() << " objects, " << getByteSize() / 1024.0 << " KB used of "
+		<< getReservedSize() / 1024.0 << " KB reserved\n";
+	for (const pool* p : sorted) {
+		out << "  " << p->name << ": " << p->objectCount << " objects, " << p->byteCount / 1024.0 << " KB in "
+			<< p->chunks.size() << (p->chunks.size() == 1 ? " chunk\n" : " chunks\n");
+	}
+}
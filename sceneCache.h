@@ -0,0 +1,709 @@
+#pragma once
+
+#include "utils.h"
+
+#include "sceneSetup.h"
+#include "mappedFile.h"
+#include "texture.h"
+#include "material.h"
+#include "sphere.h"
+#include "movingSphere.h"
+#include "box.h"
+#include "rectangle.h"
+#include "instance.h"
+#include "constatMedium.h"
+#include "bvh.h"
+#include "bvhBuilder.h"
+#include "linearBvh.h"
+#include "mesh.h"
+#include "sphereCloud.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+// Compiled scenes: the objects left after transform folding, their materials and decoded
+// textures, and the trees of meshes, sphere clouds and the top-level SAH BVH in one binary file.
+// Records are written children first and refer to earlier records by index, so loading is a
+// single pass over the mapped file that copies arrays into place and builds no tree. Objects,
+// materials and textures shared in the scene stay shared. A file is only valid for the kind of
+// build that wrote it, so the header carries the precision and the sphere cloud leaf width.
+namespace sceneCacheDetail {
+	const char magic[4] = { 'R', 'T', 'S', 'C' };
+	const std::uint32_t version = 2;
+	const std::uint32_t none = 0xffffffffu; // Index of a missing texture, material or world
+
+	struct fileHeader {
+		char magic[4];
+		std::uint32_t version;
+		std::uint32_t realSize;
+		std::uint32_t cloudLanes;
+		std::uint32_t sceneId;
+	};
+
+	enum class record : std::uint32_t {
+		solidColor, checkerTexture, imageTexture, perlinTexture,
+		lambertian, metal, dielectric, diffuseLight, isotropic,
+		sphere, movingSphere, box, yzRectangle, xzRectangle, xyRectangle, instance, constantMedium,
+		list, bvhLeaf, bvhInterior, linearBvh, mesh, sphereCloud,
+		scene // Settings and top-level objects, always the last record
+	};
+
+	class writer {
+	public:
+		template <typename T>
+		void put(const T& value) { putBlock(&value, 1); }
+
+		template <typename T>
+		void putBlock(const T* values, size_t count) {
+			static_assert(std::is_trivially_copyable<T>::value, "Only plain values are stored as bytes.");
+			const char* bytes = reinterpret_cast<const char*>(values);
+			m_bytes.insert(m_bytes.end(), bytes, bytes + count * sizeof(T));
+		}
+
+		template <typename T>
+		void putArray(const std::vector<T>& values) {
+			put(static_cast<std::uint64_t>(values.size()));
+			putBlock(values.data(), values.size());
+		}
+
+		std::uint32_t addTexture(const shared_ptr<texture>& source);
+		std::uint32_t addMaterial(const shared_ptr<material>& source);
+		std::uint32_t addObject(const shared_ptr<hittable>& source);
+
+		bool isValid() const { return m_valid; }
+		const std::vector<char>& getBytes() const { return m_bytes; }
+		size_t getObjectCount() const { return m_objects.size(); }
+
+	private:
+		template <int Axis>
+		bool putRectangle(const hittable* object, record type) {
+			auto rectangle = dynamic_cast<const axisRectangle<Axis>*>(object);
+			if (!rectangle) return false;
+			std::uint32_t materialId = addMaterial(rectangle->m_material_ptr);
+			put(type);
+			put(rectangle->m_a0); put(rectangle->m_a1); put(rectangle->m_b0); put(rectangle->m_b1); put(rectangle->m_k);
+			put(materialId);
+			return true;
+		}
+
+		template <typename T>
+		std::uint32_t unsupported(const char* kind, const T& value) {
+			std::cerr << "ERROR: Scene cache cannot store " << kind << " of type " << typeid(value).name() << ".\n";
+			m_valid = false;
+			return none;
+		}
+
+	private:
+		std::vector<char> m_bytes;
+		std::unordered_map<const void*, std::uint32_t> m_textures;
+		std::unordered_map<const void*, std::uint32_t> m_images; // Pixels to the texture storing them
+		std::unordered_map<const void*, std::uint32_t> m_materials;
+		std::unordered_map<const void*, std::uint32_t> m_objects;
+		bool m_valid = true;
+	};
+
+	std::uint32_t writer::addTexture(const shared_ptr<texture>& source) {
+		if (!source) return none;
+		auto found = m_textures.find(source.get());
+		if (found != m_textures.end()) return found->second;
+
+		if (auto solid = dynamic_cast<const solidColor*>(source.get())) {
+			put(record::solidColor);
+			put(solid->getColor());
+		} else if (auto checker = dynamic_cast<const checkerTexture*>(source.get())) {
+			std::uint32_t even = addTexture(checker->m_even);
+			std::uint32_t odd = addTexture(checker->m_odd);
+			put(record::checkerTexture);
+			put(even);
+			put(odd);
+		} else if (auto image = dynamic_cast<const imageTexture*>(source.get())) {
+			// A cached placeholder would outlive the file being fixed, so this scene is not cached.
+			if (!image->getData()) {
+				std::cerr << "ERROR: Scene cache cannot store an image that failed to load.\n";
+				m_valid = false;
+				return none;
+			}
+			// Textures made from one file share its imageData, and so share one record.
+			auto shared = m_images.find(image->getData());
+			if (shared != m_images.end()) return shared->second;
+			m_images.emplace(image->getData(), static_cast<std::uint32_t>(m_textures.size()));
+
+			std::int32_t width = image->getWidth();
+			std::int32_t height = image->getHeight();
+			put(record::imageTexture);
+			put(width);
+			put(height);
+			putBlock(image->getData(), size_t(width) * height * imageTexture::s_bytesPerPixel);
+		} else if (auto noise = dynamic_cast<const perlinTexture*>(source.get())) {
+			put(record::perlinTexture);
+			put(noise->m_scale);
+			putBlock(noise->getNoise().getRandomVectors(), perlin::getPointCount());
+			for (int axis = 0; axis < 3; axis++) putBlock(noise->getNoise().getPermutation(axis), perlin::getPointCount());
+			// The region, not the volume: loading bakes again at the resolution asked for then.
+			put(static_cast<std::uint8_t>(noise->m_hasBakeRegion));
+			put(noise->m_bakeRegion);
+		} else {
+			return unsupported("texture", *source);
+		}
+
+		std::uint32_t id = static_cast<std::uint32_t>(m_textures.size());
+		m_textures.emplace(source.get(), id);
+		return id;
+	}
+
+	std::uint32_t writer::addMaterial(const shared_ptr<material>& source) {
+		if (!source) return none;
+		auto found = m_materials.find(source.get());
+		if (found != m_materials.end()) return found->second;
+
+		if (auto diffuse = dynamic_cast<const lambertian*>(source.get())) {
+			std::uint32_t albedo = addTexture(diffuse->m_albedo);
+			put(record::lambertian);
+			put(albedo);
+		} else if (auto mirror = dynamic_cast<const metal*>(source.get())) {
+			put(record::metal);
+			put(mirror->m_albedo);
+			put(mirror->m_reflectionFuzz);
+		} else if (auto glass = dynamic_cast<const dielectric*>(source.get())) {
+			put(record::dielectric);
+			put(glass->m_refractionIndex);
+		} else if (auto light = dynamic_cast<const diffuseLight*>(source.get())) {
+			std::uint32_t emit = addTexture(light->m_emit);
+			put(record::diffuseLight);
+			put(emit);
+		} else if (auto phase = dynamic_cast<const isotropic*>(source.get())) {
+			std::uint32_t albedo = addTexture(phase->albedo);
+			put(record::isotropic);
+			put(albedo);
+		} else {
+			return unsupported("material", *source);
+		}
+
+		std::uint32_t id = static_cast<std::uint32_t>(m_materials.size());
+		m_materials.emplace(source.get(), id);
+		return id;
+	}
+
+	std::uint32_t writer::addObject(const shared_ptr<hittable>& source) {
+		auto found = m_objects.find(source.get());
+		if (found != m_objects.end()) return found->second;
+
+		const hittable* object = source.get();
+		if (auto moving = dynamic_cast<const movingSphere*>(object)) {
+			std::uint32_t materialId = addMaterial(moving->m_mat_ptr);
+			put(record::movingSphere);
+			put(moving->m_startCenter); put(moving->m_endCenter);
+			put(moving->m_startTime); put(moving->m_endTime);
+			put(moving->m_radius);
+			put(materialId);
+		} else if (auto ball = dynamic_cast<const sphere*>(object)) {
+			std::uint32_t materialId = addMaterial(ball->m_material_ptr);
+			put(record::sphere);
+			put(ball->m_center);
+			put(ball->m_radius);
+			put(materialId);
+		} else if (auto cuboid = dynamic_cast<const box*>(object)) {
+			std::uint32_t materialId = addMaterial(cuboid->m_material_ptr);
+			put(record::box);
+			put(cuboid->m_min);
+			put(cuboid->m_max);
+			put(materialId);
+		} else if (auto placed = dynamic_cast<const instance*>(object)) {
+			std::uint32_t child = addObject(placed->m_object);
+			put(record::instance);
+			put(child);
+			put(placed->m_toWorld);
+		} else if (auto medium = dynamic_cast<const constantMedium*>(object)) {
+			std::uint32_t boundary = addObject(medium->m_boundary);
+			std::uint32_t phase = addMaterial(medium->m_phaseFunction);
+			put(record::constantMedium);
+			put(boundary);
+			put(medium->m_negInvDensity);
+			put(phase);
+		} else if (auto list = dynamic_cast<const hittableList*>(object)) {
+			std::vector<std::uint32_t> children;
+			for (const auto& child : list->m_objects) children.push_back(addObject(child));
+			put(record::list);
+			putArray(children);
+		} else if (auto node = dynamic_cast<const bvhNode*>(object)) {
+			if (node->m_object) {
+				std::uint32_t child = addObject(node->m_object);
+				put(record::bvhLeaf);
+				put(node->m_box);
+				put(child);
+			} else {
+				std::uint32_t left = addObject(node->m_left);
+				std::uint32_t right = addObject(node->m_right);
+				put(record::bvhInterior);
+				put(node->m_box);
+				put(left);
+				put(right);
+			}
+		} else if (auto tree = dynamic_cast<const linearBvh*>(object)) {
+			std::vector<std::uint32_t> primitives;
+			for (const auto& primitive : tree->m_primitives) primitives.push_back(addObject(primitive));
+			put(record::linearBvh);
+			putArray(primitives);
+			putArray(tree->m_nodes);
+		} else if (auto mesh = dynamic_cast<const indexedMesh*>(object)) {
+			std::uint32_t materialId = addMaterial(mesh->getMaterial());
+			const meshBuffers& buffers = mesh->getBuffers();
+			put(record::mesh);
+			putArray(buffers.px); putArray(buffers.py); putArray(buffers.pz);
+			putArray(buffers.nx); putArray(buffers.ny); putArray(buffers.nz);
+			putArray(buffers.u); putArray(buffers.v);
+			putArray(buffers.indices);
+			putArray(mesh->getNodes());
+			put(materialId);
+		} else if (auto cloud = dynamic_cast<const sphereCloud*>(object)) {
+			const sphereCloudBuffers& buffers = cloud->getBuffers();
+			std::vector<std::uint32_t> palette;
+			for (const auto& entry : buffers.palette) palette.push_back(addMaterial(entry));
+			put(record::sphereCloud);
+			putArray(buffers.cx); putArray(buffers.cy); putArray(buffers.cz);
+			putArray(buffers.radius);
+			putArray(buffers.dx); putArray(buffers.dy); putArray(buffers.dz);
+			putArray(buffers.materialIndex);
+			putArray(palette);
+			putArray(cloud->getNodes());
+			put(static_cast<std::uint64_t>(cloud->getSphereCount()));
+			put(cloud->getStartTime());
+			put(cloud->getEndTime());
+			put(cloud->getMagnitude());
+		} else if (!putRectangle<0>(object, record::yzRectangle) && !putRectangle<1>(object, record::xzRectangle)
+			&& !putRectangle<2>(object, record::xyRectangle)) {
+			return unsupported("object", *source);
+		}
+
+		std::uint32_t id = static_cast<std::uint32_t>(m_objects.size());
+		m_objects.emplace(source.get(), id);
+		return id;
+	}
+
+	// Checks a stored tree against the layout linearBvh, indexedMesh and sphereCloud flatten to:
+	// depth first with each interior node's second child right after the first child's subtree,
+	// leaves no deeper than bvhBuilder::s_maxDepth, which sizes the traversal stacks, and leaf
+	// runs, rounded up to leafAlign, inside itemCount. Returns the index past the subtree at
+	// index, or 0 if it is malformed.
+	template <typename Node>
+	size_t checkSubtree(const std::vector<Node>& nodes, size_t index, int depth, size_t itemCount, size_t leafAlign) {
+		if (index >= nodes.size()) return 0;
+		const Node& node = nodes[index];
+		if (node.count > 0) {
+			const size_t run = (size_t(node.count) + leafAlign - 1) / leafAlign * leafAlign;
+			return node.offset <= itemCount && run <= itemCount - node.offset ? index + 1 : 0;
+		}
+		if (depth >= bvhBuilder::s_maxDepth) return 0;
+		const size_t second = checkSubtree(nodes, index + 1, depth + 1, itemCount, leafAlign);
+		if (second == 0 || node.offset != second) return 0;
+		return checkSubtree(nodes, second, depth + 1, itemCount, leafAlign);
+	}
+
+	template <typename Node>
+	bool isValidTree(const std::vector<Node>& nodes, size_t itemCount, size_t leafAlign = 1) {
+		return nodes.empty() || checkSubtree(nodes, 0, 0, itemCount, leafAlign) == nodes.size();
+	}
+
+	// Walks the mapped bytes. Every read is checked against the end of the file, every index
+	// against the records or arrays it refers to and every tree with isValidTree, so a truncated
+	// or stale file fails instead of crashing.
+	class reader {
+	public:
+		reader(const char* begin, const char* end, sceneArena& arena) : m_cursor(begin), m_end(end), m_arena(arena) {}
+
+		template <typename T>
+		bool get(T& value) { return getBlock(&value, 1); }
+
+		template <typename T>
+		bool getBlock(T* values, size_t count) {
+			if (count > size_t(m_end - m_cursor) / sizeof(T)) return false;
+			if (count == 0) return true; // Empty vectors may have no storage to copy into
+			std::memcpy(values, m_cursor, count * sizeof(T));
+			m_cursor += count * sizeof(T);
+			return true;
+		}
+
+		template <typename T>
+		bool getArray(std::vector<T>& values) {
+			std::uint64_t count;
+			if (!get(count) || count > std::uint64_t(m_end - m_cursor) / sizeof(T)) return false;
+			values.resize(static_cast<size_t>(count));
+			return getBlock(values.data(), values.size());
+		}
+
+		bool getTexture(shared_ptr<texture>& out) { return lookup(m_textures, out); }
+		bool getMaterial(shared_ptr<material>& out) { return lookup(m_materials, out); }
+		bool getObject(shared_ptr<hittable>& out) { return lookup(m_objects, out) && out; }
+
+		// Reads the record that starts at the cursor; the scene record fills scene and world.
+		bool readRecord(sceneSetup& scene, shared_ptr<hittable>& world, bool& finished);
+
+		size_t getObjectCount() const { return m_objects.size(); }
+
+	private:
+		template <typename T>
+		bool lookup(const std::vector<shared_ptr<T>>& source, shared_ptr<T>& out) {
+			std::uint32_t id;
+			if (!get(id)) return false;
+			if (id == none) {
+				out = nullptr;
+				return true;
+			}
+			if (id >= source.size()) return false;
+			out = source[id];
+			return true;
+		}
+
+		template <int Axis>
+		bool readRectangle() {
+			auto rectangle = m_arena.make<axisRectangle<Axis>>();
+			if (!(get(rectangle->m_a0) && get(rectangle->m_a1) && get(rectangle->m_b0) && get(rectangle->m_b1)
+				&& get(rectangle->m_k) && getMaterial(rectangle->m_material_ptr))) return false;
+			m_objects.push_back(rectangle);
+			return true;
+		}
+
+		bool readBvhNode(bool leaf);
+		bool readMesh();
+		bool readSphereCloud();
+
+	private:
+		const char* m_cursor;
+		const char* m_end;
+		sceneArena& m_arena; // Of the scene being loaded
+		std::vector<shared_ptr<texture>> m_textures;
+		std::vector<shared_ptr<material>> m_materials;
+		std::vector<shared_ptr<hittable>> m_objects;
+	};
+
+	bool reader::readRecord(sceneSetup& scene, shared_ptr<hittable>& world, bool& finished) {
+		record type;
+		if (!get(type)) return false;
+
+		switch (type) {
+		case record::solidColor: {
+			color value;
+			if (!get(value)) return false;
+			m_textures.push_back(m_arena.make<solidColor>(value));
+			return true;
+		}
+		case record::checkerTexture: {
+			shared_ptr<texture> even, odd;
+			if (!getTexture(even) || !getTexture(odd)) return false;
+			m_textures.push_back(m_arena.make<checkerTexture>(even, odd));
+			return true;
+		}
+		case record::imageTexture: {
+			std::int32_t width, height;
+			if (!get(width) || !get(height) || width <= 0 || height <= 0) return false;
+			const size_t byteCount = size_t(width) * height * imageTexture::s_bytesPerPixel;
+			if (byteCount > size_t(m_end - m_cursor)) return false;
+			m_textures.push_back(m_arena.make<imageTexture>(reinterpret_cast<const unsigned char*>(m_cursor), width, height));
+			m_cursor += byteCount;
+			return true;
+		}
+		case record::perlinTexture: {
+			const int n = perlin::getPointCount();
+			real scale;
+			std::vector<vec3> randomVectors(n);
+			std::vector<int> permutations(3 * n);
+			std::uint8_t baked;
+			aabb region;
+			if (!get(scale) || !getBlock(randomVectors.data(), n) || !getBlock(permutations.data(), 3 * n)
+				|| !get(baked) || !get(region)) return false;
+			for (int value : permutations)
+				if (value < 0 || value >= n) return false;
+			auto noise = m_arena.make<perlinTexture>(
+				scale, textureRegistry::global().adoptNoise(randomVectors.data(), permutations.data()));
+			if (baked) noise->bakeTurbulence(region);
+			m_textures.push_back(noise);
+			return true;
+		}
+		case record::lambertian:
+		case record::diffuseLight:
+		case record::isotropic: {
+			shared_ptr<texture> albedo;
+			if (!getTexture(albedo)) return false;
+			if (type == record::lambertian) m_materials.push_back(m_arena.make<lambertian>(albedo));
+			else if (type == record::diffuseLight) m_materials.push_back(m_arena.make<diffuseLight>(albedo));
+			else m_materials.push_back(m_arena.make<isotropic>(albedo));
+			return true;
+		}
+		case record::metal: {
+			color albedo;
+			real roughness;
+			if (!get(albedo) || !get(roughness)) return false;
+			m_materials.push_back(m_arena.make<metal>(albedo, roughness));
+			return true;
+		}
+		case record::dielectric: {
+			real refractionIndex;
+			if (!get(refractionIndex)) return false;
+			m_materials.push_back(m_arena.make<dielectric>(refractionIndex));
+			return true;
+		}
+		case record::sphere: {
+			auto ball = m_arena.make<sphere>();
+			if (!get(ball->m_center) || !get(ball->m_radius) || !getMaterial(ball->m_material_ptr)) return false;
+			m_objects.push_back(ball);
+			return true;
+		}
+		case record::movingSphere: {
+			auto moving = m_arena.make<movingSphere>();
+			if (!(get(moving->m_startCenter) && get(moving->m_endCenter) && get(moving->m_startTime) && get(moving->m_endTime)
+				&& get(moving->m_radius) && getMaterial(moving->m_mat_ptr))) return false;
+			m_objects.push_back(moving);
+			return true;
+		}
+		case record::box: {
+			auto cuboid = m_arena.make<box>();
+			if (!get(cuboid->m_min) || !get(cuboid->m_max) || !getMaterial(cuboid->m_material_ptr)) return false;
+			m_objects.push_back(cuboid);
+			return true;
+		}
+		case record::yzRectangle: return readRectangle<0>();
+		case record::xzRectangle: return readRectangle<1>();
+		case record::xyRectangle: return readRectangle<2>();
+		case record::instance: {
+			shared_ptr<hittable> child;
+			affineTransform toWorld;
+			if (!getObject(child) || !get(toWorld)) return false;
+			m_objects.push_back(m_arena.make<instance>(child, toWorld));
+			return true;
+		}
+		case record::constantMedium: {
+			shared_ptr<hittable> boundary;
+			real negInvDensity;
+			shared_ptr<material> phase;
+			if (!getObject(boundary) || !get(negInvDensity) || !getMaterial(phase)) return false;
+			auto medium = m_arena.make<constantMedium>(boundary, real(1), color());
+			medium->m_negInvDensity = negInvDensity;
+			medium->m_phaseFunction = phase;
+			m_objects.push_back(medium);
+			return true;
+		}
+		case record::list: {
+			std::uint64_t count;
+			if (!get(count) || count > std::uint64_t(m_end - m_cursor) / sizeof(std::uint32_t)) return false;
+			auto list = m_arena.make<hittableList>();
+			list->m_objects.resize(static_cast<size_t>(count));
+			for (auto& child : list->m_objects)
+				if (!getObject(child)) return false;
+			m_objects.push_back(list);
+			return true;
+		}
+		case record::bvhLeaf: return readBvhNode(true);
+		case record::bvhInterior: return readBvhNode(false);
+		case record::linearBvh: {
+			std::uint64_t count;
+			if (!get(count) || count > std::uint64_t(m_end - m_cursor) / sizeof(std::uint32_t)) return false;
+			auto tree = m_arena.make<linearBvh>();
+			tree->m_primitives.resize(static_cast<size_t>(count));
+			for (auto& primitive : tree->m_primitives)
+				if (!getObject(primitive)) return false;
+			if (!getArray(tree->m_nodes) || !isValidTree(tree->m_nodes, tree->m_primitives.size())) return false;
+			m_objects.push_back(tree);
+			return true;
+		}
+		case record::mesh: return readMesh();
+		case record::sphereCloud: return readSphereCloud();
+		case record::scene: {
+			std::uint64_t count;
+			if (!(get(scene.accelerator) && get(scene.background) && get(scene.lookFrom) && get(scene.lookAt) && get(scene.vFOV)
+				&& get(scene.aperture) && get(scene.aspectRatio) && get(scene.imageWidth) && get(scene.samplesPerPixel)
+				&& get(count) && count <= std::uint64_t(m_end - m_cursor) / sizeof(std::uint32_t))) return false;
+
+			scene.entities.m_objects.resize(static_cast<size_t>(count));
+			for (auto& object : scene.entities.m_objects)
+				if (!getObject(object)) return false;
+			if (!lookup(m_objects, world)) return false;
+
+			finished = true;
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	bool reader::readBvhNode(bool leaf) {
+		auto node = m_arena.make<bvhNode>();
+		if (!get(node->m_box)) return false;
+
+		if (leaf) {
+			if (!getObject(node->m_object)) return false;
+		} else {
+			shared_ptr<hittable> left, right;
+			if (!getObject(left) || !getObject(right)) return false;
+			node->m_left = std::dynamic_pointer_cast<bvhNode>(left);
+			node->m_right = std::dynamic_pointer_cast<bvhNode>(right);
+			if (!node->m_left || !node->m_right) return false;
+		}
+
+		m_objects.push_back(node);
+		return true;
+	}
+
+	bool reader::readMesh() {
+		meshBuffers buffers;
+		std::vector<linearBvh::linearNode> nodes;
+		shared_ptr<material> materialPtr;
+		if (!(getArray(buffers.px) && getArray(buffers.py) && getArray(buffers.pz)
+			&& getArray(buffers.nx) && getArray(buffers.ny) && getArray(buffers.nz)
+			&& getArray(buffers.u) && getArray(buffers.v) && getArray(buffers.indices)
+			&& getArray(nodes) && getMaterial(materialPtr))) return false;
+
+		const size_t vertexCount = buffers.px.size();
+		if (buffers.py.size() != vertexCount || buffers.pz.size() != vertexCount
+			|| buffers.ny.size() != buffers.nx.size() || buffers.nz.size() != buffers.nx.size()
+			|| buffers.v.size() != buffers.u.size() || buffers.indices.size() % 3 != 0) return false;
+		for (std::uint32_t index : buffers.indices)
+			if (index >= vertexCount) return false;
+		if (!isValidTree(nodes, buffers.getTriangleCount())) return false;
+
+		m_objects.push_back(m_arena.make<indexedMesh>(std::move(buffers), std::move(nodes), materialPtr));
+		return true;
+	}
+
+	bool reader::readSphereCloud() {
+		sphereCloudBuffers buffers;
+		std::vector<std::uint32_t> palette;
+		std::vector<sphereCloud::cloudNode> nodes;
+		std::uint64_t sphereCount;
+		real startTime, endTime;
+		float magnitude;
+		if (!(getArray(buffers.cx) && getArray(buffers.cy) && getArray(buffers.cz) && getArray(buffers.radius)
+			&& getArray(buffers.dx) && getArray(buffers.dy) && getArray(buffers.dz) && getArray(buffers.materialIndex)
+			&& getArray(palette) && getArray(nodes) && get(sphereCount) && get(startTime) && get(endTime) && get(magnitude)))
+			return false;
+
+		for (std::uint32_t id : palette) {
+			if (id >= m_materials.size()) return false;
+			buffers.palette.push_back(m_materials[id]);
+		}
+		for (std::uint32_t index : buffers.materialIndex)
+			if (index >= buffers.palette.size()) return false;
+
+		// Leaves are tested s_lanes slots at a time, so every run is checked padded.
+		const size_t slotCount = buffers.cx.size();
+		if (buffers.cy.size() != slotCount || buffers.cz.size() != slotCount || buffers.radius.size() != slotCount
+			|| buffers.materialIndex.size() != slotCount || sphereCount > slotCount) return false;
+		if (buffers.isMoving() && (buffers.dx.size() != slotCount || buffers.dy.size() != slotCount
+			|| buffers.dz.size() != slotCount)) return false;
+		if (!isValidTree(nodes, slotCount, sphereCloud::s_lanes)) return false;
+
+		m_objects.push_back(m_arena.make<sphereCloud>(
+			std::move(buffers), std::move(nodes), static_cast<size_t>(sphereCount), startTime, endTime, magnitude));
+		return true;
+	}
+}
+
+// Writes the scene and, when it is a linearBvh, the tree built over it. Fails without writing
+// if the scene holds a type the format does not cover.
+inline bool saveSceneCache(const std::string& path, int sceneId, const sceneSetup& scene, const shared_ptr<hittable>& world) {
+	using namespace sceneCacheDetail;
+	auto start = std::chrono::steady_clock::now();
+
+	writer out;
+	fileHeader header;
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.realSize = sizeof(real);
+	header.cloudLanes = sphereCloud::s_lanes;
+	header.sceneId = static_cast<std::uint32_t>(sceneId);
+	out.put(header);
+
+	std::vector<std::uint32_t> entities;
+	for (const auto& object : scene.entities.m_objects) entities.push_back(out.addObject(object));
+	std::uint32_t worldId = std::dynamic_pointer_cast<linearBvh>(world) ? out.addObject(world) : none;
+	if (!out.isValid()) return false;
+
+	out.put(record::scene);
+	out.put(scene.accelerator);
+	out.put(scene.background);
+	out.put(scene.lookFrom);
+	out.put(scene.lookAt);
+	out.put(scene.vFOV);
+	out.put(scene.aperture);
+	out.put(scene.aspectRatio);
+	out.put(scene.imageWidth);
+	out.put(scene.samplesPerPixel);
+	out.putArray(entities);
+	out.put(worldId);
+
+	// Same temporary file and rename as checkpoints, so an interrupted write leaves no torn cache.
+	const std::string tempPath = path + ".tmp";
+	std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+	if (!file) {
+		std::cerr << "ERROR: Could not open scene cache '" << tempPath << "' for writing.\n";
+		return false;
+	}
+
+	const std::vector<char>& bytes = out.getBytes();
+	bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	ok = std::fclose(file) == 0 && ok;
+	if (ok) {
+		std::remove(path.c_str());
+		ok = std::rename(tempPath.c_str(), path.c_str()) == 0;
+	}
+
+	if (!ok) {
+		std::cerr << "ERROR: Failed to write scene cache '" << path << "'.\n";
+		return false;
+	}
+
+	std::cerr << "sceneCache: wrote scene " << sceneId << " (" << out.getObjectCount() << " objects, "
+		<< bytes.size() / (1024.0 * 1024.0) << " MB) to '" << path << "' in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+	return true;
+}
+
+// Fills scene from the file if it was written for sceneId by a matching build. world receives
+// the saved top-level linearBvh, or null when the file has none.
+inline bool loadSceneCache(const std::string& path, int sceneId, sceneSetup& scene, shared_ptr<hittable>& world) {
+	using namespace sceneCacheDetail;
+	auto start = std::chrono::steady_clock::now();
+
+	if (!std::ifstream(path)) return false; // No cache yet; mappedFile would report the failed open
+	mappedFile file(path);
+	if (!file.isOpen()) return false;
+
+	sceneSetup loaded;
+	reader in(file.begin(), file.end(), loaded.arena);
+	fileHeader header;
+	if (!in.get(header) || std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version
+		|| header.realSize != sizeof(real) || header.cloudLanes != std::uint32_t(sphereCloud::s_lanes)) {
+		std::cerr << "Scene cache '" << path << "' was written by a different build, rebuilding the scene.\n";
+		return false;
+	}
+	if (header.sceneId != std::uint32_t(sceneId)) {
+		std::cerr << "Scene cache '" << path << "' holds scene " << header.sceneId << ", rebuilding the scene.\n";
+		return false;
+	}
+
+	shared_ptr<hittable> loadedWorld;
+	bool finished = false;
+	while (!finished) {
+		if (!in.readRecord(loaded, loadedWorld, finished)) {
+			std::cerr << "Scene cache '" << path << "' is unreadable, rebuilding the scene.\n";
+			return false;
+		}
+	}
+
+	scene = std::move(loaded);
+	world = loadedWorld;
+
+	std::cerr << "sceneCache: loaded scene " << sceneId << " (" << in.getObjectCount() << " objects, "
+		<< file.getSize() / (1024.0 * 1024.0) << " MB) from '" << path << "' in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+	return true;
+}
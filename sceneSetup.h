@@ -0,0 +1,23 @@
+#pragma once
+
+#include "utils.h"
+#include "hittableList.h"
+#include "materialPool.h"
+#include "sceneArena.h"
+#include "options.h"
+
+// Scene contents along with the view and render settings it was composed for.
+struct sceneSetup {
+	sceneArena arena; // Storage of the objects, materials and textures below; declared first so it is freed last
+	hittableList entities;
+	materialPool materials{ arena }; // Shared by the scenes that hand out a material per object
+	acceleratorType accelerator = acceleratorType::list;
+	color background = color(0.0, 0.0, 0.0);
+	point3 lookFrom;
+	point3 lookAt;
+	double vFOV = 0.0;
+	double aperture = 0.0;
+	double aspectRatio = 16.0 / 9.0;
+	int imageWidth = 400;
+	int samplesPerPixel = 100;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+// SIMD paths compiled into this build: SSE wherever SSE2 is the baseline (every x86-64
+// compiler), AVX when the compiler is told it may use it, for example with -mavx or
+// -march=native. Code with vector paths keeps a scalar version for everything else.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_SIMD_SSE 1
+#include <immintrin.h>
+#endif
+
+#if defined(RT_SIMD_SSE) && defined(__AVX__)
+#define RT_SIMD_AVX 1
+#endif
@@ -2,22 +2,69 @@
 
 #include "hittable.h"
 
+#include <cmath>
+#include <utility>
+
+// Nearest root of |oc + t d|^2 = radius^2 inside [tMin, tMax], where oc is the ray origin
+// relative to the center. Follows "Precision Improvements for Ray/Sphere Intersection" (Ray
+// Tracing Gems, chapter 7): the discriminant comes from the squared distance between the
+// center and the ray's closest point instead of b^2 - ac, which cancels for small or distant
+// spheres, and the second root is c / q instead of a difference of nearly equal terms.
+template <typename T>
+inline bool intersectSphere(const vec3T<T>& oc, const vec3T<T>& d, T radius, T tMin, T tMax, T& root) {
+    T a = d.lengthSquared();
+    T halfB = dot(oc, d);
+    T c = oc.lengthSquared() - radius * radius;
+
+    vec3T<T> closest = oc - (halfB / a) * d;
+    T discriminant = a * (radius * radius - closest.lengthSquared());
+    if (discriminant < 0) return false; // No intersection
+
+    T q = -(halfB + std::copysign(sqrt(discriminant), halfB));
+    if (q == 0) return false;
+
+    T near = c / q;
+    T far = q / a;
+    if (near > far) std::swap(near, far);
+
+    // Find the nearest root that lies in the acceptable range.
+    root = near;
+    if (root < tMin || tMax < root) {
+        root = far;
+        if (root < tMin || tMax < root)
+            return false;
+    }
+
+    return true;
+}
+
+// Moves a computed hit point back onto the surface, removing the error r.resize(t) picks up.
+template <typename T>
+inline vec3T<T> projectOntoSphere(const vec3T<T>& p, const vec3T<T>& center, T radius) {
+    vec3T<T> offset = p - center;
+    return center + (std::fabs(radius) / offset.length()) * offset;
+}
+
 class sphere : public hittable {
 public:
     sphere() : m_center(vec3(0.0, 0.0, 0.0)), m_radius(0.0) {}
-	sphere(point3 center, double r, shared_ptr<material> material_ptr)
+	sphere(point3 center, real r, shared_ptr<material> material_ptr)
         : m_center(center), m_radius(r), m_material_ptr(material_ptr) {};
 
-	virtual bool hit(const ray& r, double tMin, double tMax, hitRecord& record) const override;
-    virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const override;
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+        return hitDeferred(*this, r, tMin, tMax, record);
+    }
+
+    virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+    virtual void fillAttributes(const ray& r, hitRecord& record) const override;
+    virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override;
 
 public:
 	point3 m_center;
-	double m_radius;
+	real m_radius;
     shared_ptr<material> m_material_ptr;
 
-private:
-    static void getUV(const point3& p, double& u, double& v) {
+    static void getUV(const point3& p, real& u, real& v) {
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0,1] of angle around the Y axis from X=-1.
         // v: returned value [0,1] of angle from Y=-1 to Y=+1.
@@ -31,37 +78,36 @@ private:
         u = phi / (2 * pi);
         v = theta / pi;
     }
-};
-
-bool sphere::hit(const ray& r, double tMin, double tMax, hitRecord& record) const {
-	vec3 oc = r.getOrigin() - m_center;
-	double a = r.getDirection().lengthSquared();
-    double half_b = dot(oc, r.getDirection());
-    double c = oc.lengthSquared() - m_radius * m_radius;
 
-    double discriminant = half_b * half_b - a * c;
-    if (discriminant < 0.0) return false; // No intersection
-    double sqrtd = sqrt(discriminant);
-
-    // Find the nearest root that lies in the acceptable range.
-    double root = (-half_b - sqrtd) / a;
-    if (root < tMin || tMax < root) {
-        root = (-half_b + sqrtd) / a;
-        if (root < tMin || tMax < root)
-            return false;
+    // Derivatives of the point at radius times p with respect to getUV's u and v. The v
+    // derivative keeps a tiny length at the poles, where u is undefined.
+    static void getTangents(const point3& p, real radius, vec3& dpdu, vec3& dpdv) {
+        real ring = std::fmax(std::sqrt(p.x() * p.x() + p.z() * p.z()), real(1e-6));
+        dpdu = (2 * pi * radius) * vec3(p.z(), 0.0, -p.x());
+        dpdv = (pi * radius) * vec3(-p.x() * p.y() / ring, ring, -p.y() * p.z() / ring);
     }
+};
+
+bool sphere::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+    real root;
+    if (!intersectSphere(r.getOrigin() - m_center, r.getDirection(), m_radius, tMin, tMax, root))
+        return false;
 
     record.t = root;
-    record.point = r.resize(record.t);
+    record.object = this;
+    return true;
+}
+
+void sphere::fillAttributes(const ray& r, hitRecord& record) const {
+    record.point = projectOntoSphere(r.resize(record.t), m_center, m_radius);
     vec3 outwardNormal = (record.point - m_center) / m_radius;
     record.setFaceNormal(r, outwardNormal);
     getUV(outwardNormal, record.u, record.v);
-    record.material_ptr = m_material_ptr;
-
-    return true;
+    getTangents(outwardNormal, m_radius, record.dpdu, record.dpdv);
+    record.material_ptr = m_material_ptr.get();
 }
 
-bool sphere::getAABB(double startTime, double endTime, aabb& outputBox) const {
+bool sphere::getAABB(real startTime, real endTime, aabb& outputBox) const {
     outputBox = aabb(
         m_center - vec3(m_radius, m_radius, m_radius),
         m_center + vec3(m_radius, m_radius, m_radius)
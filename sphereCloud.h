@@ -0,0 +1,498 @@
+#pragma once
+
+#include "utils.h"
+
+#include "hittable.h"
+#include "sphere.h"
+#include "bvhBuilder.h"
+#include "wideBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Spheres as separate float arrays (structure of arrays) with a 32-bit index into a material
+// palette. Motion is optional: once any sphere moves, every sphere has a center offset over the
+// shutter, zero for the still ones.
+struct sphereCloudBuffers {
+	std::vector<float> cx, cy, cz;
+	std::vector<float> radius;
+	std::vector<float> dx, dy, dz; // End center minus start center, empty when nothing moves
+	std::vector<std::uint32_t> materialIndex;
+	std::vector<shared_ptr<material>> palette;
+
+	size_t getSphereCount() const { return cx.size(); }
+	bool isMoving() const { return !dx.empty(); }
+
+	void reserve(size_t count, bool moving) {
+		cx.reserve(count);
+		cy.reserve(count);
+		cz.reserve(count);
+		radius.reserve(count);
+		materialIndex.reserve(count);
+		if (moving) {
+			dx.reserve(count);
+			dy.reserve(count);
+			dz.reserve(count);
+		}
+	}
+
+	std::uint32_t addMaterial(shared_ptr<material> material_ptr) {
+		palette.push_back(material_ptr);
+		return static_cast<std::uint32_t>(palette.size() - 1);
+	}
+
+	void addSphere(const point3& center, real r, std::uint32_t material) {
+		cx.push_back(static_cast<float>(center.x()));
+		cy.push_back(static_cast<float>(center.y()));
+		cz.push_back(static_cast<float>(center.z()));
+		radius.push_back(static_cast<float>(r));
+		materialIndex.push_back(material);
+
+		if (isMoving()) {
+			dx.push_back(0.0f);
+			dy.push_back(0.0f);
+			dz.push_back(0.0f);
+		}
+	}
+
+	void addMovingSphere(const point3& startCenter, const point3& endCenter, real r, std::uint32_t material) {
+		// Spheres added before the first moving one get zero offsets here.
+		const size_t previous = cx.size();
+		addSphere(startCenter, r, material);
+		dx.resize(previous);
+		dy.resize(previous);
+		dz.resize(previous);
+
+		vec3 offset = endCenter - startCenter;
+		dx.push_back(static_cast<float>(offset.x()));
+		dy.push_back(static_cast<float>(offset.y()));
+		dz.push_back(static_cast<float>(offset.z()));
+	}
+
+	size_t getByteSize() const {
+		return (cx.capacity() + cy.capacity() + cz.capacity() + radius.capacity() + dx.capacity() + dy.capacity()
+			+ dz.capacity()) * sizeof(float) + materialIndex.capacity() * sizeof(std::uint32_t)
+			+ palette.capacity() * sizeof(shared_ptr<material>);
+	}
+};
+
+// Large numbers of spheres without an object per sphere. The cloud keeps its own BVH with float
+// bounds over the sphere arrays, reordered so every leaf is a contiguous run padded to the SIMD
+// width. A leaf first tests all its spheres at once in float, with the sphere radii widened by
+// the float rounding error so no hit is lost, and only the spheres that pass are intersected
+// exactly with intersectSphere. Point, normal, UV and material wait for fillAttributes.
+class sphereCloud : public hittable {
+public:
+	sphereCloud() {}
+	sphereCloud(sphereCloudBuffers buffers, real startTime = 0, real endTime = 1);
+
+	// Same depth-first layout as linearBvh, with float bounds in the rows wideBvhDetail::rayData
+	// indexes (min x, y, z, then max x, y, z).
+	struct cloudNode {
+		float bounds[6];
+		std::uint32_t offset; // Leaf: first slot of the sphere arrays, interior: index of the second child
+		std::uint16_t count;  // Spheres in a leaf, zero for interior nodes
+		std::uint8_t axis;    // Split axis of an interior node
+	};
+
+	// Restores a cloud saved with its tree; the buffers are in leaf order and padded for s_lanes.
+	sphereCloud(sphereCloudBuffers buffers, std::vector<cloudNode> nodes, size_t sphereCount, real startTime, real endTime, float magnitude)
+		: m_buffers(std::move(buffers)), m_nodes(std::move(nodes)), m_sphereCount(sphereCount), m_startTime(startTime),
+		  m_endTime(endTime), m_magnitude(magnitude) {}
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	// Keeps the sphere's slot as primitive.
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+	virtual void fillAttributes(const ray& r, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		if (m_nodes.empty()) return false;
+		const float* b = m_nodes[0].bounds;
+		outputBox = aabb(point3(b[0], b[1], b[2]), point3(b[3], b[4], b[5]));
+		return true;
+	}
+
+	size_t getSphereCount() const { return m_sphereCount; }
+	size_t getNodeCount() const { return m_nodes.size(); }
+	size_t getByteSize() const { return m_buffers.getByteSize() + m_nodes.capacity() * sizeof(cloudNode); }
+
+	const sphereCloudBuffers& getBuffers() const { return m_buffers; }
+	const std::vector<cloudNode>& getNodes() const { return m_nodes; }
+	real getStartTime() const { return m_startTime; }
+	real getEndTime() const { return m_endTime; }
+	float getMagnitude() const { return m_magnitude; }
+
+public:
+#ifdef RT_SIMD_AVX
+	static const int s_lanes = 8;
+#elif defined(RT_SIMD_SSE)
+	static const int s_lanes = 4;
+#else
+	static const int s_lanes = 1;
+#endif
+
+private:
+	// The ray in float for the leaf test, with the center offset fraction at its time.
+	struct leafRay {
+		float origin[3];
+		float direction[3];
+		float inverseLengthSquared;
+		float inverseLength;
+		float fraction;
+		float pad;
+	};
+
+	// Flattens the tree and gives every leaf its padded slot range; slotCount ends as the total.
+	std::uint32_t flatten(const bvhBuilder& builder, std::uint32_t nodeIndex, size_t& slotCount);
+
+	// Moves the spheres from input order to their leaves' slots within the same arrays.
+	void reorder(const bvhBuilder& builder, size_t slotCount);
+
+	template <typename Function>
+	void forEachArray(Function function);
+
+	bool hitNode(const cloudNode& node, const wideBvhDetail::rayData& data, float tMin, float tMax) const;
+	unsigned testLeaf(const leafRay& lr, std::uint32_t slot, int count, float tMin, float tMax) const;
+
+	real timeFraction(const ray& r) const {
+		if (!m_buffers.isMoving()) return 0;
+		return std::clamp((r.getTime() - m_startTime) / (m_endTime - m_startTime), real(0), real(1));
+	}
+
+	point3 centerAt(std::uint32_t slot, real fraction) const {
+		point3 center(m_buffers.cx[slot], m_buffers.cy[slot], m_buffers.cz[slot]);
+		if (m_buffers.isMoving())
+			center += fraction * vec3(m_buffers.dx[slot], m_buffers.dy[slot], m_buffers.dz[slot]);
+		return center;
+	}
+
+private:
+	static const int s_maxLeafSize = 8;
+
+	sphereCloudBuffers m_buffers; // In leaf order, every leaf padded to a multiple of s_lanes
+	std::vector<cloudNode> m_nodes;
+	size_t m_sphereCount = 0;
+	real m_startTime = 0;
+	real m_endTime = 1;
+	float m_magnitude = 0; // Largest coordinate any sphere reaches, for the float error bound
+};
+
+sphereCloud::sphereCloud(sphereCloudBuffers buffers, real startTime, real endTime)
+	: m_buffers(std::move(buffers)), m_sphereCount(m_buffers.getSphereCount()), m_startTime(startTime), m_endTime(endTime) {
+	if (m_sphereCount == 0) return;
+
+	std::vector<buildBounds> bounds(m_sphereCount);
+	for (size_t i = 0; i < m_sphereCount; i++) {
+		point3 center(m_buffers.cx[i], m_buffers.cy[i], m_buffers.cz[i]);
+		real r = std::fabs(real(m_buffers.radius[i]));
+		vec3 extent(r, r, r);
+		aabb box(center - extent, center + extent);
+
+		if (m_buffers.isMoving()) {
+			point3 endCenter = center + vec3(m_buffers.dx[i], m_buffers.dy[i], m_buffers.dz[i]);
+			growBox(box, aabb(endCenter - extent, endCenter + extent));
+		}
+
+		bounds[i] = buildBounds::fromBox(box);
+		for (int a = 0; a < 3; a++)
+			m_magnitude = std::max(m_magnitude, float(std::max(std::fabs(box.m_min[a]), std::fabs(box.m_max[a]))));
+	}
+
+	// One SIMD pass over a leaf costs about as much as a node visit.
+	bvhBuilder builder(std::move(bounds), s_maxLeafSize, bvhBuilder::s_traversalCost / s_lanes);
+	builder.build();
+
+	m_nodes.reserve(builder.getNodeCount());
+	size_t slotCount = 0;
+	flatten(builder, builder.getRoot(), slotCount);
+	reorder(builder, slotCount);
+
+	std::cerr << "sphereCloud: " << m_sphereCount << " spheres, " << m_buffers.getSphereCount() << " slots, "
+		<< m_nodes.size() << " nodes built in " << builder.getBuildMilliseconds() << " ms, "
+		<< getByteSize() / (1024.0 * 1024.0) << " MB (" << double(getByteSize()) / m_sphereCount << " bytes/sphere)\n";
+}
+
+std::uint32_t sphereCloud::flatten(const bvhBuilder& builder, std::uint32_t nodeIndex, size_t& slotCount) {
+	const bvhBuildNode& node = builder.getNode(nodeIndex);
+	std::uint32_t flatIndex = static_cast<std::uint32_t>(m_nodes.size());
+	m_nodes.push_back({ {}, 0, static_cast<std::uint16_t>(node.count), node.axis });
+
+	for (int a = 0; a < 3; a++) {
+		m_nodes[flatIndex].bounds[a] = roundDown(node.box.m_min[a]);
+		m_nodes[flatIndex].bounds[a + 3] = roundUp(node.box.m_max[a]);
+	}
+
+	if (node.count > 0) {
+		m_nodes[flatIndex].offset = static_cast<std::uint32_t>(slotCount);
+		slotCount += (node.count + s_lanes - 1) / s_lanes * s_lanes;
+	} else {
+		flatten(builder, node.firstChild, slotCount);
+		std::uint32_t second = flatten(builder, node.firstChild + 1, slotCount);
+		m_nodes[flatIndex].offset = second;
+	}
+
+	return flatIndex;
+}
+
+template <typename Function>
+void sphereCloud::forEachArray(Function function) {
+	for (std::vector<float>* values : { &m_buffers.cx, &m_buffers.cy, &m_buffers.cz, &m_buffers.radius })
+		function(*values);
+	if (m_buffers.isMoving()) {
+		for (std::vector<float>* values : { &m_buffers.dx, &m_buffers.dy, &m_buffers.dz })
+			function(*values);
+	}
+	function(m_buffers.materialIndex);
+}
+
+void sphereCloud::reorder(const bvhBuilder& builder, size_t slotCount) {
+	// Slot i takes sphere getPrimitive(i): each cycle of that permutation is rotated through
+	// one saved value per array.
+	std::vector<bool> placed(m_sphereCount);
+	for (std::uint32_t first = 0; first < m_sphereCount; first++) {
+		if (placed[first]) continue;
+		forEachArray([&](auto& values) {
+			const auto saved = values[first];
+			std::uint32_t slot = first;
+			for (std::uint32_t from = builder.getPrimitive(slot); from != first; from = builder.getPrimitive(slot)) {
+				values[slot] = values[from];
+				slot = from;
+			}
+			values[slot] = saved;
+		});
+		for (std::uint32_t slot = first; !placed[slot]; slot = builder.getPrimitive(slot)) placed[slot] = true;
+	}
+
+	// Leaves hold consecutive runs in node order, and a padded run never starts before its
+	// source, so moving the last leaf first overwrites nothing still to be moved. Padding
+	// slots are zeroed; testLeaf masks them off and they are never read as spheres.
+	forEachArray([slotCount](auto& values) {
+		values.reserve(slotCount);
+		values.resize(slotCount);
+	});
+	size_t sourceEnd = m_sphereCount;
+	for (auto node = m_nodes.rbegin(); node != m_nodes.rend(); ++node) {
+		if (node->count == 0) continue;
+		const size_t sourceStart = sourceEnd - node->count;
+		const size_t slot = node->offset;
+		const size_t paddedEnd = slot + (node->count + s_lanes - 1) / s_lanes * s_lanes;
+		forEachArray([&](auto& values) {
+			if (slot != sourceStart)
+				std::copy_backward(values.begin() + sourceStart, values.begin() + sourceEnd, values.begin() + slot + node->count);
+			std::fill(values.begin() + slot + node->count, values.begin() + paddedEnd, 0);
+		});
+		sourceEnd = sourceStart;
+	}
+}
+
+bool sphereCloud::hitNode(const cloudNode& node, const wideBvhDetail::rayData& data, float tMin, float tMax) const {
+	for (int a = 0; a < 3; a++) {
+		float t0 = (node.bounds[data.nearRow[a]] - data.nearOrigin[a]) * data.inverseDirection[a];
+		float t1 = (node.bounds[data.farRow[a]] - data.farOrigin[a]) * data.inverseDirection[a];
+		tMin = t0 > tMin ? t0 : tMin;
+		tMax = t1 < tMax ? t1 : tMax;
+	}
+	return tMin <= tMax * wideBvhDetail::farScale;
+}
+
+// Bit per sphere of the leaf whose widened sphere the ray passes through within [tMin, tMax]:
+// the distance from the center to the ray's closest point is at most the radius, and the
+// closest point lies no further than a radius outside the range.
+unsigned sphereCloud::testLeaf(const leafRay& lr, std::uint32_t slot, int count, float tMin, float tMax) const {
+	const bool moving = m_buffers.isMoving();
+	unsigned mask = 0;
+
+#ifdef RT_SIMD_AVX
+	const __m256 ox = _mm256_set1_ps(lr.origin[0]), oy = _mm256_set1_ps(lr.origin[1]), oz = _mm256_set1_ps(lr.origin[2]);
+	const __m256 dx = _mm256_set1_ps(lr.direction[0]), dy = _mm256_set1_ps(lr.direction[1]), dz = _mm256_set1_ps(lr.direction[2]);
+	const __m256 fraction = _mm256_set1_ps(lr.fraction);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	for (int c = 0; c < count; c += 8) {
+		const std::uint32_t s = slot + c;
+		__m256 x = _mm256_loadu_ps(&m_buffers.cx[s]), y = _mm256_loadu_ps(&m_buffers.cy[s]), z = _mm256_loadu_ps(&m_buffers.cz[s]);
+		if (moving) {
+			x = _mm256_add_ps(x, _mm256_mul_ps(fraction, _mm256_loadu_ps(&m_buffers.dx[s])));
+			y = _mm256_add_ps(y, _mm256_mul_ps(fraction, _mm256_loadu_ps(&m_buffers.dy[s])));
+			z = _mm256_add_ps(z, _mm256_mul_ps(fraction, _mm256_loadu_ps(&m_buffers.dz[s])));
+		}
+		x = _mm256_sub_ps(x, ox);
+		y = _mm256_sub_ps(y, oy);
+		z = _mm256_sub_ps(z, oz);
+
+		__m256 along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, dx), _mm256_mul_ps(y, dy)), _mm256_mul_ps(z, dz));
+		__m256 tClosest = _mm256_mul_ps(along, _mm256_set1_ps(lr.inverseLengthSquared));
+		x = _mm256_sub_ps(x, _mm256_mul_ps(tClosest, dx));
+		y = _mm256_sub_ps(y, _mm256_mul_ps(tClosest, dy));
+		z = _mm256_sub_ps(z, _mm256_mul_ps(tClosest, dz));
+		__m256 distanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+
+		__m256 reach = _mm256_add_ps(_mm256_andnot_ps(signBit, _mm256_loadu_ps(&m_buffers.radius[s])), _mm256_set1_ps(lr.pad));
+		__m256 reachT = _mm256_mul_ps(reach, _mm256_set1_ps(lr.inverseLength));
+		__m256 inside = _mm256_cmp_ps(distanceSquared, _mm256_mul_ps(reach, reach), _CMP_LE_OQ);
+		inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(tClosest, reachT), _mm256_set1_ps(tMin), _CMP_GE_OQ));
+		inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_sub_ps(tClosest, reachT), _mm256_set1_ps(tMax), _CMP_LE_OQ));
+		mask |= unsigned(_mm256_movemask_ps(inside)) << c;
+	}
+#elif defined(RT_SIMD_SSE)
+	const __m128 ox = _mm_set1_ps(lr.origin[0]), oy = _mm_set1_ps(lr.origin[1]), oz = _mm_set1_ps(lr.origin[2]);
+	const __m128 dx = _mm_set1_ps(lr.direction[0]), dy = _mm_set1_ps(lr.direction[1]), dz = _mm_set1_ps(lr.direction[2]);
+	const __m128 fraction = _mm_set1_ps(lr.fraction);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	for (int c = 0; c < count; c += 4) {
+		const std::uint32_t s = slot + c;
+		__m128 x = _mm_loadu_ps(&m_buffers.cx[s]), y = _mm_loadu_ps(&m_buffers.cy[s]), z = _mm_loadu_ps(&m_buffers.cz[s]);
+		if (moving) {
+			x = _mm_add_ps(x, _mm_mul_ps(fraction, _mm_loadu_ps(&m_buffers.dx[s])));
+			y = _mm_add_ps(y, _mm_mul_ps(fraction, _mm_loadu_ps(&m_buffers.dy[s])));
+			z = _mm_add_ps(z, _mm_mul_ps(fraction, _mm_loadu_ps(&m_buffers.dz[s])));
+		}
+		x = _mm_sub_ps(x, ox);
+		y = _mm_sub_ps(y, oy);
+		z = _mm_sub_ps(z, oz);
+
+		__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, dx), _mm_mul_ps(y, dy)), _mm_mul_ps(z, dz));
+		__m128 tClosest = _mm_mul_ps(along, _mm_set1_ps(lr.inverseLengthSquared));
+		x = _mm_sub_ps(x, _mm_mul_ps(tClosest, dx));
+		y = _mm_sub_ps(y, _mm_mul_ps(tClosest, dy));
+		z = _mm_sub_ps(z, _mm_mul_ps(tClosest, dz));
+		__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+
+		__m128 reach = _mm_add_ps(_mm_andnot_ps(signBit, _mm_loadu_ps(&m_buffers.radius[s])), _mm_set1_ps(lr.pad));
+		__m128 reachT = _mm_mul_ps(reach, _mm_set1_ps(lr.inverseLength));
+		__m128 inside = _mm_cmple_ps(distanceSquared, _mm_mul_ps(reach, reach));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(tClosest, reachT), _mm_set1_ps(tMin)));
+		inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_sub_ps(tClosest, reachT), _mm_set1_ps(tMax)));
+		mask |= unsigned(_mm_movemask_ps(inside)) << c;
+	}
+#else
+	for (int c = 0; c < count; c++) {
+		const std::uint32_t s = slot + c;
+		float offset[3] = { m_buffers.cx[s], m_buffers.cy[s], m_buffers.cz[s] };
+		if (moving) {
+			offset[0] += lr.fraction * m_buffers.dx[s];
+			offset[1] += lr.fraction * m_buffers.dy[s];
+			offset[2] += lr.fraction * m_buffers.dz[s];
+		}
+
+		float along = 0.0f;
+		for (int a = 0; a < 3; a++) {
+			offset[a] -= lr.origin[a];
+			along += offset[a] * lr.direction[a];
+		}
+
+		float tClosest = along * lr.inverseLengthSquared;
+		float distanceSquared = 0.0f;
+		for (int a = 0; a < 3; a++) {
+			float p = offset[a] - tClosest * lr.direction[a];
+			distanceSquared += p * p;
+		}
+
+		float reach = std::fabs(m_buffers.radius[s]) + lr.pad;
+		float reachT = reach * lr.inverseLength;
+		if (distanceSquared <= reach * reach && tClosest + reachT >= tMin && tClosest - reachT <= tMax)
+			mask |= 1u << c;
+	}
+#endif
+
+	return mask & ((1u << count) - 1);
+}
+
+bool sphereCloud::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	using namespace wideBvhDetail;
+	if (m_nodes.empty()) return false;
+
+	const rayData data = prepareRay(r);
+	const point3 origin = r.getOrigin();
+	const vec3 direction = r.getDirection();
+	const bool directionIsNegative[3] = { direction.x() < 0, direction.y() < 0, direction.z() < 0 };
+	const real fraction = timeFraction(r);
+
+	leafRay lr;
+	float originMagnitude = 0.0f;
+	for (int a = 0; a < 3; a++) {
+		lr.origin[a] = static_cast<float>(origin[a]);
+		lr.direction[a] = static_cast<float>(direction[a]);
+		originMagnitude = std::max(originMagnitude, std::fabs(lr.origin[a]));
+	}
+	const double lengthSquared = direction.lengthSquared();
+	lr.inverseLengthSquared = static_cast<float>(1.0 / lengthSquared);
+	lr.inverseLength = static_cast<float>(1.0 / std::sqrt(lengthSquared));
+	lr.fraction = static_cast<float>(fraction);
+	// A few float roundings of the largest coordinate involved, well above the error of the test.
+	lr.pad = 32.0f * FLT_EPSILON * (m_magnitude + originMagnitude);
+
+	const float floatMin = roundDown(tMin);
+	float floatMax = roundUp(tMax);
+
+	std::uint32_t stack[bvhBuilder::s_maxDepth];
+	int stackSize = 0;
+	std::uint32_t current = 0;
+
+	std::uint32_t closest = 0;
+	bool hasHit = false;
+
+	while (true) {
+		const cloudNode& node = m_nodes[current];
+
+		if (hitNode(node, data, floatMin, floatMax)) {
+			if (node.count > 0) {
+				unsigned mask = testLeaf(lr, node.offset, node.count, floatMin, floatMax);
+				while (mask != 0) {
+					int lane = 0;
+					while (!(mask & (1u << lane))) lane++;
+					mask &= mask - 1;
+
+					const std::uint32_t s = node.offset + lane;
+					real root;
+					if (intersectSphere(origin - centerAt(s, fraction), direction, real(m_buffers.radius[s]), tMin, tMax, root)) {
+						hasHit = true;
+						tMax = root;
+						floatMax = roundUp(tMax);
+						closest = s;
+					}
+				}
+			} else if (directionIsNegative[node.axis]) {
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) break;
+		current = stack[--stackSize];
+	}
+
+	if (!hasHit) return false;
+
+	record.t = tMax;
+	record.object = this;
+	record.primitive = closest;
+	return true;
+}
+
+void sphereCloud::fillAttributes(const ray& r, hitRecord& record) const {
+	const real fraction = timeFraction(r);
+	const std::uint32_t slot = record.primitive;
+	const point3 center = centerAt(slot, fraction);
+	const real radius = m_buffers.radius[slot];
+
+	record.point = projectOntoSphere(r.resize(record.t), center, radius);
+	vec3 outwardNormal = (record.point - center) / radius;
+	record.setFaceNormal(r, outwardNormal);
+	sphere::getUV(outwardNormal, record.u, record.v);
+	sphere::getTangents(outwardNormal, radius, record.dpdu, record.dpdv);
+	record.material_ptr = m_buffers.palette[m_buffers.materialIndex[slot]].get();
+}
@@ -0,0 +1,107 @@
+// Regression test for BVH depth: spheres at geometrically growing distances make every SAH
+// split peel off a single sphere, which used to build trees 86 (x = 1.2^i) to 266 (x = 2^i)
+// levels deep and overflow the fixed traversal stacks. Build and run from the repository root:
+//
+//     g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread tests/bvhDepthTest.cpp -o bvhDepthTest
+//     ./bvhDepthTest
+//
+// The sanitizers catch a stack overrun; without them the test still checks the depth of the
+// builds and compares every accelerator's hits with a brute-force search.
+#include "../utils.h"
+
+#include "../material.h"
+#include "../hittable.h"
+#include "../hittableList.h"
+#include "../sphere.h"
+#include "../sphereCloud.h"
+#include "../tlas.h"
+#include "../motionBvh.h"
+#include "../bvh.h"
+#include "../linearBvh.h"
+#include "../wideBvh.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string& what) {
+		if (!condition) {
+			std::cerr << "FAILED: " << what << "\n";
+			failures++;
+		}
+	}
+
+	// One ray straight down onto each sphere, which has to descend to that sphere's leaf, plus
+	// one along the row that passes through every box.
+	std::vector<ray> probeRays(const std::vector<point3>& centers) {
+		std::vector<ray> rays;
+		for (const point3& center : centers)
+			rays.push_back(ray(center + vec3(0, 2 * center.x(), 0), vec3(0, -1, 0), 0.0));
+		rays.push_back(ray(point3(-1, 0, 0), vec3(1, 0, 0), 0.0));
+		return rays;
+	}
+
+	void checkAccelerator(const std::string& name, const hittable& tree, const hittableList& reference, const std::vector<ray>& rays) {
+		int mismatches = 0;
+		for (const ray& r : rays) {
+			hitRecord expected, found;
+			const bool expectedHit = reference.hit(r, real(0.001), real(infinity), expected);
+			const bool foundHit = tree.hit(r, real(0.001), real(infinity), found);
+			if (expectedHit != foundHit || (expectedHit && std::fabs(expected.t - found.t) > 1e-6 * std::fabs(expected.t)))
+				mismatches++;
+		}
+		check(mismatches == 0, name + ": " + std::to_string(mismatches) + " of " + std::to_string(rays.size()) + " rays disagree");
+	}
+
+	// ratio^i must stay finite in float for the sphere cloud.
+	void runSpacing(double ratio, int count, bool withCloud) {
+		const std::string label = "x = " + std::to_string(ratio) + "^i";
+
+		std::vector<point3> centers;
+		std::vector<aabb> bounds;
+		hittableList spheres;
+		sphereCloudBuffers buffers;
+		const std::uint32_t cloudMaterial = buffers.addMaterial(nullptr);
+		for (int i = 0; i < count; i++) {
+			const double x = std::pow(ratio, i);
+			centers.push_back(point3(x, 0, 0));
+			spheres.add(make_shared<sphere>(centers.back(), 0.01 * x, nullptr));
+			buffers.addSphere(centers.back(), 0.01 * x, cloudMaterial);
+
+			aabb box;
+			spheres.m_objects.back()->getAABB(0, 1, box);
+			bounds.push_back(box);
+		}
+
+		bvhBuilder builder(bounds, 4);
+		builder.build(1);
+		check(builder.getDepth() <= bvhBuilder::s_maxDepth,
+			label + ": builder depth " + std::to_string(builder.getDepth()) + " exceeds " + std::to_string(bvhBuilder::s_maxDepth));
+
+		const std::vector<ray> rays = probeRays(centers);
+		checkAccelerator(label + " bvhNode", bvhNode(spheres, 0, 1), spheres, rays);
+		checkAccelerator(label + " linearBvh", linearBvh(spheres, 0, 1), spheres, rays);
+		checkAccelerator(label + " bvh4", bvh4(spheres, 0, 1), spheres, rays);
+		checkAccelerator(label + " bvh8", bvh8(spheres, 0, 1), spheres, rays);
+		checkAccelerator(label + " tlas", tlas(spheres, 0, 1), spheres, rays);
+		checkAccelerator(label + " motionBvh", motionBvh(spheres, 0, 1), spheres, rays);
+		if (withCloud) checkAccelerator(label + " sphereCloud", sphereCloud(std::move(buffers)), spheres, rays);
+	}
+}
+
+int main() {
+	runSpacing(1.2, 1000, false);
+	runSpacing(2.0, 1000, false);
+	runSpacing(1.1, 900, true);
+
+	if (failures > 0) {
+		std::cerr << failures << " checks failed.\n";
+		return 1;
+	}
+	std::cerr << "All BVH depth checks passed.\n";
+	return 0;
+}
@@ -0,0 +1,103 @@
+// Regression test for OBJ face corners: tests/flatCube.obj gives every corner of the cube one
+// normal per face that meets there, which loadOBJ used to collapse to the first normal seen, so
+// the cube shaded as if smooth with arbitrary normals. Build and run from the repository root:
+//
+//     g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread tests/objCornerTest.cpp -o objCornerTest
+//     ./objCornerTest
+//
+// Each triangle must carry its face's normal at all three corners and the four texture
+// coordinates of its face, loading must not depend on the thread count, and a ray onto each
+// face must come back with the flat normal.
+#include "../utils.h"
+
+#include "../hittable.h"
+#include "../mesh.h"
+#include "../meshLoader.h"
+
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string& what) {
+		if (!condition) {
+			std::cerr << "FAILED: " << what << "\n";
+			failures++;
+		}
+	}
+
+	const char* const path = "tests/flatCube.obj";
+
+	// The face a triangle lies on is the axis along which all its corners agree.
+	vec3 faceNormal(const meshBuffers& mesh, size_t t) {
+		const std::uint32_t* tri = &mesh.indices[3 * t];
+		for (int axis = 0; axis < 3; axis++) {
+			const real value = mesh.getPosition(tri[0])[axis];
+			if (mesh.getPosition(tri[1])[axis] == value && mesh.getPosition(tri[2])[axis] == value) {
+				vec3 normal(0, 0, 0);
+				normal[axis] = value > 0 ? 1 : -1;
+				return normal;
+			}
+		}
+		return vec3(0, 0, 0);
+	}
+
+	void checkCorners(const meshBuffers& mesh) {
+		check(mesh.getTriangleCount() == 12, "12 triangles, got " + std::to_string(mesh.getTriangleCount()));
+		check(mesh.getVertexCount() == 24, "24 vertices, one per face corner, got " + std::to_string(mesh.getVertexCount()));
+		check(mesh.hasNormals() && mesh.hasUVs(), "normals and texture coordinates per vertex");
+		if (!mesh.hasNormals() || !mesh.hasUVs()) return;
+
+		std::vector<std::set<std::pair<real, real>>> faceUVs(6);
+		for (size_t t = 0; t < mesh.getTriangleCount(); t++) {
+			const vec3 expected = faceNormal(mesh, t);
+			const int face = expected.x() != 0 ? (expected.x() > 0) : expected.y() != 0 ? 2 + (expected.y() > 0) : 4 + (expected.z() > 0);
+			for (int k = 0; k < 3; k++) {
+				const std::uint32_t i = mesh.indices[3 * t + k];
+				const vec3 normal(mesh.nx[i], mesh.ny[i], mesh.nz[i]);
+				check((normal - expected).length() == 0, "triangle " + std::to_string(t) + " corner " + std::to_string(k) + " normal");
+				faceUVs[face].insert({ mesh.u[i], mesh.v[i] });
+			}
+		}
+		for (int face = 0; face < 6; face++)
+			check(faceUVs[face].size() == 4, "face " + std::to_string(face) + " uses all four texture coordinates");
+	}
+
+	void checkShading(meshBuffers mesh) {
+		indexedMesh cube(std::move(mesh), nullptr);
+		for (int axis = 0; axis < 3; axis++) {
+			for (int side = -1; side <= 1; side += 2) {
+				vec3 outward(0, 0, 0);
+				outward[axis] = side;
+				point3 origin(real(0.3), real(-0.2), real(0.1));
+				origin[axis] = 3 * side;
+				hitRecord record;
+				const bool hit = cube.hit(ray(origin, -outward, 0.0), real(0.001), real(infinity), record);
+				check(hit && (record.normal - outward).length() < 1e-9, "shading normal of face " + std::to_string(axis) + (side > 0 ? "+" : "-"));
+			}
+		}
+	}
+}
+
+int main() {
+	meshBuffers single, parallel;
+	size_t fileSize = 0;
+	check(loadOBJ(path, single, fileSize, 1), std::string("load ") + path + " on one thread");
+	check(loadOBJ(path, parallel, fileSize, 8), std::string("load ") + path + " on eight threads");
+	checkCorners(single);
+	check(single.indices == parallel.indices && single.px == parallel.px && single.nx == parallel.nx && single.u == parallel.u,
+		"same mesh whatever the thread count");
+	checkShading(single);
+
+	if (failures > 0) {
+		std::cerr << failures << " checks failed.\n";
+		return 1;
+	}
+	std::cerr << "All OBJ corner checks passed.\n";
+	return 0;
+}
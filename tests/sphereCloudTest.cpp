@@ -0,0 +1,133 @@
+// Equivalence test for sphereCloud: random clouds of still spheres, moving spheres (some added
+// before the first moving one, which get zero offsets) and negative radii (hollow spheres with
+// inward normals) are traced with random rays at random times, and every hit is compared with a
+// brute-force search over the sphere and movingSphere objects the cloud stands for. Build and
+// run from the repository root:
+//
+//     g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread tests/sphereCloudTest.cpp -o sphereCloudTest
+//     ./sphereCloudTest
+//
+// That build runs the SSE leaf test (4 lanes). Add -mavx for the AVX leaf test (8 lanes) and
+// -DRT_USE_FLOAT for the single-precision renderer; other targets get the scalar leaf test.
+#include "../utils.h"
+
+#include "../material.h"
+#include "../hittable.h"
+#include "../hittableList.h"
+#include "../sphere.h"
+#include "../movingSphere.h"
+#include "../sphereCloud.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string& what) {
+		if (!condition) {
+			std::cerr << "FAILED: " << what << "\n";
+			failures++;
+		}
+	}
+
+	struct cloudCase {
+		std::string name;
+		int count;
+		double movingShare;   // Fraction of spheres that move, after the first tenth
+		double negativeShare; // Fraction of spheres with a negative radius
+		real startTime, endTime;
+	};
+
+	bool isClose(real a, real b, real tolerance) {
+		return std::fabs(a - b) <= tolerance * std::max(real(1), std::fabs(a));
+	}
+
+	void runCase(const cloudCase& c, int rayCount) {
+		std::vector<shared_ptr<material>> materials;
+		for (int i = 0; i < 5; i++) materials.push_back(make_shared<lambertian>(color::random()));
+
+		// The objects take the cloud's float values so both describe the same spheres.
+		sphereCloudBuffers buffers;
+		for (const auto& m : materials) buffers.addMaterial(m);
+		hittableList reference;
+		for (int i = 0; i < c.count; i++) {
+			const point3 center = vec3::random(-10.0, 10.0);
+			const real r = real(randomDouble(0.05, 0.8)) * (randomDouble() < c.negativeShare ? -1 : 1);
+			const std::uint32_t m = static_cast<std::uint32_t>(randomInt(0, int(materials.size()) - 1));
+
+			if (i >= c.count / 10 && randomDouble() < c.movingShare) {
+				buffers.addMovingSphere(center, center + vec3::random(-3.0, 3.0), r, m);
+				const size_t s = buffers.getSphereCount() - 1;
+				const point3 start(buffers.cx[s], buffers.cy[s], buffers.cz[s]);
+				const vec3 offset(buffers.dx[s], buffers.dy[s], buffers.dz[s]);
+				reference.add(make_shared<movingSphere>(start, start + offset, c.startTime, c.endTime, buffers.radius[s], materials[m]));
+			} else {
+				buffers.addSphere(center, r, m);
+				const size_t s = buffers.getSphereCount() - 1;
+				reference.add(make_shared<sphere>(point3(buffers.cx[s], buffers.cy[s], buffers.cz[s]), buffers.radius[s], materials[m]));
+			}
+		}
+
+		const sphereCloud cloud(std::move(buffers), c.startTime, c.endTime);
+		check(cloud.getSphereCount() == size_t(c.count), c.name + ": sphere count");
+
+		// Single precision carries its rounding through the hit point into every attribute.
+		const real tolerance = sizeof(real) == sizeof(float) ? real(1e-3) : real(1e-9);
+		int hitCount = 0;
+		int mismatches = 0;
+		for (int i = 0; i < rayCount; i++) {
+			// Aimed into the cloud, so most rays pass several spheres; some start inside one.
+			const point3 origin = vec3::random(-14.0, 14.0);
+			const point3 target = vec3::random(-10.0, 10.0);
+			const real time = c.startTime + real(randomDouble()) * (c.endTime - c.startTime);
+			const ray r(origin, target - origin, time);
+
+			hitRecord expected, found;
+			const bool expectedHit = reference.hit(r, real(0.001), real(infinity), expected);
+			const bool foundHit = cloud.hit(r, real(0.001), real(infinity), found);
+			if (expectedHit) hitCount++;
+
+			bool same = expectedHit == foundHit;
+			if (same && expectedHit) {
+				same = isClose(expected.t, found.t, tolerance) && expected.isFrontFace == found.isFrontFace
+					&& expected.material_ptr == found.material_ptr && isClose(expected.u, found.u, tolerance)
+					&& isClose(expected.v, found.v, tolerance);
+				for (int a = 0; a < 3; a++) {
+					same = same && isClose(expected.point[a], found.point[a], tolerance)
+						&& isClose(expected.normal[a], found.normal[a], tolerance);
+				}
+			}
+			if (!same) mismatches++;
+		}
+
+		check(mismatches == 0, c.name + ": " + std::to_string(mismatches) + " of " + std::to_string(rayCount) + " rays disagree");
+		check(hitCount > rayCount / 10 || c.count < 100, c.name + ": only " + std::to_string(hitCount) + " rays hit");
+	}
+}
+
+int main() {
+	const cloudCase cases[] = {
+		{ "still", 3000, 0.0, 0.0, 0, 1 },
+		{ "moving", 3000, 0.5, 0.0, 0, 1 },
+		{ "all moving", 1000, 1.0, 0.0, 0, 1 },
+		{ "negative radii", 3000, 0.0, 0.3, 0, 1 },
+		{ "moving negative radii", 3000, 0.5, 0.3, 0, 1 },
+		{ "moving over 0.5-2", 2000, 0.5, 0.1, real(0.5), 2 },
+		// Fewer spheres than lanes, and counts that leave the last leaf part empty.
+		{ "one sphere", 1, 0.0, 0.0, 0, 1 },
+		{ "three spheres", 3, 1.0, 0.0, 0, 1 },
+		{ "nineteen spheres", 19, 0.5, 0.3, 0, 1 },
+	};
+
+	for (const cloudCase& c : cases) runCase(c, 20000);
+
+	if (failures > 0) {
+		std::cerr << failures << " checks failed.\n";
+		return 1;
+	}
+	std::cerr << "All sphereCloud checks passed.\n";
+	return 0;
+}
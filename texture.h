@@ -1,65 +1,119 @@
 #pragma once
 
 #include "utils.h"
-#include "rtw_stb_image.h"
 #include "perlin.h"
+#include "textureRegistry.h"
+#include "rayDifferential.h"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 
 class texture {
 public:
-	virtual color getValue(double u, double v, const point3& p) const = 0;
+	virtual color getValue(real u, real v, const point3& p) const = 0;
+
+	// Value averaged over a pixel's footprint, for textures that can filter; the rest ignore it.
+	virtual color getFilteredValue(real u, real v, const point3& p, const uvFootprint& footprint) const {
+		return getValue(u, v, p);
+	}
 };
 
 class imageTexture : public texture {
 public:
-	imageTexture(const char* filename) {
-		int componentsPerPixel = s_bytesPerPixel;
+	// Shares the registry's decoded copy of the file, which may still be decoding; the first
+	// lookup waits for it.
+	imageTexture(const char* filename)
+		: m_pending(textureRegistry::global().loadImage(filename)) {}
 
-		m_data = stbi_load(
-			filename, &m_width, &m_height, &componentsPerPixel, componentsPerPixel
-		);
-
-		if (!m_data) {
-			std::cerr << "ERROR: Could not load texture image file '" << filename << "',\n";
-			m_width = m_height = 0;
-		}
+	// Copies already decoded RGB pixels, rows top to bottom. An empty image has no data, like a
+	// file that failed to load.
+	imageTexture(const unsigned char* pixels, int width, int height)
+		: m_pending(textureRegistry::global().adoptImage(pixels, width, height)) {}
 
-		m_bytesPerScanline = s_bytesPerPixel * m_width;
-	}
-
-	~imageTexture() {
-		delete[] m_data;
-	}
+	virtual color getValue(real u, real v, const point3& p) const override {
+		const imageData& image = getImage();
 
-	virtual color getValue(double u, double v, const point3& p) const override {
 		// If we have no texture data, then return solid magenta
-		if (!m_data) return color(0.0, 1.0, 1.0);
+		if (!image.pixels) return color(0.0, 1.0, 1.0);
 
 		// Clamp input tex coords to [0,1] x [1,0]
 		u = clamp(u, 0.0, 1.0);
 		v = 1.0 - clamp(v, 0.0, 1.0); // Flip V to img coords
 
-		int i = static_cast<int>(u * m_width);
-		int j = static_cast<int>(v * m_height);
+		int i = static_cast<int>(u * image.width);
+		int j = static_cast<int>(v * image.height);
 
 		// Clamp integer mapping, since actual coordinates should be less than 1.0
-		if (i >= m_width)  i = m_width - 1;
-		if (j >= m_height) j = m_height - 1;
+		if (i >= image.width)  i = image.width - 1;
+		if (j >= image.height) j = image.height - 1;
 
-		const double colorScale = 1.0 / 255.0;
-		unsigned char* pixel = m_data + j * m_bytesPerScanline + i * s_bytesPerPixel;
+		const real colorScale = 1.0 / 255.0;
+		const unsigned char* pixel = image.pixels.get() + (size_t(j) * image.width + i) * s_bytesPerPixel;
 
 		return color(colorScale * pixel[0], colorScale * pixel[1], colorScale * pixel[2]);
 	}
 
+	// Trilinear: bilinear lookups in the two pyramid levels around the one where the footprint
+	// covers about a texel, blended. Unknown footprints keep the nearest full-resolution texel.
+	virtual color getFilteredValue(real u, real v, const point3& p, const uvFootprint& footprint) const override {
+		const imageData& image = getImage();
+		if (!footprint.valid || !image.pixels) return getValue(u, v, p);
+
+		const real width = std::fmax(
+			std::hypot(footprint.dudx * image.width, footprint.dvdx * image.height),
+			std::hypot(footprint.dudy * image.width, footprint.dvdy * image.height));
+		const real level = std::clamp(real(std::log2(std::fmax(width, real(1)))), real(0), real(image.levels.size() - 1));
+		const int lower = static_cast<int>(level);
+		const real blend = level - lower;
+
+		color value = getBilinear(image.levels[lower], u, v);
+		if (blend > 0) value = (1 - blend) * value + blend * getBilinear(image.levels[lower + 1], u, v);
+		return value;
+	}
+
+	int getWidth() const { return getImage().width; }
+	int getHeight() const { return getImage().height; }
+	const unsigned char* getData() const { return getImage().pixels.get(); }
+
 public:
-	const static int s_bytesPerPixel = 3;
+	const static int s_bytesPerPixel = imageData::s_bytesPerPixel;
 
 private:
-	unsigned char* m_data;
-	int m_width, m_height;
-	int m_bytesPerScanline;
+	// Texel centres sit at half-integer positions; lookups clamp at the edges like getValue.
+	static color getBilinear(const imageData::mipLevel& level, real u, real v) {
+		const real x = clamp(u, 0.0, 1.0) * level.width - real(0.5);
+		const real y = (1 - clamp(v, 0.0, 1.0)) * level.height - real(0.5);
+		const int x0 = static_cast<int>(std::floor(x));
+		const int y0 = static_cast<int>(std::floor(y));
+		const real fx = x - x0;
+		const real fy = y - y0;
+
+		auto texel = [&level](int i, int j) {
+			i = std::clamp(i, 0, level.width - 1);
+			j = std::clamp(j, 0, level.height - 1);
+			const unsigned char* pixel = level.pixels + (size_t(j) * level.width + i) * s_bytesPerPixel;
+			return color(pixel[0], pixel[1], pixel[2]);
+		};
+
+		color top = (1 - fx) * texel(x0, y0) + fx * texel(x0 + 1, y0);
+		color bottom = (1 - fx) * texel(x0, y0 + 1) + fx * texel(x0 + 1, y0 + 1);
+		return ((1 - fy) * top + fy * bottom) * (1.0 / 255.0);
+	}
+
+	// The future is only asked once per texture; afterwards every thread reads the cached pointer.
+	const imageData& getImage() const {
+		const imageData* image = m_image.load(std::memory_order_acquire);
+		if (!image) {
+			image = m_pending.get().get();
+			m_image.store(image, std::memory_order_release);
+		}
+		return *image;
+	}
+
+private:
+	textureRegistry::imageFuture m_pending;
+	mutable std::atomic<const imageData*> m_image{ nullptr };
 };
 
 class solidColor : public texture {
@@ -67,13 +121,15 @@ public:
 	solidColor() {}
 	solidColor(color c) : colorValue(c) {}
 
-	solidColor(double red, double green, double blue)
+	solidColor(real red, real green, real blue)
 		: solidColor(color(red, green, blue)) {}
 
-	virtual color getValue(double u, double v, const point3& p) const override {
+	virtual color getValue(real u, real v, const point3& p) const override {
 		return colorValue;
 	}
 
+	const color& getColor() const { return colorValue; }
+
 private:
 	color colorValue;
 };
@@ -88,15 +144,23 @@ public:
 	checkerTexture(color even, color odd)
 		: m_even(make_shared<solidColor>(even)), m_odd(make_shared<solidColor>(odd)) {}
 
-	virtual color getValue(double u, double v, const point3& p) const override {
+	virtual color getValue(real u, real v, const point3& p) const override {
 		// Clamp u and v to 0.0 - 1.0
 		u -= floor(u);
 		v -= floor(v);
 
-		double sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
+		real sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
 		return sines < 0 ? m_odd->getValue(u, v, p) : m_even->getValue(u, v, p);
 	}
 
+	virtual color getFilteredValue(real u, real v, const point3& p, const uvFootprint& footprint) const override {
+		u -= floor(u);
+		v -= floor(v);
+
+		real sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
+		return sines < 0 ? m_odd->getFilteredValue(u, v, p, footprint) : m_even->getFilteredValue(u, v, p, footprint);
+	}
+
 public:
 	shared_ptr<texture> m_odd;
 	shared_ptr<texture> m_even;
@@ -104,14 +168,29 @@ public:
 
 class perlinTexture : public texture {
 public:
-	perlinTexture() : m_scale(1.0) {}
-	perlinTexture(double scale) : m_scale(scale) {}
+	perlinTexture() : perlinTexture(1.0) {}
+	perlinTexture(real scale) : m_noise(textureRegistry::global().getNoise()), m_scale(scale) {}
+	perlinTexture(real scale, shared_ptr<const perlin> noise) : m_noise(std::move(noise)), m_scale(scale) {}
 
-	virtual color getValue(double u, double v, const point3& p) const override {
-		return color(1.0, 1.0, 1.0) * 0.5 * (1.0 + sin(m_scale * p.z() + 10.0 * noise.turbulant(p)));
+	virtual color getValue(real u, real v, const point3& p) const override {
+		const real turbulence = m_volume && m_volume->contains(p) ? m_volume->turbulence(p) : m_noise->turbulant(p);
+		return color(1.0, 1.0, 1.0) * 0.5 * (1.0 + sin(m_scale * p.z() + 10.0 * turbulence));
 	}
 
+	// Looks the turbulence up in a volume baked over region, when the registry has a volume
+	// resolution set; points outside the region keep evaluating the noise.
+	void bakeTurbulence(const aabb& region) {
+		m_bakeRegion = region;
+		m_hasBakeRegion = true;
+		m_volume = textureRegistry::global().getNoiseVolume(m_noise, region);
+	}
+
+	const perlin& getNoise() const { return *m_noise; }
+
 public:
-	perlin noise;
-	double m_scale;
+	shared_ptr<const perlin> m_noise; // Immutable, shared with every other perlinTexture
+	real m_scale;
+	shared_ptr<const noiseVolume> m_volume; // Null unless baked
+	aabb m_bakeRegion;
+	bool m_hasBakeRegion = false;
 };
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "utils.h"
+#include "rtw_stb_image.h"
+#include "perlin.h"
+#include "noiseVolume.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Decoded RGB pixels, rows top to bottom, and their MIP pyramid: each further level halves the
+// one before with a 2x2 box filter, down to a single texel. Never modified once published, so
+// any number of textures and render threads read it without locking.
+struct imageData {
+	static const int s_bytesPerPixel = 3;
+
+	struct mipLevel {
+		const unsigned char* pixels;
+		int width;
+		int height;
+	};
+
+	std::unique_ptr<unsigned char, void (*)(void*)> pixels{ nullptr, stbi_image_free }; // Null if decoding failed
+	int width = 0;
+	int height = 0;
+	std::vector<mipLevel> levels;       // levels[0] is pixels itself
+	std::vector<unsigned char> mipData; // Storage of every level after the first
+
+	void buildMipLevels();
+
+	size_t getByteSize() const {
+		return pixels ? size_t(width) * height * s_bytesPerPixel + mipData.size() : 0;
+	}
+};
+
+void imageData::buildMipLevels() {
+	levels.clear();
+	mipData.clear();
+	if (!pixels) return;
+
+	// Sizes first, so the storage is allocated once and level pointers stay valid.
+	std::vector<size_t> offsets;
+	size_t total = 0;
+	for (int w = width, h = height; w > 1 || h > 1;) {
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+		offsets.push_back(total);
+		total += size_t(w) * h * s_bytesPerPixel;
+	}
+	mipData.resize(total);
+
+	levels.push_back({ pixels.get(), width, height });
+	for (size_t offset : offsets) {
+		const mipLevel source = levels.back();
+		mipLevel target = { mipData.data() + offset, std::max(1, source.width / 2), std::max(1, source.height / 2) };
+		unsigned char* out = mipData.data() + offset;
+
+		// An odd last row or column is dropped, which keeps every target texel a 2x2 average.
+		for (int y = 0; y < target.height; y++) {
+			const int y0 = std::min(2 * y, source.height - 1), y1 = std::min(2 * y + 1, source.height - 1);
+			for (int x = 0; x < target.width; x++) {
+				const int x0 = std::min(2 * x, source.width - 1), x1 = std::min(2 * x + 1, source.width - 1);
+				for (int c = 0; c < s_bytesPerPixel; c++) {
+					auto at = [&](int sx, int sy) { return source.pixels[(size_t(sy) * source.width + sx) * s_bytesPerPixel + c]; };
+					*out++ = static_cast<unsigned char>((at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1) + 2) / 4);
+				}
+			}
+		}
+		levels.push_back(target);
+	}
+}
+
+// Process-wide owner of decoded texture assets. The first request for an image file starts
+// decoding it and building its pyramid on a background thread, and every later request shares
+// that result, so scenes that put one file on many materials decode and hold it once. The
+// Perlin tables, and turbulence baked from them, are shared the same way. Assets stay resident
+// until the process exits.
+class textureRegistry {
+public:
+	using imageFuture = std::shared_future<shared_ptr<const imageData>>;
+
+	static textureRegistry& global() {
+		static textureRegistry registry;
+		return registry;
+	}
+
+	imageFuture loadImage(const std::string& path);
+
+	// Keeps a copy of pixels decoded elsewhere, e.g. by the scene cache; identical pixels share
+	// the copy adopted first.
+	imageFuture adoptImage(const unsigned char* pixels, int width, int height);
+
+	// Made on first use from the calling thread's sampler, like a perlin of its own would be.
+	shared_ptr<const perlin> getNoise();
+
+	// Tables saved from a perlin; a set already held is returned when they match it.
+	shared_ptr<const perlin> adoptNoise(const vec3* randomVectors, const int* permutations);
+
+	// Cells per axis of baked turbulence volumes; zero, the default, keeps the noise exact.
+	void setNoiseVolumeResolution(int resolution) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_volumeResolution = std::max(0, resolution);
+	}
+
+	// Turbulence of noise baked over region at the current resolution, or null when baking is
+	// off. Textures asking for the same noise and region share one volume.
+	shared_ptr<const noiseVolume> getNoiseVolume(const shared_ptr<const perlin>& noise, const aabb& region);
+
+	size_t getRequestCount() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_imageRequests + m_noiseRequests + m_volumeRequests;
+	}
+	size_t getResidentSize() const; // Decoded images that have finished, the noise tables and volumes
+	void printStatistics(std::ostream& out) const;
+
+private:
+	static shared_ptr<const imageData> decode(const std::string& path);
+	static bool sameNoise(const perlin& noise, const vec3* randomVectors, const int* permutations);
+	static size_t getNoiseSize() { return perlin::getPointCount() * (sizeof(vec3) + 3 * sizeof(int) + 4 * sizeof(float)); }
+	size_t getNoiseSetCount() const { return (m_noise ? 1 : 0) + m_adoptedNoise.size(); }
+
+private:
+	mutable std::mutex m_mutex;
+	std::map<std::string, imageFuture> m_images;
+	std::vector<shared_ptr<const imageData>> m_adopted;
+	shared_ptr<const perlin> m_noise;
+	std::vector<shared_ptr<const perlin>> m_adoptedNoise; // Saved sets that differ from m_noise
+	size_t m_imageRequests = 0;
+	size_t m_noiseRequests = 0;
+
+	struct volumeEntry {
+		shared_ptr<const perlin> noise;
+		aabb region;
+		shared_ptr<const noiseVolume> volume;
+	};
+	std::vector<volumeEntry> m_volumes;
+	int m_volumeResolution = 0;
+	size_t m_volumeRequests = 0;
+};
+
+shared_ptr<const imageData> textureRegistry::decode(const std::string& path) {
+	auto image = make_shared<imageData>();
+	int componentsPerPixel = imageData::s_bytesPerPixel;
+	image->pixels.reset(stbi_load(path.c_str(), &image->width, &image->height, &componentsPerPixel, componentsPerPixel));
+
+	if (!image->pixels) {
+		std::cerr << "ERROR: Could not load texture image file '" << path << "',\n";
+		image->width = image->height = 0;
+	}
+	image->buildMipLevels();
+	return image;
+}
+
+textureRegistry::imageFuture textureRegistry::loadImage(const std::string& path) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_imageRequests++;
+
+	auto found = m_images.find(path);
+	if (found != m_images.end()) return found->second;
+
+	imageFuture pending = std::async(std::launch::async, decode, path).share();
+	m_images.emplace(path, pending);
+	return pending;
+}
+
+textureRegistry::imageFuture textureRegistry::adoptImage(const unsigned char* pixels, int width, int height) {
+	// Copied under the lock, like volumes are baked: scenes are built on one thread.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_imageRequests++;
+
+	const size_t byteCount = width > 0 && height > 0 ? size_t(width) * height * imageData::s_bytesPerPixel : 0;
+	shared_ptr<const imageData> image;
+	for (const auto& adopted : m_adopted) {
+		if (adopted->width == std::max(0, width) && adopted->height == std::max(0, height)
+			&& (byteCount == 0 || std::memcmp(adopted->pixels.get(), pixels, byteCount) == 0)) {
+			image = adopted;
+			break;
+		}
+	}
+
+	if (!image) {
+		auto copy = make_shared<imageData>();
+		if (byteCount > 0) {
+			// stb_image allocates with malloc, so copies do too and share its deleter.
+			copy->pixels.reset(static_cast<unsigned char*>(std::malloc(byteCount)));
+			std::memcpy(copy->pixels.get(), pixels, byteCount);
+			copy->width = width;
+			copy->height = height;
+		}
+		copy->buildMipLevels();
+		m_adopted.push_back(copy);
+		image = copy;
+	}
+
+	std::promise<shared_ptr<const imageData>> ready;
+	ready.set_value(image);
+	return ready.get_future().share();
+}
+
+shared_ptr<const perlin> textureRegistry::getNoise() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_noiseRequests++;
+	if (!m_noise) m_noise = make_shared<const perlin>();
+	return m_noise;
+}
+
+bool textureRegistry::sameNoise(const perlin& noise, const vec3* randomVectors, const int* permutations) {
+	const int n = perlin::getPointCount();
+	if (std::memcmp(noise.getRandomVectors(), randomVectors, n * sizeof(vec3)) != 0) return false;
+	for (int axis = 0; axis < 3; axis++)
+		if (std::memcmp(noise.getPermutation(axis), permutations + axis * n, n * sizeof(int)) != 0) return false;
+	return true;
+}
+
+shared_ptr<const perlin> textureRegistry::adoptNoise(const vec3* randomVectors, const int* permutations) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_noiseRequests++;
+	if (m_noise && sameNoise(*m_noise, randomVectors, permutations)) return m_noise;
+	for (const auto& noise : m_adoptedNoise)
+		if (sameNoise(*noise, randomVectors, permutations)) return noise;
+
+	const int n = perlin::getPointCount();
+	auto noise = make_shared<const perlin>(randomVectors, permutations, permutations + n, permutations + 2 * n);
+	if (!m_noise) m_noise = noise;
+	else m_adoptedNoise.push_back(noise);
+	return noise;
+}
+
+shared_ptr<const noiseVolume> textureRegistry::getNoiseVolume(const shared_ptr<const perlin>& noise, const aabb& region) {
+	// Baked under the lock: scenes are built on one thread, and the bake itself is parallel.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_volumeResolution == 0 || !noise) return nullptr;
+	m_volumeRequests++;
+
+	auto sameCorner = [](const point3& a, const point3& b) { return a.x() == b.x() && a.y() == b.y() && a.z() == b.z(); };
+	for (const auto& entry : m_volumes) {
+		if (entry.noise == noise && entry.volume->getResolution() == m_volumeResolution
+			&& sameCorner(entry.region.m_min, region.m_min) && sameCorner(entry.region.m_max, region.m_max))
+			return entry.volume;
+	}
+
+	auto volume = make_shared<const noiseVolume>(*noise, region, m_volumeResolution);
+	m_volumes.push_back({ noise, region, volume });
+	return volume;
+}
+
+size_t textureRegistry::getResidentSize() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t bytes = getNoiseSetCount() * getNoiseSize();
+	for (const auto& entry : m_images) {
+		if (entry.second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			bytes += entry.second.get()->getByteSize();
+	}
+	for (const auto& image : m_adopted) bytes += image->getByteSize();
+	for (const auto& entry : m_volumes) bytes += entry.volume->getByteSize();
+	return bytes;
+}
+
+void textureRegistry::printStatistics(std::ostream& out) const {
+	size_t resident = getResidentSize();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t decoded = 0;
+	for (const auto& entry : m_images) {
+		if (entry.second.wait_for(std::chrono::seconds(0)) == std::future_status::ready && entry.second.get()->pixels)
+			decoded++;
+	}
+	out << "textureRegistry: " << m_imageRequests << " image requests for " << m_images.size() << " files ("
+		<< decoded << " decoded) and " << m_adopted.size() << " adopted copies, "
+		<< m_noiseRequests << " noise requests for " << getNoiseSetCount() << " table sets, "
+		<< m_volumeRequests << " volume requests for " << m_volumes.size() << " baked volumes, "
+		<< resident / (1024.0 * 1024.0) << " MB resident\n";
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of workers, each owning a task deque. A worker pops its newest task
+// first and, once its own deque runs dry, steals the oldest task of another worker, so
+// uneven tiles (sky vs. glass) still keep every core busy.
+class threadPool {
+public:
+	explicit threadPool(unsigned threadCount = defaultThreadCount());
+	~threadPool();
+
+	threadPool(const threadPool&) = delete;
+	threadPool& operator=(const threadPool&) = delete;
+
+	// Tasks submitted from a worker land on that worker's own deque.
+	void submit(std::function<void()> task);
+
+	// Blocks until every submitted task, including ones submitted by tasks, has finished.
+	void wait();
+
+	unsigned size() const { return static_cast<unsigned>(m_workers.size()); }
+
+	static unsigned defaultThreadCount() {
+		unsigned count = std::thread::hardware_concurrency();
+		return count == 0 ? 1 : count;
+	}
+
+private:
+	struct workQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	bool popLocal(unsigned index, std::function<void()>& task);
+	bool steal(unsigned thief, std::function<void()>& task);
+	void workerLoop(unsigned index);
+
+	static int& currentWorker() {
+		static thread_local int index = -1;
+		return index;
+	}
+
+private:
+	std::vector<std::unique_ptr<workQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_stateMutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_idleCondition;
+	long long m_queued = 0;  // Submitted but not yet picked up
+	long long m_pending = 0; // Submitted but not yet finished
+	unsigned m_nextQueue = 0;
+	bool m_stopping = false;
+};
+
+inline threadPool::threadPool(unsigned threadCount) {
+	if (threadCount == 0) threadCount = 1;
+
+	for (unsigned i = 0; i < threadCount; i++)
+		m_queues.push_back(std::make_unique<workQueue>());
+
+	for (unsigned i = 0; i < threadCount; i++)
+		m_workers.emplace_back(&threadPool::workerLoop, this, i);
+}
+
+inline threadPool::~threadPool() {
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(m_stateMutex);
+		m_stopping = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (std::thread& worker : m_workers) worker.join();
+}
+
+inline void threadPool::submit(std::function<void()> task) {
+	unsigned index;
+	{
+		std::lock_guard<std::mutex> lock(m_stateMutex);
+		int worker = currentWorker();
+		index = worker >= 0 ? static_cast<unsigned>(worker) : m_nextQueue++ % size();
+		m_pending++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+		m_queues[index]->tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_stateMutex);
+		m_queued++;
+	}
+	m_wakeCondition.notify_one();
+}
+
+inline void threadPool::wait() {
+	std::unique_lock<std::mutex> lock(m_stateMutex);
+	m_idleCondition.wait(lock, [this] { return m_pending == 0; });
+}
+
+inline bool threadPool::popLocal(unsigned index, std::function<void()>& task) {
+	std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+	if (m_queues[index]->tasks.empty()) return false;
+
+	task = std::move(m_queues[index]->tasks.back());
+	m_queues[index]->tasks.pop_back();
+	return true;
+}
+
+inline bool threadPool::steal(unsigned thief, std::function<void()>& task) {
+	for (unsigned offset = 1; offset < size(); offset++) {
+		workQueue& victim = *m_queues[(thief + offset) % size()];
+
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tasks.empty()) continue;
+
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		return true;
+	}
+
+	return false;
+}
+
+inline void threadPool::workerLoop(unsigned index) {
+	currentWorker() = static_cast<int>(index);
+
+	while (true) {
+		std::function<void()> task;
+
+		if (popLocal(index, task) || steal(index, task)) {
+			{
+				std::lock_guard<std::mutex> lock(m_stateMutex);
+				m_queued--;
+			}
+
+			task();
+
+			std::lock_guard<std::mutex> lock(m_stateMutex);
+			if (--m_pending == 0) m_idleCondition.notify_all();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_stateMutex);
+		m_wakeCondition.wait(lock, [this] { return m_stopping || m_queued > 0; });
+		if (m_stopping && m_queued <= 0) return;
+	}
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "utils.h"
+
+#include "hittable.h"
+#include "hittableList.h"
+#include "bvh.h"
+#include "bvhBuilder.h"
+#include "linearBvh.h"
+#include "instance.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// Two-level hierarchy. Each distinct shape referenced by an instance gets one bottom-level
+// tree (a linearBvh for lists and bvhNodes; meshes and single primitives are used as they are)
+// that all instances of it share. The top level is a flattened SAH tree over world-space
+// instance boxes, with objects that are not instances entered under the identity transform.
+// Moving instances only needs refit(), which recomputes node boxes and keeps the topology.
+class tlas : public hittable {
+public:
+	tlas() {}
+	tlas(const hittableList& entities, real startTime, real endTime, int maxLeafSize = 2);
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		if (m_nodes.empty()) return false;
+		outputBox = m_nodes[0].box;
+		return true;
+	}
+
+	size_t getInstanceCount() const { return m_entries.size(); }
+	size_t getShapeCount() const { return m_shapeCount; }
+	size_t getNodeCount() const { return m_nodes.size(); }
+
+	// Top-level storage only: nodes and instance records, not the shapes they share.
+	size_t getByteSize() const {
+		return m_nodes.capacity() * sizeof(linearBvh::linearNode) + m_entries.capacity() * sizeof(entry);
+	}
+
+	const instance& getInstance(size_t index) const { return m_entries[index].placement; }
+	bool isTransformed(size_t index) const { return m_entries[index].transformed; }
+
+	// Index is into the tree's own instance order, see getInstance. Call refit() afterwards.
+	void setTransform(size_t index, const affineTransform& toWorld) {
+		m_entries[index].placement.setTransform(toWorld);
+		m_entries[index].transformed = true;
+	}
+
+	void refit();
+
+private:
+	struct entry {
+		instance placement;
+		bool transformed; // False for objects entered as they are, which skip the ray transform
+	};
+
+	std::uint32_t flatten(const bvhBuilder& builder, std::uint32_t nodeIndex, std::vector<entry>& source);
+
+private:
+	std::vector<entry> m_entries; // Reordered so every leaf is a contiguous run
+	std::vector<linearBvh::linearNode> m_nodes;
+	size_t m_shapeCount = 0;
+};
+
+tlas::tlas(const hittableList& entities, real startTime, real endTime, int maxLeafSize) {
+	std::unordered_map<const hittable*, shared_ptr<hittable>> shapes;
+
+	auto bottomLevel = [&](const shared_ptr<hittable>& shape) {
+		auto found = shapes.find(shape.get());
+		if (found != shapes.end()) return found->second;
+
+		shared_ptr<hittable> tree = shape;
+		if (std::dynamic_pointer_cast<hittableList>(shape) || std::dynamic_pointer_cast<bvhNode>(shape))
+			tree = make_shared<linearBvh>(flattenHierarchy(hittableList(shape)), startTime, endTime);
+
+		shapes.emplace(shape.get(), tree);
+		return tree;
+	};
+
+	std::vector<entry> source;
+	for (const auto& object : flattenHierarchy(entities).m_objects) {
+		if (auto placed = std::dynamic_pointer_cast<instance>(object))
+			source.push_back({ instance(bottomLevel(placed->m_object), placed->m_toWorld), true });
+		else
+			source.push_back({ instance(object, affineTransform()), false });
+	}
+	m_shapeCount = shapes.size();
+	if (source.empty()) return;
+
+	std::vector<aabb> bounds(source.size());
+	for (size_t i = 0; i < source.size(); i++) {
+		if (!source[i].placement.getAABB(startTime, endTime, bounds[i]))
+			std::cerr << "No bounding box in BVH constructor.\n";
+	}
+
+	bvhBuilder builder(std::move(bounds), std::min(maxLeafSize, 0xffff));
+	builder.build();
+
+	m_nodes.reserve(builder.getNodeCount());
+	m_entries.reserve(source.size());
+	flatten(builder, builder.getRoot(), source);
+
+	std::cerr << "tlas: " << m_entries.size() << " instances of " << m_shapeCount << " shared shapes, "
+		<< m_nodes.size() << " nodes built in " << builder.getBuildMilliseconds() << " ms, "
+		<< getByteSize() / 1024.0 << " KB top level\n";
+}
+
+// Same depth-first layout as linearBvh, with the instance records moved into leaf order.
+std::uint32_t tlas::flatten(const bvhBuilder& builder, std::uint32_t nodeIndex, std::vector<entry>& source) {
+	const bvhBuildNode& node = builder.getNode(nodeIndex);
+	std::uint32_t flatIndex = static_cast<std::uint32_t>(m_nodes.size());
+	m_nodes.push_back({ node.box, 0, static_cast<std::uint16_t>(node.count), node.axis });
+
+	if (node.count > 0) {
+		m_nodes[flatIndex].offset = static_cast<std::uint32_t>(m_entries.size());
+		for (std::uint32_t i = node.start; i < node.start + node.count; i++)
+			m_entries.push_back(std::move(source[builder.getPrimitive(i)]));
+	} else {
+		flatten(builder, node.firstChild, source);
+		std::uint32_t second = flatten(builder, node.firstChild + 1, source);
+		m_nodes[flatIndex].offset = second;
+	}
+
+	return flatIndex;
+}
+
+// Children always follow their parent in the array, so one backwards pass sees every child
+// before the node that encloses it.
+void tlas::refit() {
+	for (size_t i = m_nodes.size(); i-- > 0;) {
+		linearBvh::linearNode& node = m_nodes[i];
+
+		if (node.count > 0) {
+			node.box = m_entries[node.offset].placement.m_box;
+			for (std::uint32_t k = node.offset + 1; k < node.offset + node.count; k++)
+				growBox(node.box, m_entries[k].placement.m_box);
+		} else {
+			node.box = m_nodes[i + 1].box;
+			growBox(node.box, m_nodes[node.offset].box);
+		}
+	}
+}
+
+bool tlas::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	if (m_nodes.empty()) return false;
+
+	const vec3 direction = r.getDirection();
+	const vec3 inverseDirection(1.0 / direction.x(), 1.0 / direction.y(), 1.0 / direction.z());
+	const bool directionIsNegative[3] = { direction.x() < 0.0, direction.y() < 0.0, direction.z() < 0.0 };
+
+	std::uint32_t stack[bvhBuilder::s_maxDepth];
+	int stackSize = 0;
+	std::uint32_t current = 0;
+	bool hasHit = false;
+
+	while (true) {
+		const linearBvh::linearNode& node = m_nodes[current];
+
+		if (node.box.hit(r, inverseDirection, tMin, tMax)) {
+			if (node.count > 0) {
+				for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+					const entry& e = m_entries[i];
+					// Instances finish their hits in object space; untransformed shapes can defer.
+					bool found = e.transformed
+						? e.placement.intersect(r, tMin, tMax, record)
+						: e.placement.m_object->intersect(r, tMin, tMax, record);
+					if (found) {
+						hasHit = true;
+						tMax = record.t;
+					}
+				}
+			} else if (directionIsNegative[node.axis]) {
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) break;
+		current = stack[--stackSize];
+	}
+
+	return hasHit;
+}
@@ -15,20 +15,15 @@ struct vertex {
 		: m_location(location), m_normal(normal), m_texCoord(texCoord) {}
 };
 
+// Vertices are stored inline, so a triangle is one block with no allocation of its own.
 struct triangle {
-	vertex* m_vertices;
+	vertex m_vertices[3];
 
-	triangle() : m_vertices(nullptr) {}
+	triangle() {}
 
-	triangle(vertex v0, vertex v1, vertex v2) {
-		m_vertices = new vertex[3];
-		m_vertices[0] = v0;
-		m_vertices[1] = v1;
-		m_vertices[2] = v2;
-	}
+	triangle(vertex v0, vertex v1, vertex v2) : m_vertices{ v0, v1, v2 } {}
 	
 	triangle(point3* vertices, vec3* normals, vec2* texCoords) {
-		m_vertices = new vertex[3];
 		for (int i = 0; i < 3; i++) {
 			m_vertices[i] = vertex(vertices[i], normals[i], texCoords[i]);
 		}
@@ -42,8 +37,8 @@ public:
 	TriangleMesh(int verticesN, int trianglesN, triangle* triangles)
 		: m_verticesN(verticesN), m_trianglesN(trianglesN), m_triangles(triangles) {}
 
-	virtual bool hit(const ray& ray, double tMin, double tMax, hitRecord& record) const = 0;
-	virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const = 0;
+	virtual bool hit(const ray& ray, real tMin, real tMax, hitRecord& record) const = 0;
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const = 0;
 
 	~TriangleMesh() {
 		if (m_triangles) delete[] m_triangles;
@@ -56,6 +51,8 @@ public:
 	aabb m_aabb;
 };
 
+// Rectangle that finds its plane at run time. Only aaBox still uses it; scenes build the
+// axis-specialized rectangles in rectangle.h through makeRectangle.
 class aaRectangle : public TriangleMesh {
 public:
 	aaRectangle() : m_x0(0.0), m_x1(0.0), m_y0(0.0), m_y1(0.0), m_z0(0.0), m_z1(0.0) {}
@@ -99,9 +96,9 @@ public:
 		m_triangles[1] = triangle(lowL, upR, lowR);
 	}
 	
-	virtual bool hit(const ray& ray, double tMin, double tMax, hitRecord& record) const override;
+	virtual bool hit(const ray& ray, real tMin, real tMax, hitRecord& record) const override;
 
-	virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const override {
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
 		// The bounding box must have non-zero width in each dimension, so pad the Z
 		// dimension a small amount.
 		if (m_z0 == m_z1) {
@@ -116,11 +113,11 @@ public:
 	}
 
 public:
-	double m_x0, m_x1, m_y0, m_y1, m_z0, m_z1;
+	real m_x0, m_x1, m_y0, m_y1, m_z0, m_z1;
 };
 
-bool aaRectangle::hit(const ray& r, double t_min, double t_max, hitRecord& rec) const {
-	double t, x, y, z;
+bool aaRectangle::hit(const ray& r, real t_min, real t_max, hitRecord& rec) const {
+	real t, x, y, z;
 
 	if (m_z0 == m_z1) {
 		t = (m_z0 - r.getOrigin().z()) / r.getDirection().z();
@@ -159,19 +156,34 @@ bool aaRectangle::hit(const ray& r, double t_min, double t_max, hitRecord& rec)
 
 	rec.t = t;
 	rec.setFaceNormal(r, m_triangles->m_vertices->m_normal);
-	rec.material_ptr = m_material_ptr;
+	rec.dpdu = rec.dpdv = vec3(0, 0, 0);
+	rec.material_ptr = m_material_ptr.get();
 	rec.point = r.resize(t);
 	return true;
 }
 
+// Box made of six rectangles. Scenes use box (box.h) instead; this stays as the reference
+// layout that --benchmark compares it against.
 class aaBox : public TriangleMesh {
 public:
 	aaBox() {}
 	aaBox(const point3& p0, const point3& p1, shared_ptr<material> mat_ptr);
 
-	virtual bool hit(const ray& ray, double tMin, double tMax, hitRecord& record) const override;
+	virtual bool hit(const ray& ray, real tMin, real tMax, hitRecord& record) const override;
+
+	// Bytes owned by one box: the sides, their make_shared control blocks (about two pointers
+	// each), the list's pointer array, and each side's array of two triangles.
+	size_t getByteSize() const {
+		size_t bytes = sizeof(aaBox) + m_sides.m_objects.capacity() * sizeof(shared_ptr<hittable>);
+		for (const auto& side : m_sides.m_objects) {
+			const aaRectangle& rectangle = static_cast<const aaRectangle&>(*side);
+			bytes += sizeof(aaRectangle) + 2 * sizeof(void*);
+			bytes += rectangle.m_trianglesN * sizeof(triangle);
+		}
+		return bytes;
+	}
 
-	virtual bool getAABB(double startTime, double endTime, aabb& outputBox) const override {
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
 		outputBox = aabb(m_boxMin, m_boxMax);
 		return true;
 	}
@@ -196,6 +208,6 @@ aaBox::aaBox(const point3& p0, const point3& p1, shared_ptr<material> mat_ptr) {
 	m_sides.add(make_shared<aaRectangle>(p0, p1 - vec3(p1.x() - p0.x(), 0.0, 0.0), mat_ptr));
 }
 
-bool aaBox::hit(const ray& r, double tMin, double tMax, hitRecord& record) const {
+bool aaBox::hit(const ray& r, real tMin, real tMax, hitRecord& record) const {
 	return m_sides.hit(r, tMin, tMax, record);
 }
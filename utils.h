@@ -1,7 +1,8 @@
 #pragma once
 
+#include "sampler.h"
+
 #include <cmath>
-#include <random>
 #include <limits>
 #include <memory>
 
@@ -9,6 +10,14 @@ using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
+// Scalar type of the geometry and shading math. Double by default; define RT_USE_FLOAT (for
+// example -DRT_USE_FLOAT) for a single-precision renderer with half the geometry footprint.
+#ifdef RT_USE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -21,13 +30,8 @@ inline double degreesToRadians(double degrees) {
 }
 
 inline double randomDouble() {
-	// C++ style random generation
-	static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-	static std::mt19937 generator;
-	return distribution(generator);
-	
-	// C style random generation
-	// return std::rand() / (RAND_MAX + 1.0);
+	// Draws from the calling thread's counter-based sampler, see sampler.h
+	return sampler::current().nextDouble();
 }
 
 inline double randomDouble(double min, double max) {
@@ -5,100 +5,114 @@
 
 using std::sqrt;
 
-class vec2 {
+template <typename T>
+class vec2T {
 public:
-    vec2() : m_e{0.0, 0.0} {}
-    vec2(double e0, double e1) : m_e{ e0, e1 } {}
+    using scalar = T;
 
-    double x() const { return m_e[0]; }
-    double y() const { return m_e[1]; }
+    vec2T() : m_e{0, 0} {}
+    vec2T(T e0, T e1) : m_e{ e0, e1 } {}
 
-    vec2 operator-() const { return vec2(-m_e[0], -m_e[1]); }
-    double operator[](int i) const { return m_e[i]; }
-    double& operator[](int i) { return m_e[i]; }
+    T x() const { return m_e[0]; }
+    T y() const { return m_e[1]; }
 
-    vec2& operator+=(const vec2& v) {
+    vec2T operator-() const { return vec2T(-m_e[0], -m_e[1]); }
+    T operator[](int i) const { return m_e[i]; }
+    T& operator[](int i) { return m_e[i]; }
+
+    vec2T& operator+=(const vec2T& v) {
         m_e[0] += v.m_e[0];
         m_e[1] += v.m_e[1];
         return *this;
     }
 
-    vec2& operator*=(const double t) {
+    vec2T& operator*=(const T t) {
         m_e[0] *= t;
         m_e[1] *= t;
         return *this;
     }
 
-    vec2& operator/=(const double t) {
+    vec2T& operator/=(const T t) {
         return *this *= 1 / t;
     }
 
-    double length() const {
+    T length() const {
         return sqrt(lengthSquared());
     }
 
-    double lengthSquared() const {
+    T lengthSquared() const {
         return m_e[0] * m_e[0] + m_e[1] * m_e[1];
     }
 
-    inline static vec2 random() {
-        return vec2(randomDouble(), randomDouble());
+    inline static vec2T random() {
+        return vec2T(T(randomDouble()), T(randomDouble()));
     }
 
-    inline static vec2 random(double min, double max) {
-        return vec2(randomDouble(min, max), randomDouble(min, max));
+    inline static vec2T random(double min, double max) {
+        return vec2T(T(randomDouble(min, max)), T(randomDouble(min, max)));
     }
 
     inline bool nearZero() const {
-        const double epsilon = 1e-8;
-        return (abs(m_e[0]) < epsilon) && (abs(m_e[1]) < epsilon);
+        const T epsilon = T(1e-8);
+        return (std::fabs(m_e[0]) < epsilon) && (std::fabs(m_e[1]) < epsilon);
     }
 
 public:
-    double m_e[2];
+    T m_e[2];
 };
 
 // Type aliases for vec2
+using vec2 = vec2T<real>;
 using point2 = vec2;   // 2D point
 
 // vec2 Utility Functions
 
-inline std::ostream& operator<<(std::ostream& out, const vec2& v) {
-    return out << v.m_e[0] << ' ' << v.m_e[1] << ' ' << v.m_e[2];
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec2T<T>& v) {
+    return out << v.m_e[0] << ' ' << v.m_e[1];
 }
 
-inline vec2 operator+(const vec2& u, const vec2& v) {
-    return vec2(u.m_e[0] + v.m_e[0], u.m_e[1] + v.m_e[1]);
+template <typename T>
+inline vec2T<T> operator+(const vec2T<T>& u, const vec2T<T>& v) {
+    return vec2T<T>(u.m_e[0] + v.m_e[0], u.m_e[1] + v.m_e[1]);
 }
 
-inline vec2 operator-(const vec2& u, const vec2& v) {
-    return vec2(u.m_e[0] - v.m_e[0], u.m_e[1] - v.m_e[1]);
+template <typename T>
+inline vec2T<T> operator-(const vec2T<T>& u, const vec2T<T>& v) {
+    return vec2T<T>(u.m_e[0] - v.m_e[0], u.m_e[1] - v.m_e[1]);
 }
 
-inline vec2 operator*(const vec2& u, const vec2& v) {
-    return vec2(u.m_e[0] * v.m_e[0], u.m_e[1] * v.m_e[1]);
+template <typename T>
+inline vec2T<T> operator*(const vec2T<T>& u, const vec2T<T>& v) {
+    return vec2T<T>(u.m_e[0] * v.m_e[0], u.m_e[1] * v.m_e[1]);
 }
 
-inline vec2 operator*(double t, const vec2& v) {
-    return vec2(t * v.m_e[0], t * v.m_e[1]);
+template <typename T>
+inline vec2T<T> operator*(typename vec2T<T>::scalar t, const vec2T<T>& v) {
+    return vec2T<T>(t * v.m_e[0], t * v.m_e[1]);
 }
 
-inline vec2 operator*(const vec2& v, double t) {
+template <typename T>
+inline vec2T<T> operator*(const vec2T<T>& v, typename vec2T<T>::scalar t) {
     return t * v;
 }
 
-inline vec2 operator/(vec2 v, double t) {
+template <typename T>
+inline vec2T<T> operator/(vec2T<T> v, typename vec2T<T>::scalar t) {
     return (1 / t) * v;
 }
 
-inline double dot(const vec2& u, const vec2& v) {
+template <typename T>
+inline T dot(const vec2T<T>& u, const vec2T<T>& v) {
     return u.m_e[0] * v.m_e[0] + u.m_e[1] * v.m_e[1];
 }
 
-inline double cross(const vec2& u, const vec2& v) {
+template <typename T>
+inline T cross(const vec2T<T>& u, const vec2T<T>& v) {
     return u.m_e[0] * v.m_e[1] - u.m_e[1] * v.m_e[0];
 }
 
-inline vec2 unitVector(vec2 v) {
+template <typename T>
+inline vec2T<T> unitVector(vec2T<T> v) {
     return v / v.length();
 }
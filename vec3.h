@@ -5,133 +5,158 @@
 
 using std::sqrt;
 
-class vec3 {
+// Three-component vector over the scalar type T. The renderer uses vec3 = vec3T<real>, see
+// utils.h; accumulators that must not lose precision use vec3T<double> in any build.
+template <typename T>
+class vec3T {
 public:
-    vec3() : m_e{ 0,0,0 } {}
-    vec3(double e0, double e1, double e2) : m_e{ e0, e1, e2 } {}
+    using scalar = T;
 
-    double x() const { return m_e[0]; }
-    double y() const { return m_e[1]; }
-    double z() const { return m_e[2]; }
+    vec3T() : m_e{ 0,0,0 } {}
+    vec3T(T e0, T e1, T e2) : m_e{ e0, e1, e2 } {}
 
-    vec3 operator-() const { return vec3(-m_e[0], -m_e[1], -m_e[2]); }
-    double operator[](int i) const { return m_e[i]; }
-    double& operator[](int i) { return m_e[i]; }
+    template <typename U>
+    explicit vec3T(const vec3T<U>& v) : m_e{ T(v.x()), T(v.y()), T(v.z()) } {}
 
-    vec3& operator+=(const vec3& v) {
+    T x() const { return m_e[0]; }
+    T y() const { return m_e[1]; }
+    T z() const { return m_e[2]; }
+
+    vec3T operator-() const { return vec3T(-m_e[0], -m_e[1], -m_e[2]); }
+    T operator[](int i) const { return m_e[i]; }
+    T& operator[](int i) { return m_e[i]; }
+
+    vec3T& operator+=(const vec3T& v) {
         m_e[0] += v.m_e[0];
         m_e[1] += v.m_e[1];
         m_e[2] += v.m_e[2];
         return *this;
     }
 
-    vec3& operator*=(const double t) {
+    vec3T& operator*=(const T t) {
         m_e[0] *= t;
         m_e[1] *= t;
         m_e[2] *= t;
         return *this;
     }
 
-    vec3& operator/=(const double t) {
+    vec3T& operator/=(const T t) {
         return *this *= 1 / t;
     }
 
-    double length() const {
+    T length() const {
         return sqrt(lengthSquared());
     }
 
-    double lengthSquared() const {
+    T lengthSquared() const {
         return m_e[0] * m_e[0] + m_e[1] * m_e[1] + m_e[2] * m_e[2];
     }
 
-    inline static vec3 random() {
-        return vec3(randomDouble(), randomDouble(), randomDouble());
+    inline static vec3T random() {
+        return vec3T(T(randomDouble()), T(randomDouble()), T(randomDouble()));
     }
 
-    inline static vec3 random(double min, double max) {
-        return vec3(randomDouble(min, max), randomDouble(min, max), randomDouble(min, max));
+    inline static vec3T random(double min, double max) {
+        return vec3T(T(randomDouble(min, max)), T(randomDouble(min, max)), T(randomDouble(min, max)));
     }
 
     inline bool nearZero() const {
-        const double epsilon = 1e-8;
-        return (abs(m_e[0]) < epsilon) && (abs(m_e[1]) < epsilon) && (abs(m_e[2]) < epsilon);
+        const T epsilon = T(1e-8);
+        return (std::fabs(m_e[0]) < epsilon) && (std::fabs(m_e[1]) < epsilon) && (std::fabs(m_e[2]) < epsilon);
     }
 
 public:
-    double m_e[3];
+    T m_e[3];
 };
 
 // Type aliases for vec3
+using vec3 = vec3T<real>;
 using point3 = vec3;   // 3D point
 using color = vec3;    // RGB color
 
-// vec3 Utility Functions
+// vec3 Utility Functions. Scalar arguments are taken as vec3T<T>::scalar so that T is deduced
+// from the vector alone and double literals still work with a float vector.
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec3T<T>& v) {
     return out << v.m_e[0] << ' ' << v.m_e[1] << ' ' << v.m_e[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return vec3(u.m_e[0] + v.m_e[0], u.m_e[1] + v.m_e[1], u.m_e[2] + v.m_e[2]);
+template <typename T>
+inline vec3T<T> operator+(const vec3T<T>& u, const vec3T<T>& v) {
+    return vec3T<T>(u.m_e[0] + v.m_e[0], u.m_e[1] + v.m_e[1], u.m_e[2] + v.m_e[2]);
 }
 
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.m_e[0] - v.m_e[0], u.m_e[1] - v.m_e[1], u.m_e[2] - v.m_e[2]);
+template <typename T>
+inline vec3T<T> operator-(const vec3T<T>& u, const vec3T<T>& v) {
+    return vec3T<T>(u.m_e[0] - v.m_e[0], u.m_e[1] - v.m_e[1], u.m_e[2] - v.m_e[2]);
 }
 
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.m_e[0] * v.m_e[0], u.m_e[1] * v.m_e[1], u.m_e[2] * v.m_e[2]);
+template <typename T>
+inline vec3T<T> operator*(const vec3T<T>& u, const vec3T<T>& v) {
+    return vec3T<T>(u.m_e[0] * v.m_e[0], u.m_e[1] * v.m_e[1], u.m_e[2] * v.m_e[2]);
 }
 
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t * v.m_e[0], t * v.m_e[1], t * v.m_e[2]);
+template <typename T>
+inline vec3T<T> operator*(typename vec3T<T>::scalar t, const vec3T<T>& v) {
+    return vec3T<T>(t * v.m_e[0], t * v.m_e[1], t * v.m_e[2]);
 }
 
-inline vec3 operator*(const vec3& v, double t) {
+template <typename T>
+inline vec3T<T> operator*(const vec3T<T>& v, typename vec3T<T>::scalar t) {
     return t * v;
 }
 
-inline vec3 operator/(vec3 v, double t) {
+template <typename T>
+inline vec3T<T> operator/(vec3T<T> v, typename vec3T<T>::scalar t) {
     return (1 / t) * v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const vec3T<T>& u, const vec3T<T>& v) {
     return u.m_e[0] * v.m_e[0]
         + u.m_e[1] * v.m_e[1]
         + u.m_e[2] * v.m_e[2];
 }
 
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.m_e[1] * v.m_e[2] - u.m_e[2] * v.m_e[1],
+template <typename T>
+inline vec3T<T> cross(const vec3T<T>& u, const vec3T<T>& v) {
+    return vec3T<T>(u.m_e[1] * v.m_e[2] - u.m_e[2] * v.m_e[1],
         u.m_e[2] * v.m_e[0] - u.m_e[0] * v.m_e[2],
         u.m_e[0] * v.m_e[1] - u.m_e[1] * v.m_e[0]);
 }
 
-inline vec3 unitVector(vec3 v) {
+template <typename T>
+inline vec3T<T> unitVector(vec3T<T> v) {
     return v / v.length();
 }
 
-inline vec3 reflect(const vec3& vector, const vec3& normal) {
+template <typename T>
+inline vec3T<T> reflect(const vec3T<T>& vector, const vec3T<T>& normal) {
     return vector - 2 * dot(vector, normal) * normal;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& normal, double coeff) {
-    double cosTheta = fmin(dot(-uv, normal), 1.0);
-    vec3 perpR = coeff * (uv + cosTheta * normal);
-    vec3 parallelR = -sqrt(fabs(1.0 - perpR.lengthSquared())) * normal;
+template <typename T>
+inline vec3T<T> refract(const vec3T<T>& uv, const vec3T<T>& normal, typename vec3T<T>::scalar coeff) {
+    T cosTheta = std::fmin(dot(-uv, normal), T(1));
+    vec3T<T> perpR = coeff * (uv + cosTheta * normal);
+    vec3T<T> parallelR = -sqrt(std::fabs(1 - perpR.lengthSquared())) * normal;
     return perpR + parallelR;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& normal, double cosTheta, double coeff) {
-    vec3 perpR = coeff * (uv + cosTheta * normal);
-    vec3 parallelR = -sqrt(fabs(1.0 - perpR.lengthSquared())) * normal;
+template <typename T>
+inline vec3T<T> refract(
+    const vec3T<T>& uv, const vec3T<T>& normal, typename vec3T<T>::scalar cosTheta, typename vec3T<T>::scalar coeff
+) {
+    vec3T<T> perpR = coeff * (uv + cosTheta * normal);
+    vec3T<T> parallelR = -sqrt(std::fabs(1 - perpR.lengthSquared())) * normal;
     return perpR + parallelR;
 }
 
 inline vec3 randomInUnitSphere() {
     while (true) {
         vec3 point = vec3::random(-1.0, 1.0);
-        if (point.lengthSquared() >= 1.0) continue;
+        if (point.lengthSquared() >= 1) continue;
         return point;
     }
 }
@@ -143,12 +168,12 @@ inline vec3 randomUnitVector() {
 inline vec3 randomInHemisphere(const vec3& normal) {
     // Alternate diffuse method
     vec3 inUnitSphere = randomInUnitSphere();
-    return dot(inUnitSphere, normal) > 0.0 ? inUnitSphere : -inUnitSphere;
+    return dot(inUnitSphere, normal) > 0 ? inUnitSphere : -inUnitSphere;
 }
 
 inline vec3 randomInUnitDisk() {
     while (true) {
-        vec3 point = vec3(randomDouble(-1.0, 1.0), randomDouble(-1.0, 1.0), 0.0);
+        vec3 point = vec3(real(randomDouble(-1.0, 1.0)), real(randomDouble(-1.0, 1.0)), 0);
         if (point.lengthSquared() >= 1) continue;
         return point;
     }
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "utils.h"
+
+#include "hittable.h"
+#include "hittableList.h"
+#include "bvhBuilder.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Node with up to Width children. Child bounds are stored as floats in structure-of-arrays
+// rows (min x, y, z, then max x, y, z), so one SIMD slab test covers every child at once.
+// Unused slots hold an inverted box that no ray can enter.
+template <int Width>
+struct wideBvhNode {
+	float bounds[6][Width];
+	std::uint32_t child[Width]; // Interior child: node index, leaf child: first primitive
+	std::uint16_t count[Width]; // Primitives of a leaf child, zero for interior children and unused slots
+};
+
+namespace wideBvhDetail {
+	// Float versions of a ray, with per-axis rows of the nearer and farther slab. The origin is
+	// nudged by its own rounding error toward the near planes and away from the far planes, so
+	// testing in float never rejects a box the full-precision ray would enter.
+	struct rayData {
+		float nearOrigin[3];
+		float farOrigin[3];
+		float inverseDirection[3];
+		int nearRow[3];
+		int farRow[3];
+	};
+
+	inline rayData prepareRay(const ray& r) {
+		rayData data;
+		const point3 origin = r.getOrigin();
+		const vec3 direction = r.getDirection();
+
+		for (int a = 0; a < 3; a++) {
+			float o = static_cast<float>(origin[a]);
+			float error = (std::fabs(o) + 1.0f) * FLT_EPSILON;
+			bool negative = std::signbit(direction[a]);
+
+			data.inverseDirection[a] = static_cast<float>(1.0 / direction[a]);
+			data.nearRow[a] = negative ? a + 3 : a;
+			data.farRow[a] = negative ? a : a + 3;
+			data.nearOrigin[a] = negative ? o - error : o + error;
+			data.farOrigin[a] = negative ? o + error : o - error;
+		}
+
+		return data;
+	}
+
+	// Covers the rounding of the float subtraction and multiplication, see pbrt-v3 section 3.9.2.
+	const float farScale = 1.0f + 4.0f * FLT_EPSILON;
+
+	// Tests the ray against every child box, returning a bit per hit child and each child's entry
+	// distance. Four lanes at a time with SSE, eight at a time with AVX for BVH8.
+	template <int Width>
+	inline int slabTest(const wideBvhNode<Width>& node, const rayData& r, float tMin, float tMax, float* tNear) {
+		int mask = 0;
+
+#ifdef RT_SIMD_SSE
+		for (int c = 0; c < Width; c += 4) {
+			__m128 entry = _mm_set1_ps(tMin);
+			__m128 exit = _mm_set1_ps(tMax);
+
+			for (int a = 0; a < 3; a++) {
+				__m128 inverse = _mm_set1_ps(r.inverseDirection[a]);
+				__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.bounds[r.nearRow[a]][c]), _mm_set1_ps(r.nearOrigin[a])), inverse);
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.bounds[r.farRow[a]][c]), _mm_set1_ps(r.farOrigin[a])), inverse);
+				// The running value goes second: a NaN from 0 * inf then leaves it unchanged.
+				entry = _mm_max_ps(t0, entry);
+				exit = _mm_min_ps(t1, exit);
+			}
+
+			exit = _mm_mul_ps(exit, _mm_set1_ps(farScale));
+			mask |= _mm_movemask_ps(_mm_cmple_ps(entry, exit)) << c;
+			_mm_storeu_ps(tNear + c, entry);
+		}
+#else
+		for (int c = 0; c < Width; c++) {
+			float entry = tMin, exit = tMax;
+			for (int a = 0; a < 3; a++) {
+				float t0 = (node.bounds[r.nearRow[a]][c] - r.nearOrigin[a]) * r.inverseDirection[a];
+				float t1 = (node.bounds[r.farRow[a]][c] - r.farOrigin[a]) * r.inverseDirection[a];
+				entry = t0 > entry ? t0 : entry;
+				exit = t1 < exit ? t1 : exit;
+			}
+			if (entry <= exit * farScale) mask |= 1 << c;
+			tNear[c] = entry;
+		}
+#endif
+
+		return mask;
+	}
+
+#ifdef RT_SIMD_AVX
+	template <>
+	inline int slabTest<8>(const wideBvhNode<8>& node, const rayData& r, float tMin, float tMax, float* tNear) {
+		__m256 entry = _mm256_set1_ps(tMin);
+		__m256 exit = _mm256_set1_ps(tMax);
+
+		for (int a = 0; a < 3; a++) {
+			__m256 inverse = _mm256_set1_ps(r.inverseDirection[a]);
+			__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[r.nearRow[a]]), _mm256_set1_ps(r.nearOrigin[a])), inverse);
+			__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[r.farRow[a]]), _mm256_set1_ps(r.farOrigin[a])), inverse);
+			entry = _mm256_max_ps(t0, entry);
+			exit = _mm256_min_ps(t1, exit);
+		}
+
+		exit = _mm256_mul_ps(exit, _mm256_set1_ps(farScale));
+		_mm256_storeu_ps(tNear, entry);
+		return _mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ));
+	}
+#endif
+}
+
+// Bounding volume hierarchy with 4 or 8 children per node, collapsed from the binary SAH build
+// by repeatedly opening the child with the largest surface area. A ray visits far fewer nodes
+// than in a binary tree, each visit tests all children with one SIMD slab test against the
+// reciprocal direction computed once per ray, and hit children are visited nearest first.
+template <int Width>
+class wideBvh : public hittable {
+	static_assert(Width == 4 || Width == 8, "wideBvh supports 4 or 8 children per node");
+
+public:
+	wideBvh() {}
+	wideBvh(const hittableList& entities, real startTime, real endTime, int maxLeafSize = 4);
+
+	virtual bool hit(const ray& r, real tMin, real tMax, hitRecord& record) const override {
+		return hitDeferred(*this, r, tMin, tMax, record);
+	}
+
+	virtual bool intersect(const ray& r, real tMin, real tMax, hitRecord& record) const override;
+
+	virtual bool getAABB(real startTime, real endTime, aabb& outputBox) const override {
+		if (m_nodes.empty()) return false;
+		outputBox = m_box;
+		return true;
+	}
+
+	size_t getNodeCount() const { return m_nodes.size(); }
+
+private:
+	std::uint32_t collapse(const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects);
+
+private:
+	std::vector<shared_ptr<hittable>> m_primitives; // Reordered so every leaf is a contiguous run
+	std::vector<wideBvhNode<Width>> m_nodes;
+	aabb m_box;
+};
+
+using bvh4 = wideBvh<4>;
+using bvh8 = wideBvh<8>;
+
+template <int Width>
+wideBvh<Width>::wideBvh(const hittableList& entities, real startTime, real endTime, int maxLeafSize) {
+	const std::vector<shared_ptr<hittable>>& objects = entities.m_objects;
+	if (objects.empty()) return;
+
+	bvhBuilder builder(gatherBounds(objects, 0, objects.size(), startTime, endTime), std::min(maxLeafSize, 0xffff));
+	builder.build();
+
+	m_box = builder.getNode(builder.getRoot()).box;
+	m_primitives.reserve(objects.size());
+	collapse(builder, builder.getRoot(), objects);
+
+	std::cerr << "bvh" << Width << ": " << objects.size() << " objects, " << m_nodes.size() << " nodes built in "
+		<< builder.getBuildMilliseconds() << " ms\n";
+}
+
+// Emits one wide node for the binary subtree at nodeIndex and returns its index.
+template <int Width>
+std::uint32_t wideBvh<Width>::collapse(
+	const bvhBuilder& builder, std::uint32_t nodeIndex, const std::vector<shared_ptr<hittable>>& objects
+) {
+	using namespace wideBvhDetail;
+
+	std::uint32_t children[Width];
+	int childCount = 0;
+
+	const bvhBuildNode& node = builder.getNode(nodeIndex);
+	if (node.count > 0) {
+		children[childCount++] = nodeIndex; // A single leaf root
+	} else {
+		children[childCount++] = node.firstChild;
+		children[childCount++] = node.firstChild + 1;
+	}
+
+	// Pull grandchildren up until the node is full, largest boxes first.
+	while (childCount < Width) {
+		int largest = -1;
+		double largestArea = -1.0;
+		for (int i = 0; i < childCount; i++) {
+			const bvhBuildNode& candidate = builder.getNode(children[i]);
+			if (candidate.count == 0 && surfaceArea(candidate.box) > largestArea) {
+				largest = i;
+				largestArea = surfaceArea(candidate.box);
+			}
+		}
+		if (largest < 0) break;
+
+		std::uint32_t opened = builder.getNode(children[largest]).firstChild;
+		children[largest] = opened;
+		children[childCount++] = opened + 1;
+	}
+
+	std::uint32_t wideIndex = static_cast<std::uint32_t>(m_nodes.size());
+	m_nodes.emplace_back();
+
+	for (int i = 0; i < Width; i++) {
+		float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		std::uint32_t child = 0;
+		std::uint16_t count = 0;
+
+		if (i < childCount) {
+			const bvhBuildNode& source = builder.getNode(children[i]);
+			for (int a = 0; a < 3; a++) {
+				lower[a] = roundDown(source.box.m_min[a]);
+				upper[a] = roundUp(source.box.m_max[a]);
+			}
+
+			if (source.count > 0) {
+				child = static_cast<std::uint32_t>(m_primitives.size());
+				count = static_cast<std::uint16_t>(source.count);
+				for (std::uint32_t p = source.start; p < source.start + source.count; p++)
+					m_primitives.push_back(objects[builder.getPrimitive(p)]);
+			} else {
+				child = collapse(builder, children[i], objects);
+			}
+		}
+
+		// m_nodes may have grown during the recursion, so index it afresh.
+		wideBvhNode<Width>& wide = m_nodes[wideIndex];
+		for (int a = 0; a < 3; a++) {
+			wide.bounds[a][i] = lower[a];
+			wide.bounds[a + 3][i] = upper[a];
+		}
+		wide.child[i] = child;
+		wide.count[i] = count;
+	}
+
+	return wideIndex;
+}
+
+template <int Width>
+bool wideBvh<Width>::intersect(const ray& r, real tMin, real tMax, hitRecord& record) const {
+	using namespace wideBvhDetail;
+
+	if (m_nodes.empty()) return false;
+
+	struct stackEntry {
+		std::uint32_t child;
+		std::uint16_t count;
+		float tNear;
+	};
+
+	const rayData data = prepareRay(r);
+	const float floatMin = roundDown(tMin);
+	float floatMax = roundUp(tMax);
+
+	// Every wide level spans at least one binary level and pushes up to Width - 1 siblings.
+	stackEntry stack[bvhBuilder::s_maxDepth * (Width - 1) + 1];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, 0, floatMin };
+	bool hasHit = false;
+
+	while (stackSize > 0) {
+		const stackEntry entry = stack[--stackSize];
+		if (entry.tNear > floatMax) continue; // A closer hit was found after this was pushed
+
+		if (entry.count > 0) {
+			for (std::uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+				if (m_primitives[i]->intersect(r, tMin, tMax, record)) {
+					hasHit = true;
+					tMax = record.t;
+					floatMax = roundUp(tMax);
+				}
+			}
+			continue;
+		}
+
+		const wideBvhNode<Width>& node = m_nodes[entry.child];
+		float tNear[Width];
+		int mask = slabTest<Width>(node, data, floatMin, floatMax, tNear);
+
+		// Push hit children farthest first, so the nearest is popped next.
+		int first = stackSize;
+		for (int i = 0; i < Width; i++) {
+			if (!(mask & (1 << i))) continue;
+
+			stackEntry child = { node.child[i], node.count[i], tNear[i] };
+			int j = stackSize++;
+			for (; j > first && stack[j - 1].tNear < child.tNear; j--) stack[j] = stack[j - 1];
+			stack[j] = child;
+		}
+	}
+
+	return hasHit;
+}